@@ -0,0 +1,129 @@
+#include "ai.h"
+
+
+static Sim_Fixed face_x(const Sim_State * state, int paddle) {
+    /* Where the ball's center touches the front face of 'paddle'. */
+    Sim_Fixed reach = (state->items[paddle].width + state->items[ID_BALL].width)*
+                      (SIM_FIXED_ONE/2);
+    Sim_Fixed x = state->positions[paddle].x;
+    return x < 0 ? x + reach : x - reach;
+}
+
+
+static Sim_Fixed turn_x(const Sim_State * state, Sim_Fixed ball_x, int direction) {
+    /* Where a ball at 'ball_x' moving in 'direction' along x turns back: the
+     * face of the paddle on that side if the ball is still in front of it,
+     * the wall behind it otherwise. */
+
+    int paddle = state->positions[ID_PADDLE_RIGHT].x > 0 ? ID_PADDLE_RIGHT : ID_PADDLE_LEFT;
+    if (direction < 0) {
+        paddle = paddle == ID_PADDLE_RIGHT ? ID_PADDLE_LEFT : ID_PADDLE_RIGHT;
+    }
+    Sim_Fixed face = face_x(state, paddle);
+    if ((int64_t)(face - ball_x)*direction >= 0) {
+        return face;
+    }
+    Sim_Fixed limit = state->env.width*(SIM_FIXED_ONE/2) -
+                      state->items[ID_BALL].width*(SIM_FIXED_ONE/2);
+    return direction > 0 ? limit : -limit;
+}
+
+
+bool ai_predict(const Sim_State * state, int paddle, Sim_Fixed * y, int64_t * ticks) {
+    /* Predict the height at which the ball's center will reach the face of
+     * 'paddle', and in how many ticks. Returns false if the ball does not
+     * move along x and never will. */
+
+    Sim_Vec ball = state->positions[ID_BALL];
+    Sim_Vec speed = state->items[ID_BALL].speed;
+    if (speed.x == 0) {
+        return false;
+    }
+    int direction = speed.x > 0 ? 1 : -1;
+
+    /* Distance along x to the face, unfolded at the turning point if the
+     * ball is moving away. */
+    Sim_Fixed face = face_x(state, paddle);
+    int64_t distance;
+    if ((int64_t)(face - ball.x)*direction >= 0) {
+        distance = (int64_t)(face - ball.x)*direction;
+    } else {
+        Sim_Fixed turn = turn_x(state, ball.x, direction);
+        distance = (int64_t)(turn - ball.x)*direction + (int64_t)(turn - face)*direction;
+    }
+    int64_t speed_x = (int64_t)speed.x*direction;
+    *ticks = (distance + speed_x - 1)/speed_x;
+
+    /* Height on the unfolded straight line, folded back between the walls
+     * the center can reach: mirrored copies repeat every 4 half heights. */
+    int64_t limit = (int64_t)state->env.height*(SIM_FIXED_ONE/2) -
+                    state->items[ID_BALL].height*(SIM_FIXED_ONE/2);
+    int64_t unfolded = ball.y + (int64_t)speed.y*distance/speed_x;
+    int64_t period = 4*limit;
+    int64_t phase = (unfolded + limit) % period;
+    phase = phase < 0 ? phase + period : phase;
+    *y = (Sim_Fixed)(phase <= 2*limit ? phase - limit : 3*limit - phase);
+    return true;
+}
+
+
+void ai_init(Ai * ai, const Ai_Config * config) {
+    /* Start an opponent that has seen nothing yet. */
+    *ai = (Ai){
+        .config = *config,
+        .rng = config->seed ? config->seed : 0x9e3779b9u,
+    };
+}
+
+
+static int aim_error(Ai * ai) {
+    /* Uniform in [-error, error] pixels (xorshift32). */
+    uint32_t x = ai->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    ai->rng = x;
+    int error = ai->config.error;
+    return error > 0 ? (int)(x % (uint32_t)(2*error + 1)) - error : 0;
+}
+
+
+Sim_Input ai_input(Ai * ai, const Sim_State * state) {
+    /* Decide the input bits for the paddle of 'ai' for the next step. */
+
+    /* A ball that turned is a new shot, noticed after the reaction time. */
+    Sim_Fixed speed_x = state->items[ID_BALL].speed.x;
+    int direction = speed_x > 0 ? 1 : (speed_x < 0 ? -1 : 0);
+    if (direction != ai->direction) {
+        ai->direction = direction;
+        ai->wait = ai->config.reaction_ticks;
+        ai->aiming = false;
+    }
+
+    if (!ai->aiming) {
+        if (ai->wait > 0) {
+            ai->wait--;
+        } else {
+            Sim_Fixed y;
+            int64_t ticks;
+            if (ai_predict(state, ai->config.paddle, &y, &ticks)) {
+                ai->target = y + aim_error(ai)*SIM_FIXED_ONE;
+                ai->predictions++;
+            }
+            ai->aiming = true;
+        }
+    }
+
+    /* Head for the target, until within half a step of it. */
+    int paddle = ai->config.paddle;
+    Sim_Fixed offset = ai->target - state->positions[paddle].y;
+    Sim_Fixed slack = state->items[paddle].speed.y/2;
+    bool left = paddle == ID_PADDLE_LEFT;
+    if (offset > slack) {
+        return left ? INPUT_LEFT_UP : INPUT_RIGHT_UP;
+    }
+    if (offset < -slack) {
+        return left ? INPUT_LEFT_DOWN : INPUT_RIGHT_DOWN;
+    }
+    return 0;
+}
@@ -0,0 +1,49 @@
+#ifndef AI_H
+#define AI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sim.h"
+
+/* Computer opponent for either paddle.
+ *
+ * Where the ball will cross a paddle's face is found in closed form rather
+ * than by stepping the simulation ahead. Between walls the ball's center
+ * moves in a straight line, and a bounce off the top or bottom wall mirrors
+ * the rest of the path, so in the arena unfolded into mirrored copies the
+ * path is one straight line. Its height at the face, folded back into the
+ * arena, is the intercept, at a constant cost however far or fast the ball
+ * travels. A ball moving away is taken to come back off the far paddle's
+ * face, or the wall behind it, which is one more mirror along x. The ball
+ * glancing off the end of a paddle is the one thing this misses.
+ *
+ * The controller plays like a person would: it notices the ball has turned
+ * only 'reaction_ticks' later, then predicts once and heads for the
+ * intercept, off by up to 'error' pixels drawn anew for every shot. */
+
+
+typedef struct Ai_Config {
+    int paddle; /* ID_PADDLE_LEFT or ID_PADDLE_RIGHT. */
+    uint32_t reaction_ticks; /* Before reacting to a new shot. */
+    int error; /* Most pixels the aim is off by. */
+    uint32_t seed; /* Of the aim errors, not zero. */
+} Ai_Config;
+
+
+typedef struct Ai {
+    Ai_Config config;
+    uint32_t rng;
+    int direction; /* Sign of the ball's x speed when last seen. */
+    uint32_t wait; /* Ticks until reacting to the current shot. */
+    bool aiming; /* Predicted the current shot. */
+    Sim_Fixed target; /* Height the paddle's center heads for. */
+    uint64_t predictions;
+} Ai;
+
+
+bool ai_predict(const Sim_State * state, int paddle, Sim_Fixed * y, int64_t * ticks);
+void ai_init(Ai * ai, const Ai_Config * config);
+Sim_Input ai_input(Ai * ai, const Sim_State * state);
+
+#endif
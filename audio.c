@@ -0,0 +1,140 @@
+#include <string.h>
+
+#include "audio.h"
+#include "trace.h"
+
+
+static int audio_callback(const void * input,
+                          void * output,
+                          unsigned long num_frames,
+                          const PaStreamCallbackTimeInfo * time_info,
+                          PaStreamCallbackFlags status,
+                          void * data) {
+    /* Fill the next buffer, on PortAudio's thread. */
+
+    (void)input;
+    Audio * audio = data;
+    double start = trace_now();
+
+    if (status & paOutputUnderflow) {
+        audio->stats.underruns++;
+    }
+
+    /* Until the first sample of this buffer is heard, as far as the host
+     * knows. */
+    double delay = time_info->outputBufferDacTime - time_info->currentTime;
+    if (delay <= 0.0) {
+        delay = audio->output_latency;
+    }
+
+    /* At most a queue's worth, so a busy producer cannot keep the callback
+     * past its deadline. */
+    Sound_Event event;
+    for (int i=0; i<SOUND_QUEUE_SIZE && sound_queue_pop(&audio->queue, &event); i++) {
+        sound_synth_trigger(&audio->synth, event.events);
+        histogram_add(&audio->latency, start - event.time + delay);
+        audio->stats.events++;
+    }
+
+    sound_synth_render(&audio->synth, output, num_frames, AUDIO_CHANNELS);
+
+    double elapsed = trace_now() - start;
+    histogram_add(&audio->callback_time, elapsed);
+    audio->stats.callbacks++;
+    if (elapsed > (double)num_frames/audio->sample_rate) {
+        audio->stats.late++;
+    }
+    return paContinue;
+}
+
+
+int audio_open(Audio * audio, int sample_rate, unsigned long num_frames) {
+    /* Start playing on the default output device, 'num_frames' frames per
+     * buffer at 'sample_rate'. Returns 0 on success, -1 on failure. */
+
+    memset(audio, 0, sizeof(*audio));
+    audio->sample_rate = sample_rate;
+    sound_synth_init(&audio->synth, sample_rate);
+
+    if (Pa_Initialize() != paNoError) {
+        return -1;
+    }
+    audio->initialized = 1;
+
+    PaDeviceIndex device = Pa_GetDefaultOutputDevice();
+    const PaDeviceInfo * device_info = device != paNoDevice ? Pa_GetDeviceInfo(device) : NULL;
+    if (!device_info) {
+        audio_close(audio);
+        return -1;
+    }
+
+    PaStreamParameters parameters = {
+        .device = device,
+        .channelCount = AUDIO_CHANNELS,
+        .sampleFormat = paFloat32,
+        .suggestedLatency = device_info->defaultLowOutputLatency,
+        .hostApiSpecificStreamInfo = NULL,
+    };
+    if (Pa_OpenStream(&audio->stream, NULL, &parameters, sample_rate, num_frames,
+                      paNoFlag, audio_callback, audio) != paNoError) {
+        audio->stream = NULL;
+        audio_close(audio);
+        return -1;
+    }
+
+    const PaStreamInfo * stream_info = Pa_GetStreamInfo(audio->stream);
+    audio->output_latency = stream_info ? stream_info->outputLatency : 0.0;
+
+    if (Pa_StartStream(audio->stream) != paNoError) {
+        audio_close(audio);
+        return -1;
+    }
+    return 0;
+}
+
+
+void audio_post(Audio * audio, uint32_t events) {
+    /* Play the sounds of the SIM_EVENT_* bits in 'events'. From the one
+     * thread that runs the simulation only. */
+    if (!audio->stream || events == 0) {
+        return;
+    }
+    sound_queue_push(&audio->queue, (Sound_Event){.time = trace_now(), .events = events});
+}
+
+
+int audio_close(Audio * audio) {
+    /* Stop the stream, after the callback running returns, and shut
+     * PortAudio down. Returns 0 on success, -1 on failure. */
+
+    int result = 0;
+    if (audio->stream) {
+        if (Pa_StopStream(audio->stream) != paNoError) {
+            result = -1;
+        }
+        if (Pa_CloseStream(audio->stream) != paNoError) {
+            result = -1;
+        }
+        audio->stream = NULL;
+    }
+    if (audio->initialized) {
+        Pa_Terminate();
+        audio->initialized = 0;
+    }
+    return result;
+}
+
+
+void audio_print(const Audio * audio, FILE * file) {
+    /* Report how soon the sounds were heard and how the callback kept up. */
+    histogram_print(&audio->latency, "sound latency", file);
+    histogram_print(&audio->callback_time, "audio callback", file);
+    fprintf(file, "audio: %llu callbacks, %llu late, %llu underruns, "
+                  "%llu events, %llu dropped, output latency %.2f ms\n",
+            (unsigned long long)audio->stats.callbacks,
+            (unsigned long long)audio->stats.late,
+            (unsigned long long)audio->stats.underruns,
+            (unsigned long long)audio->stats.events,
+            (unsigned long long)audio->queue.ring.dropped,
+            audio->output_latency*1000.0);
+}
@@ -0,0 +1,62 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <portaudio.h>
+
+#include "histogram.h"
+#include "sound.h"
+
+/* Sound effects played on PortAudio's own thread.
+ *
+ * The simulation posts the events of every tick into a lock-free queue,
+ * stamped with the time. PortAudio calls back for every buffer of
+ * AUDIO_FRAMES frames: the callback takes whatever events are queued,
+ * starts their blips and mixes the voices into the buffer, and does
+ * nothing that could block, lock or allocate. The buffer is kept short and
+ * the lowest latency the device offers is asked for, so an event is heard
+ * a few milliseconds after it happened.
+ *
+ * For every event the time from posting to the first sample reaching the
+ * device is kept in a histogram, the wait for the callback plus the output
+ * latency the host reports for the buffer. So is the time each callback
+ * took, with how many ran past the length of their buffer and how many
+ * buffers the device ran dry on. The callback alone writes these, so they
+ * are read once the stream is closed. */
+
+
+#define AUDIO_SAMPLE_RATE 48000
+#define AUDIO_FRAMES 128
+#define AUDIO_CHANNELS 2
+
+
+typedef struct Audio_Stats {
+    uint64_t callbacks;
+    uint64_t underruns; /* Buffers the device ran out of samples on. */
+    uint64_t late; /* Callbacks that took longer than their buffer lasts. */
+    uint64_t events; /* Taken from the queue. */
+} Audio_Stats;
+
+
+typedef struct Audio {
+    PaStream * stream;
+    int initialized; /* PortAudio itself. */
+    int sample_rate;
+    double output_latency; /* Seconds, as reported for the open stream. */
+
+    Sound_Queue queue;
+    Sound_Synth synth; /* Callback only. */
+
+    Histogram callback_time; /* Seconds per callback. */
+    Histogram latency; /* Seconds from posting an event to hearing it. */
+    Audio_Stats stats;
+} Audio;
+
+
+int audio_open(Audio * audio, int sample_rate, unsigned long num_frames);
+void audio_post(Audio * audio, uint32_t events);
+int audio_close(Audio * audio);
+void audio_print(const Audio * audio, FILE * file);
+
+#endif
@@ -0,0 +1,215 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BALLS_X86 1
+#endif
+
+#include "balls.h"
+
+
+int balls_init(Ball_Store * balls, size_t capacity) {
+    /* Allocate zeroed arrays for at least 'capacity' balls. Returns 0 on
+     * success. */
+
+    memset(balls, 0, sizeof(*balls));
+
+    /* Round up so the kernels never need a scalar tail. */
+    capacity = (capacity + BALLS_LANES-1) / BALLS_LANES * BALLS_LANES;
+    if (capacity == 0) {
+        capacity = BALLS_LANES;
+    }
+
+    float ** arrays[] = {
+        &balls->x, &balls->y,
+        &balls->vx, &balls->vy,
+        &balls->half_width, &balls->half_height,
+    };
+
+    size_t size = capacity*sizeof(float);
+    for (size_t i=0; i<sizeof(arrays)/sizeof(arrays[0]); i++) {
+        *arrays[i] = aligned_alloc(32, size);
+        if (!*arrays[i]) {
+            balls_free(balls);
+            return -1;
+        }
+        memset(*arrays[i], 0, size);
+    }
+
+    balls->capacity = capacity;
+    return 0;
+}
+
+
+void balls_free(Ball_Store * balls) {
+    free(balls->x);
+    free(balls->y);
+    free(balls->vx);
+    free(balls->vy);
+    free(balls->half_width);
+    free(balls->half_height);
+    memset(balls, 0, sizeof(*balls));
+}
+
+
+static float random_unit(uint32_t * rng) {
+    /* Return a reproducible pseudo-random float in [0, 1) (xorshift32). */
+    uint32_t x = *rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *rng = x;
+    return (x >> 8) * (1.0f/16777216.0f);
+}
+
+
+void balls_spawn(Ball_Store * balls, size_t count, const Sim_State * state, uint32_t seed) {
+    /* Fill the store with 'count' balls shaped like the ball in 'state',
+     * scattered over the arena and moving in random directions at the ball's
+     * speed. */
+
+    if (count > balls->capacity) {
+        count = balls->capacity;
+    }
+
+    Item_Data ball = state->items[ID_BALL];
+    Data_Environment env = state->env;
+
+    float half_width = ball.width*env.delta_width*0.5f;
+    float half_height = ball.height*env.delta_height*0.5f;
+    float speed = fabsf((float)ball.speed.x/SIM_FIXED_ONE); /* Pixels per tick. */
+
+    uint32_t rng = seed ? seed : 1;
+    for (size_t i=0; i<count; i++) {
+        float angle = random_unit(&rng)*6.2831853f;
+        balls->x[i] = (random_unit(&rng)*2.0f-1.0f)*(1.0f-half_width);
+        balls->y[i] = (random_unit(&rng)*2.0f-1.0f)*(1.0f-half_height);
+        balls->vx[i] = cosf(angle)*speed*env.delta_width;
+        balls->vy[i] = sinf(angle)*speed*env.delta_height;
+        balls->half_width[i] = half_width;
+        balls->half_height[i] = half_height;
+    }
+    balls->count = count;
+}
+
+
+void balls_step_scalar(Ball_Store * balls) {
+    /* Reference kernel: move every ball one tick and reflect it off the
+     * arena walls, clamping it back inside like move_non_controlled_items
+     * does for the single ball. */
+
+    size_t count = balls->count;
+    for (size_t i=0; i<count; i++) {
+        float next_x = balls->x[i] + balls->vx[i];
+        float limit_x = 1.0f - balls->half_width[i];
+        if (next_x > limit_x) {
+            next_x = limit_x;
+            balls->vx[i] = -balls->vx[i];
+        } else if (next_x < -limit_x) {
+            next_x = -limit_x;
+            balls->vx[i] = -balls->vx[i];
+        }
+        balls->x[i] = next_x;
+
+        float next_y = balls->y[i] + balls->vy[i];
+        float limit_y = 1.0f - balls->half_height[i];
+        if (next_y > limit_y) {
+            next_y = limit_y;
+            balls->vy[i] = -balls->vy[i];
+        } else if (next_y < -limit_y) {
+            next_y = -limit_y;
+            balls->vy[i] = -balls->vy[i];
+        }
+        balls->y[i] = next_y;
+    }
+}
+
+
+#ifdef BALLS_X86
+
+static void balls_step_sse(Ball_Store * balls) {
+    /* SSE kernel, 4 balls per iteration. A ball that leaves [-limit, limit]
+     * is clamped to the wall it crossed and has its speed negated; the sign
+     * flip is a xor with the sign bit under the crossing mask. */
+
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+
+    float * pos[2] = {balls->x, balls->y};
+    float * vel[2] = {balls->vx, balls->vy};
+    float * half[2] = {balls->half_width, balls->half_height};
+
+    for (size_t i=0; i<balls->count; i+=4) {
+        for (size_t axis=0; axis<2; axis++) {
+            __m128 p = _mm_load_ps(pos[axis]+i);
+            __m128 v = _mm_load_ps(vel[axis]+i);
+            __m128 limit = _mm_sub_ps(one, _mm_load_ps(half[axis]+i));
+
+            __m128 next = _mm_add_ps(p, v);
+            __m128 low = _mm_xor_ps(limit, sign);
+            __m128 crossed = _mm_or_ps(_mm_cmpgt_ps(next, limit),
+                                       _mm_cmplt_ps(next, low));
+
+            next = _mm_min_ps(_mm_max_ps(next, low), limit);
+            v = _mm_xor_ps(v, _mm_and_ps(crossed, sign));
+
+            _mm_store_ps(pos[axis]+i, next);
+            _mm_store_ps(vel[axis]+i, v);
+        }
+    }
+}
+
+
+__attribute__((target("avx2")))
+static void balls_step_avx2(Ball_Store * balls) {
+    /* AVX2 version of balls_step_sse, 8 balls per iteration. */
+
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+
+    float * pos[2] = {balls->x, balls->y};
+    float * vel[2] = {balls->vx, balls->vy};
+    float * half[2] = {balls->half_width, balls->half_height};
+
+    for (size_t i=0; i<balls->count; i+=8) {
+        for (size_t axis=0; axis<2; axis++) {
+            __m256 p = _mm256_load_ps(pos[axis]+i);
+            __m256 v = _mm256_load_ps(vel[axis]+i);
+            __m256 limit = _mm256_sub_ps(one, _mm256_load_ps(half[axis]+i));
+
+            __m256 next = _mm256_add_ps(p, v);
+            __m256 low = _mm256_xor_ps(limit, sign);
+            __m256 crossed = _mm256_or_ps(_mm256_cmp_ps(next, limit, _CMP_GT_OQ),
+                                          _mm256_cmp_ps(next, low, _CMP_LT_OQ));
+
+            next = _mm256_min_ps(_mm256_max_ps(next, low), limit);
+            v = _mm256_xor_ps(v, _mm256_and_ps(crossed, sign));
+
+            _mm256_store_ps(pos[axis]+i, next);
+            _mm256_store_ps(vel[axis]+i, v);
+        }
+    }
+}
+
+#endif
+
+
+void balls_step(Ball_Store * balls) {
+    /* Advance all balls one tick with the widest kernel the CPU supports.
+     * Padding lanes are zero sized and still, so they are safe to process. */
+#ifdef BALLS_X86
+    static int has_avx2 = -1;
+    if (has_avx2 < 0) {
+        has_avx2 = __builtin_cpu_supports("avx2");
+    }
+    if (has_avx2) {
+        balls_step_avx2(balls);
+    } else {
+        balls_step_sse(balls);
+    }
+#else
+    balls_step_scalar(balls);
+#endif
+}
@@ -0,0 +1,38 @@
+#ifndef BALLS_H
+#define BALLS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sim.h"
+
+/* Struct-of-arrays store for the multi-ball mode. Every field lives in its
+ * own contiguous, 32-byte aligned array so the update kernel can integrate
+ * and bounce 4 (SSE) or 8 (AVX2) balls per instruction. Positions and
+ * speeds are floats in normalized device coordinates per tick, ready for
+ * rendering; unlike Sim_State they are not bit exact across machines. */
+
+
+/* Arrays are padded to a multiple of this many lanes. */
+#define BALLS_LANES 8
+
+
+typedef struct Ball_Store {
+    size_t count;
+    size_t capacity;
+    float * x;
+    float * y;
+    float * vx;
+    float * vy;
+    float * half_width;
+    float * half_height;
+} Ball_Store;
+
+
+int balls_init(Ball_Store * balls, size_t capacity);
+void balls_free(Ball_Store * balls);
+void balls_spawn(Ball_Store * balls, size_t count, const Sim_State * state, uint32_t seed);
+void balls_step(Ball_Store * balls);
+void balls_step_scalar(Ball_Store * balls);
+
+#endif
@@ -0,0 +1,416 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+
+
+/* What the ball of a game hit first in the current pass. One bit each, so
+ * groups of hits are tested with a mask rather than a chain of compares. */
+enum {
+    BATCH_HIT_NONE = 0,
+    BATCH_HIT_WALL_RIGHT = 1,
+    BATCH_HIT_WALL_LEFT = 2,
+    BATCH_HIT_WALL_Y = 4,
+    BATCH_HIT_PADDLE_X = 8,
+    BATCH_HIT_PADDLE_Y = 16,
+};
+
+
+/* Sweep times outside the tick, as in sim.c. */
+#define BATCH_TIME_BEFORE (-1)
+#define BATCH_TIME_AFTER (SIM_TIME_ONE + 1)
+
+
+/* Constants shared by all games, derived once per step from the rules. */
+typedef struct Batch_Rules {
+    Sim_Fixed speed_paddle;
+    Sim_Fixed limit_paddle;
+    Sim_Fixed limit_x;
+    Sim_Fixed limit_y;
+    Sim_Fixed paddle_x[2];
+    Sim_Fixed reach_x[2]; /* Paddle plus ball half sizes. */
+    Sim_Fixed reach_y[2];
+} Batch_Rules;
+
+
+/* Restrict-qualified view of the per-game arrays, so the compiler knows
+ * they never alias and can vectorize across games. */
+typedef struct Batch_Lanes {
+    Sim_Fixed * restrict paddle_right_y;
+    Sim_Fixed * restrict paddle_left_y;
+    Sim_Fixed * restrict ball_x;
+    Sim_Fixed * restrict ball_y;
+    Sim_Fixed * restrict ball_speed_x;
+    Sim_Fixed * restrict ball_speed_y;
+    uint32_t * restrict score_right;
+    uint32_t * restrict score_left;
+    uint32_t * restrict events;
+    int32_t * restrict time_left;
+} Batch_Lanes;
+
+
+int batch_init(Batch_State * batch, size_t count, const Sim_State * initial) {
+    /* Set up 'count' games, all starting from 'initial'. Returns 0 on
+     * success. */
+
+    memset(batch, 0, sizeof(*batch));
+
+    size_t capacity = (count + BATCH_LANES-1) / BATCH_LANES * BATCH_LANES;
+    if (capacity == 0) {
+        capacity = BATCH_LANES;
+    }
+
+    void ** arrays[] = {
+        (void **)&batch->paddle_right_y, (void **)&batch->paddle_left_y,
+        (void **)&batch->ball_x, (void **)&batch->ball_y,
+        (void **)&batch->ball_speed_x, (void **)&batch->ball_speed_y,
+        (void **)&batch->score_right, (void **)&batch->score_left,
+        (void **)&batch->events, (void **)&batch->time_left,
+    };
+
+    /* All fields are 4 bytes wide. */
+    size_t size = capacity*sizeof(Sim_Fixed);
+    for (size_t i=0; i<sizeof(arrays)/sizeof(arrays[0]); i++) {
+        *arrays[i] = aligned_alloc(64, size);
+        if (!*arrays[i]) {
+            batch_free(batch);
+            return -1;
+        }
+        memset(*arrays[i], 0, size);
+    }
+
+    batch->capacity = capacity;
+    batch_reset(batch, count, initial);
+    return 0;
+}
+
+
+void batch_reset(Batch_State * batch, size_t count, const Sim_State * initial) {
+    /* Restart with 'count' games, at most the capacity given to batch_init,
+     * all starting from 'initial'. */
+    batch->count = count;
+    batch->rules = *initial;
+    batch->tick = initial->tick;
+
+    for (size_t i=0; i<batch->capacity; i++) {
+        batch_set(batch, i, initial);
+    }
+}
+
+
+void batch_free(Batch_State * batch) {
+    free(batch->paddle_right_y);
+    free(batch->paddle_left_y);
+    free(batch->ball_x);
+    free(batch->ball_y);
+    free(batch->ball_speed_x);
+    free(batch->ball_speed_y);
+    free(batch->score_right);
+    free(batch->score_left);
+    free(batch->events);
+    free(batch->time_left);
+    memset(batch, 0, sizeof(*batch));
+}
+
+
+void batch_get(const Batch_State * batch, size_t game, Sim_State * state) {
+    /* Expand game 'game' into a full Sim_State. */
+    *state = batch->rules;
+    state->tick = batch->tick;
+    state->positions[ID_PADDLE_RIGHT].y = batch->paddle_right_y[game];
+    state->positions[ID_PADDLE_LEFT].y = batch->paddle_left_y[game];
+    state->positions[ID_BALL].x = batch->ball_x[game];
+    state->positions[ID_BALL].y = batch->ball_y[game];
+    state->items[ID_BALL].speed.x = batch->ball_speed_x[game];
+    state->items[ID_BALL].speed.y = batch->ball_speed_y[game];
+    state->score[ID_PADDLE_RIGHT] = batch->score_right[game];
+    state->score[ID_PADDLE_LEFT] = batch->score_left[game];
+    state->events = batch->events[game];
+}
+
+
+void batch_set(Batch_State * batch, size_t game, const Sim_State * state) {
+    /* Store the per-game parts of 'state' in game 'game'. */
+    batch->paddle_right_y[game] = state->positions[ID_PADDLE_RIGHT].y;
+    batch->paddle_left_y[game] = state->positions[ID_PADDLE_LEFT].y;
+    batch->ball_x[game] = state->positions[ID_BALL].x;
+    batch->ball_y[game] = state->positions[ID_BALL].y;
+    batch->ball_speed_x[game] = state->items[ID_BALL].speed.x;
+    batch->ball_speed_y[game] = state->items[ID_BALL].speed.y;
+    batch->score_right[game] = state->score[ID_PADDLE_RIGHT];
+    batch->score_left[game] = state->score[ID_PADDLE_LEFT];
+    batch->events[game] = state->events;
+}
+
+
+static Batch_Lanes batch_lanes(Batch_State * batch) {
+    return (Batch_Lanes){
+        batch->paddle_right_y, batch->paddle_left_y,
+        batch->ball_x, batch->ball_y,
+        batch->ball_speed_x, batch->ball_speed_y,
+        batch->score_right, batch->score_left,
+        batch->events, batch->time_left,
+    };
+}
+
+
+static Batch_Rules batch_rules(const Sim_State * rules) {
+    /* Precompute the shared constants with the same expressions that
+     * sim.c uses. */
+
+    const Item_Data * items = rules->items;
+    Data_Environment env = rules->env;
+    Batch_Rules r;
+
+    /* Both paddles share speed and size, as in sim_init. */
+    Item_Data paddle = items[ID_PADDLE_RIGHT];
+    r.speed_paddle = paddle.speed.y;
+    r.limit_paddle = (Sim_Fixed)(env.height/2 - paddle.height/2)*SIM_FIXED_ONE;
+
+    Sim_Fixed half_width_ball = items[ID_BALL].width*(SIM_FIXED_ONE/2);
+    Sim_Fixed half_height_ball = items[ID_BALL].height*(SIM_FIXED_ONE/2);
+    r.limit_x = env.width*(SIM_FIXED_ONE/2) - half_width_ball;
+    r.limit_y = env.height*(SIM_FIXED_ONE/2) - half_height_ball;
+
+    int ids[] = {ID_PADDLE_RIGHT, ID_PADDLE_LEFT};
+    for (size_t p=0; p<2; p++) {
+        r.paddle_x[p] = rules->positions[ids[p]].x;
+        r.reach_x[p] = items[ids[p]].width*(SIM_FIXED_ONE/2) + half_width_ball;
+        r.reach_y[p] = items[ids[p]].height*(SIM_FIXED_ONE/2) + half_height_ball;
+    }
+    return r;
+}
+
+
+__attribute__((always_inline))
+static inline int32_t time_to_cover(double distance, double move) {
+    /* time_to_cover of sim.c, for integer 'distance' and nonzero 'move'.
+     * SIMD has no integer division, but the operands are exact in double
+     * and the quotient stays far below 2^53, so truncating the correctly
+     * rounded quotient gives exactly the integer quotient. Clamping first
+     * keeps it in 32 bits. */
+    double time = distance*SIM_TIME_ONE/move;
+    time = time < BATCH_TIME_BEFORE ? BATCH_TIME_BEFORE : time;
+    time = time > BATCH_TIME_AFTER ? BATCH_TIME_AFTER : time;
+    return (int32_t)time;
+}
+
+
+__attribute__((always_inline))
+static inline Sim_Fixed scale_by_time(Sim_Fixed value, int32_t time) {
+    /* scale_by_time of sim.c. The product is exact in double and dividing
+     * by a power of two is too. */
+    return (Sim_Fixed)((double)value*time/SIM_TIME_ONE);
+}
+
+
+__attribute__((always_inline))
+static inline Sim_Fixed paddle_next(Sim_Fixed pos, int up, int down, Batch_Rules r) {
+    /* Branch-free version of move_paddle in sim.c. */
+    Sim_Fixed pos_up = pos + r.speed_paddle;
+    pos_up = pos_up < r.limit_paddle ? pos_up : r.limit_paddle;
+    Sim_Fixed pos_down = pos - r.speed_paddle;
+    pos_down = pos_down > -r.limit_paddle ? pos_down : -r.limit_paddle;
+    return up ? pos_up : (down ? pos_down : pos);
+}
+
+
+__attribute__((always_inline))
+static inline void ball_push(Batch_Lanes batch, size_t i, Batch_Rules r) {
+    /* Branch-free version of the paddle push-out at the start of
+     * move_non_controlled_items. */
+
+    Sim_Fixed x = batch.ball_x[i];
+    Sim_Fixed y = batch.ball_y[i];
+    Sim_Fixed speed_x = batch.ball_speed_x[i];
+    uint32_t events = batch.events[i];
+    Sim_Fixed paddle_y[2] = {batch.paddle_right_y[i], batch.paddle_left_y[i]};
+
+    for (int p=0; p<2; p++) {
+        Sim_Fixed dx = x - r.paddle_x[p];
+        Sim_Fixed dy = y - paddle_y[p];
+        int overlap = (dx > -r.reach_x[p]) & (dx < r.reach_x[p]) &
+                      (dy > -r.reach_y[p]) & (dy < r.reach_y[p]);
+
+        Sim_Fixed direction = r.paddle_x[p] > 0 ? -1 : 1;
+        Sim_Fixed pushed = r.paddle_x[p] + direction*r.reach_x[p];
+        int flip = overlap & (speed_x*direction < 0);
+
+        x = overlap ? pushed : x;
+        speed_x = flip ? -speed_x : speed_x;
+        events |= overlap ? SIM_EVENT_BOUNCE_PADDLE : 0;
+    }
+
+    batch.ball_x[i] = x;
+    batch.ball_speed_x[i] = speed_x;
+    batch.events[i] = events;
+}
+
+
+__attribute__((always_inline))
+static inline void ball_pass(Batch_Lanes batch, size_t i, Batch_Rules r) {
+    /* Branch-free version of one bounce of the swept loop in
+     * move_non_controlled_items. Games with no time left do not move, hit
+     * nothing and so come out unchanged without any special casing. */
+
+    int32_t time_left = batch.time_left[i];
+    Sim_Fixed x = batch.ball_x[i];
+    Sim_Fixed y = batch.ball_y[i];
+    Sim_Fixed speed_x = batch.ball_speed_x[i];
+    Sim_Fixed speed_y = batch.ball_speed_y[i];
+    Sim_Fixed paddle_y[2] = {batch.paddle_right_y[i], batch.paddle_left_y[i]};
+    Sim_Fixed move_x = scale_by_time(speed_x, time_left);
+    Sim_Fixed move_y = scale_by_time(speed_y, time_left);
+
+    /* Divisors for the times below, which are only used when not zero. */
+    int still_x = move_x == 0;
+    int still_y = move_y == 0;
+    double divisor_x = still_x ? 1.0 : move_x;
+    double divisor_y = still_y ? 1.0 : move_y;
+
+    /* Side walls. */
+    int hit_right = (move_x > 0) & (x + move_x > r.limit_x);
+    int hit_left = (move_x < 0) & (x + move_x < -r.limit_x);
+    double wall_x = hit_right ? r.limit_x : -r.limit_x;
+    int32_t time_wall_x = time_to_cover(wall_x - x, divisor_x);
+
+    int32_t time_hit = hit_right | hit_left ? time_wall_x : SIM_TIME_ONE;
+    int hit = hit_right ? BATCH_HIT_WALL_RIGHT : (hit_left ? BATCH_HIT_WALL_LEFT : BATCH_HIT_NONE);
+
+    /* Top and bottom walls. */
+    int hit_top = (move_y > 0) & (y + move_y > r.limit_y);
+    int hit_bottom = (move_y < 0) & (y + move_y < -r.limit_y);
+    double wall_y = hit_top ? r.limit_y : -r.limit_y;
+    int32_t time_wall_y = time_to_cover(wall_y - y, divisor_y);
+    int take_y = (hit_top | hit_bottom) & (time_wall_y < time_hit);
+    time_hit = take_y ? time_wall_y : time_hit;
+    hit = take_y ? BATCH_HIT_WALL_Y : hit;
+
+    /* Paddles, as sweep_paddle. The face that was hit is kept to place the
+     * ball on. */
+    Sim_Fixed face_x = 0;
+    Sim_Fixed face_y = 0;
+#pragma GCC unroll 2
+    for (int p=0; p<2; p++) {
+        Sim_Fixed dx = x - r.paddle_x[p];
+        Sim_Fixed dy = y - paddle_y[p];
+        int miss = (still_x & ((dx <= -r.reach_x[p]) | (dx >= r.reach_x[p]))) |
+                   (still_y & ((dy <= -r.reach_y[p]) | (dy >= r.reach_y[p])));
+
+        int32_t ax = time_to_cover((double)-r.reach_x[p] - dx, divisor_x);
+        int32_t bx = time_to_cover((double)r.reach_x[p] - dx, divisor_x);
+        int32_t ay = time_to_cover((double)-r.reach_y[p] - dy, divisor_y);
+        int32_t by = time_to_cover((double)r.reach_y[p] - dy, divisor_y);
+
+        int32_t enter_x = still_x ? BATCH_TIME_BEFORE : (ax < bx ? ax : bx);
+        int32_t exit_x = still_x ? BATCH_TIME_AFTER : (ax < bx ? bx : ax);
+        int32_t enter_y = still_y ? BATCH_TIME_BEFORE : (ay < by ? ay : by);
+        int32_t exit_y = still_y ? BATCH_TIME_AFTER : (ay < by ? by : ay);
+
+        int32_t enter = enter_x > enter_y ? enter_x : enter_y;
+        int32_t exit = exit_x < exit_y ? exit_x : exit_y;
+        int found = !miss & !((enter >= exit) | (enter < 0) | (enter > SIM_TIME_ONE));
+
+        int take = found & (enter < time_hit);
+        time_hit = take ? enter : time_hit;
+        hit = take ? (enter_x > enter_y ? BATCH_HIT_PADDLE_X : BATCH_HIT_PADDLE_Y) : hit;
+        face_x = take ? (move_x > 0 ? r.paddle_x[p] - r.reach_x[p] :
+                                      r.paddle_x[p] + r.reach_x[p]) : face_x;
+        face_y = take ? (move_y > 0 ? paddle_y[p] - r.reach_y[p] :
+                                      paddle_y[p] + r.reach_y[p]) : face_y;
+    }
+
+    time_hit = time_hit < 0 ? 0 : time_hit;
+
+    /* Travel to the impact, or to the end of the tick. */
+    x += scale_by_time(move_x, time_hit);
+    y += scale_by_time(move_y, time_hit);
+    time_left -= scale_by_time(time_left, time_hit);
+
+    /* Place the ball on what it hit and bounce. */
+    x = hit == BATCH_HIT_WALL_RIGHT ? r.limit_x : x;
+    x = hit == BATCH_HIT_WALL_LEFT ? -r.limit_x : x;
+    x = hit == BATCH_HIT_PADDLE_X ? face_x : x;
+    y = hit == BATCH_HIT_WALL_Y ? (speed_y > 0 ? r.limit_y : -r.limit_y) : y;
+    y = hit == BATCH_HIT_PADDLE_Y ? face_y : y;
+
+    int flip_x = (hit & (BATCH_HIT_WALL_RIGHT | BATCH_HIT_WALL_LEFT |
+                         BATCH_HIT_PADDLE_X)) != 0;
+    int flip_y = (hit & (BATCH_HIT_WALL_Y | BATCH_HIT_PADDLE_Y)) != 0;
+
+    uint32_t events = batch.events[i];
+    events |= hit == BATCH_HIT_WALL_RIGHT ? SIM_EVENT_SCORE_LEFT : 0;
+    events |= hit == BATCH_HIT_WALL_LEFT ? SIM_EVENT_SCORE_RIGHT : 0;
+    events |= hit == BATCH_HIT_WALL_Y ? SIM_EVENT_BOUNCE_WALL : 0;
+    events |= hit & (BATCH_HIT_PADDLE_X | BATCH_HIT_PADDLE_Y) ?
+              SIM_EVENT_BOUNCE_PADDLE : 0;
+
+    batch.ball_x[i] = x;
+    batch.ball_y[i] = y;
+    batch.ball_speed_x[i] = flip_x ? -speed_x : speed_x;
+    batch.ball_speed_y[i] = flip_y ? -speed_y : speed_y;
+    batch.score_left[i] += hit == BATCH_HIT_WALL_RIGHT;
+    batch.score_right[i] += hit == BATCH_HIT_WALL_LEFT;
+    batch.events[i] = events;
+    batch.time_left[i] = hit != BATCH_HIT_NONE ? time_left : 0;
+}
+
+
+__attribute__((target_clones("avx2", "default"), optimize("no-thread-jumps")))
+static void batch_step_lanes(Batch_Lanes batch,
+                             size_t count,
+                             const Sim_Input * restrict inputs,
+                             Batch_Rules r) {
+    /* Vector part of the step: input, push-out and the first bounce passes
+     * for every game. Cloned for AVX2 and selected at load time. Jump
+     * threading splits the selects of ball_pass into branches, which stops
+     * the passes from vectorizing, so it is off here. */
+
+    for (size_t i=0; i<count; i++) {
+        Sim_Input input = inputs[i];
+        batch.paddle_right_y[i] = paddle_next(batch.paddle_right_y[i],
+                                               input & INPUT_RIGHT_UP,
+                                               input & INPUT_RIGHT_DOWN, r);
+        batch.paddle_left_y[i] = paddle_next(batch.paddle_left_y[i],
+                                              input & INPUT_LEFT_UP,
+                                              input & INPUT_LEFT_DOWN, r);
+        batch.events[i] = 0;
+        batch.time_left[i] = SIM_TIME_ONE;
+    }
+
+    for (size_t i=0; i<count; i++) {
+        ball_push(batch, i, r);
+    }
+
+    /* One loop per pass (BATCH_VECTOR_PASSES), as the vectorizer does not
+     * handle a loop around two vectorizable loops. */
+    for (size_t i=0; i<count; i++) {
+        ball_pass(batch, i, r);
+    }
+    for (size_t i=0; i<count; i++) {
+        ball_pass(batch, i, r);
+    }
+}
+
+
+void batch_step(Batch_State * batch, const Sim_Input * inputs) {
+    /* Advance every game one tick, game i using inputs[i]. Equivalent to
+     * calling sim_step on each game. */
+
+    Batch_Rules r = batch_rules(&batch->rules);
+    Batch_Lanes lanes = batch_lanes(batch);
+
+    batch_step_lanes(lanes, batch->count, inputs, r);
+
+    /* Finish the rare games that bounce more than the vector passes
+     * cover. */
+    for (size_t i=0; i<batch->count; i++) {
+        for (int pass=BATCH_VECTOR_PASSES;
+             pass<SIM_MAX_BOUNCES && batch->time_left[i] > 0;
+             pass++) {
+            ball_pass(lanes, i, r);
+        }
+    }
+
+    batch->tick++;
+}
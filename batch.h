@@ -0,0 +1,53 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sim.h"
+
+/* Lockstep simulation of many independent games. Every game follows the
+ * rules of sim_step, but the per-game state is kept in lane-aligned arrays
+ * (one element per game) so that a single pass over the arrays advances all
+ * games with the full SIMD width. Everything that is the same for all games
+ * (sizes, paddle x positions and speeds, the arena) is shared. */
+
+
+/* Arrays are padded to a multiple of this many games. */
+#define BATCH_LANES 16
+
+/* Bounce passes run for all lanes before the few games that still have
+ * time left in the tick are finished one by one. */
+#define BATCH_VECTOR_PASSES 2
+
+
+typedef struct Batch_State {
+    size_t count;
+    size_t capacity;
+    Sim_State rules; /* Shared items, environment and tick rate. */
+    uint64_t tick;
+
+    /* Per-game state. */
+    Sim_Fixed * paddle_right_y;
+    Sim_Fixed * paddle_left_y;
+    Sim_Fixed * ball_x;
+    Sim_Fixed * ball_y;
+    Sim_Fixed * ball_speed_x; /* Sub-pixels per tick, like Item_Data.speed. */
+    Sim_Fixed * ball_speed_y;
+    uint32_t * score_right;
+    uint32_t * score_left;
+    uint32_t * events;
+
+    /* Scratch for the step. */
+    int32_t * time_left;
+} Batch_State;
+
+
+int batch_init(Batch_State * batch, size_t count, const Sim_State * initial);
+void batch_reset(Batch_State * batch, size_t count, const Sim_State * initial);
+void batch_free(Batch_State * batch);
+void batch_step(Batch_State * batch, const Sim_Input * inputs);
+void batch_get(const Batch_State * batch, size_t game, Sim_State * state);
+void batch_set(Batch_State * batch, size_t game, const Sim_State * state);
+
+#endif
@@ -0,0 +1,558 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sched.h>
+
+#include "sim.h"
+#include "batch.h"
+#include "scene.h"
+#include "balls.h"
+#include "sprites.h"
+#include "raster.h"
+#include "ai.h"
+#include "sound.h"
+
+/* Microbenchmarks of the hot functions. Every benchmark is warmed up, its
+ * iteration count calibrated so that one repetition takes about
+ * --min-time, and then timed over --reps repetitions. The median, mean,
+ * standard deviation and range of ns/op across the repetitions are
+ * reported, since a single run says little about a change of a few
+ * percent.
+ *
+ * --csv writes the results in a form that --baseline reads back, to
+ * compare a change against an earlier run of the same build:
+ *
+ *     make bench && ./bench --csv before.csv
+ *     (apply the change)
+ *     make bench && ./bench --baseline before.csv */
+
+
+/* Games stepped per iteration of the batch benchmark. */
+#define BENCH_GAMES 1024
+
+/* Balls written per iteration of the sprite and instance benchmarks. */
+#define BENCH_BALLS 4096
+
+/* Frames per buffer of the sound benchmark, as the game plays them. */
+#define BENCH_SOUND_FRAMES 128
+
+/* Results read back from a baseline file. */
+#define BENCH_MAX_BASELINE 64
+
+
+typedef struct Bench_Context {
+    Sim_State sim;
+    Sim_Input inputs[BENCH_GAMES];
+    uint32_t rng;
+    float vertices[ID_NUM*18];
+    m4 matrices[2];
+    Display display;
+    float cells[DISPLAY_MAX_CELLS][2];
+    Batch_State batch;
+    Ball_Store balls;
+    float * ball_vertices; /* SPRITE_FLOATS per ball. */
+    float * ball_offsets; /* Interleaved x, y per ball. */
+    Display displays[2];
+    float * frame_vertices; /* The squares of a game frame. */
+    Sprite_Batch frame;
+    Raster raster;
+    Raster thumbnail;
+    Sound_Synth synth;
+    float sound[BENCH_SOUND_FRAMES*2]; /* Stereo. */
+} Bench_Context;
+
+
+typedef struct Bench {
+    const char * name;
+    void (* run)(Bench_Context * context, uint64_t iterations);
+    double ops_per_iteration;
+} Bench;
+
+
+typedef struct Bench_Result {
+    char name[64];
+    uint64_t iterations;
+    int reps;
+    double median; /* ns/op */
+    double mean;
+    double stddev;
+    double min;
+    double max;
+} Bench_Result;
+
+
+static double time_now(void) {
+    /* Return a monotonic timestamp in seconds. */
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+
+static inline void escape(const void * pointer) {
+    /* Make the compiler assume that whatever 'pointer' points to is read
+     * and written, so that the benchmarked work is not optimized away. */
+    __asm__ volatile("" : : "g"(pointer) : "memory");
+}
+
+
+static Sim_Input next_input(uint32_t * rng) {
+    /* xorshift32, masked to the input bits. */
+    uint32_t x = *rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *rng = x;
+    return x & (INPUT_RIGHT_UP | INPUT_RIGHT_DOWN | INPUT_LEFT_UP | INPUT_LEFT_DOWN);
+}
+
+
+// ================================================================
+// == Benchmarks.
+// ================================================================
+
+static void bench_square(Bench_Context * context, uint64_t iterations) {
+    for (uint64_t i=0; i<iterations; i++) {
+        square(context->vertices, context->sim.items[i % ID_NUM], context->sim.env);
+        escape(context->vertices);
+    }
+}
+
+
+static void bench_m4_set(Bench_Context * context, uint64_t iterations) {
+    for (uint64_t i=0; i<iterations; i++) {
+        m4_set(context->matrices[i & 1], context->matrices[~i & 1]);
+        escape(context->matrices);
+    }
+}
+
+
+static void bench_display_set(Bench_Context * context, uint64_t iterations) {
+    for (uint64_t i=0; i<iterations; i++) {
+        display_set(&context->display, i % 100000);
+        escape(&context->display);
+    }
+}
+
+
+static void bench_display_cells(Bench_Context * context, uint64_t iterations) {
+    for (uint64_t i=0; i<iterations; i++) {
+        display_cells(&context->display, context->cells);
+        escape(context->cells);
+    }
+}
+
+
+static void bench_setup_display(Bench_Context * context, uint64_t iterations) {
+    for (uint64_t i=0; i<iterations; i++) {
+        setup_display(&context->display, -40, 280, 0, i & 1,
+                      context->sim.items, &context->sim.env);
+        escape(&context->display);
+    }
+}
+
+
+static void bench_react_to_events(Bench_Context * context, uint64_t iterations) {
+    for (uint64_t i=0; i<iterations; i++) {
+        react_to_events(&context->sim, context->inputs[i % BENCH_GAMES]);
+        escape(&context->sim);
+    }
+}
+
+
+static void bench_move_non_controlled_items(Bench_Context * context, uint64_t iterations) {
+    for (uint64_t i=0; i<iterations; i++) {
+        move_non_controlled_items(&context->sim);
+        escape(&context->sim);
+    }
+}
+
+
+static void bench_sim_step(Bench_Context * context, uint64_t iterations) {
+    for (uint64_t i=0; i<iterations; i++) {
+        sim_step(&context->sim, context->inputs[i % BENCH_GAMES]);
+        escape(&context->sim);
+    }
+}
+
+
+static void bench_batch_step(Bench_Context * context, uint64_t iterations) {
+    for (uint64_t i=0; i<iterations; i++) {
+        batch_step(&context->batch, context->inputs);
+        escape(&context->batch);
+    }
+}
+
+
+static void bench_sprites(Bench_Context * context, uint64_t iterations) {
+    /* What the sprite batcher writes per ball. */
+    Ball_Store * balls = &context->balls;
+    for (uint64_t i=0; i<iterations; i++) {
+        Sprite_Batch batch;
+        sprite_batch_begin(&batch, context->ball_vertices, balls->count);
+        sprite_batch_squares(&batch, balls->x, balls->y, 1, balls->count,
+                             0.01f, 0.01f);
+        escape(context->ball_vertices);
+    }
+}
+
+
+static void bench_instance_offsets(Bench_Context * context, uint64_t iterations) {
+    /* What instanced drawing writes per ball, as render_balls does. */
+    Ball_Store * balls = &context->balls;
+    for (uint64_t i=0; i<iterations; i++) {
+        for (size_t b=0; b<balls->count; b++) {
+            context->ball_offsets[2*b+0] = balls->x[b];
+            context->ball_offsets[2*b+1] = balls->y[b];
+        }
+        escape(context->ball_offsets);
+    }
+}
+
+
+static void bench_raster(Bench_Context * context, uint64_t iterations) {
+    for (uint64_t i=0; i<iterations; i++) {
+        raster_draw(&context->raster, &context->frame, 0xff000000, 0xffffffff);
+        escape(context->raster.target.pixels);
+    }
+}
+
+
+static void bench_raster_thumbnail(Bench_Context * context, uint64_t iterations) {
+    for (uint64_t i=0; i<iterations; i++) {
+        raster_draw(&context->thumbnail, &context->frame, 0xff000000, 0xffffffff);
+        escape(context->thumbnail.target.pixels);
+    }
+}
+
+
+static void bench_ai_predict(Bench_Context * context, uint64_t iterations) {
+    /* The ball at the start, heading away from the left paddle, so that
+     * the prediction unfolds off the far side too. */
+    for (uint64_t i=0; i<iterations; i++) {
+        Sim_Fixed y;
+        int64_t ticks;
+        ai_predict(&context->sim, ID_PADDLE_LEFT, &y, &ticks);
+        escape(&y);
+        escape(&context->sim);
+    }
+}
+
+
+static void bench_ai_simulate(Bench_Context * context, uint64_t iterations) {
+    /* What the prediction replaces: stepping a copy of the game until the
+     * ball turns back off the left side. */
+    for (uint64_t i=0; i<iterations; i++) {
+        Sim_State ahead = context->sim;
+        Sim_Fixed speed_x = ahead.items[ID_BALL].speed.x;
+        while (!(speed_x < 0 && ahead.items[ID_BALL].speed.x > 0)) {
+            speed_x = ahead.items[ID_BALL].speed.x;
+            sim_step(&ahead, 0);
+        }
+        escape(&ahead);
+    }
+}
+
+
+static void bench_sound_buffer(Bench_Context * context, uint64_t iterations) {
+    /* The work of one audio callback at its busiest: every event starting
+     * a blip and all voices sounding. */
+    for (uint64_t i=0; i<iterations; i++) {
+        sound_synth_trigger(&context->synth, SIM_EVENT_BOUNCE_WALL | SIM_EVENT_BOUNCE_PADDLE |
+                                             SIM_EVENT_SCORE_RIGHT | SIM_EVENT_SCORE_LEFT);
+        sound_synth_render(&context->synth, context->sound, BENCH_SOUND_FRAMES, 2);
+        escape(context->sound);
+    }
+}
+
+
+static const Bench benches[] = {
+    {"square", bench_square, 1},
+    {"m4_set", bench_m4_set, 1},
+    {"display_set", bench_display_set, 1},
+    {"display_cells", bench_display_cells, 1},
+    {"setup_display", bench_setup_display, 1},
+    {"react_to_events", bench_react_to_events, 1},
+    {"move_non_controlled_items", bench_move_non_controlled_items, 1},
+    {"sim_step", bench_sim_step, 1},
+    {"batch_step/game", bench_batch_step, BENCH_GAMES},
+    {"sprites/ball", bench_sprites, BENCH_BALLS},
+    {"instance_offsets/ball", bench_instance_offsets, BENCH_BALLS},
+    {"raster/frame 800x600", bench_raster, 1},
+    {"raster/frame 160x120", bench_raster_thumbnail, 1},
+    {"ai/predict", bench_ai_predict, 1},
+    {"ai/simulate ahead", bench_ai_simulate, 1},
+    {"sound/buffer 128 frames", bench_sound_buffer, 1},
+};
+
+
+// ================================================================
+// == Harness.
+// ================================================================
+
+static void context_reset(Bench_Context * context) {
+    /* Put every benchmark's state back to the same start, so that runs of
+     * the same build do the same work. */
+    sim_init(&context->sim, 800, 600);
+    context->rng = 0x9e3779b9u;
+    for (size_t g=0; g<BENCH_GAMES; g++) {
+        context->inputs[g] = next_input(&context->rng);
+    }
+    m4_set(context->matrices[0], m4_unity);
+    m4_set(context->matrices[1], m4_unity);
+    setup_display(&context->display, -40, 280, 12345, false,
+                  context->sim.items, &context->sim.env);
+    batch_reset(&context->batch, BENCH_GAMES, &context->sim);
+
+    /* A frame of the game with two digit scores. */
+    scene_displays(&context->displays[0], &context->displays[1],
+                   context->sim.items, &context->sim.env);
+    display_set(&context->displays[0], 10);
+    display_set(&context->displays[1], 7);
+    Display * displays[2] = {&context->displays[0], &context->displays[1]};
+    v3 positions[ID_NUM];
+    for (size_t id=0; id<ID_NUM; id++) {
+        positions[id] = sim_to_ndc(&context->sim.env, context->sim.positions[id]);
+    }
+    sound_synth_init(&context->synth, 48000);
+    sprite_batch_begin(&context->frame, context->frame_vertices, 3 + 2*DISPLAY_MAX_CELLS);
+    scene_sprites(&context->frame, &context->sim, positions, NULL, displays, 2,
+                  context->cells);
+}
+
+
+static double time_run(const Bench * bench, Bench_Context * context, uint64_t iterations) {
+    /* Seconds that 'iterations' iterations take. */
+    double time_start = time_now();
+    bench->run(context, iterations);
+    return time_now() - time_start;
+}
+
+
+static int compare_doubles(const void * a, const void * b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+
+static void bench_measure(const Bench * bench, Bench_Context * context,
+                          int reps, double min_time, Bench_Result * result) {
+    /* Warm up, calibrate and time 'reps' repetitions of 'bench'. */
+
+    context_reset(context);
+
+    /* Grow the iteration count until one repetition takes long enough,
+     * which also warms up caches, branch predictors and clocks. */
+    uint64_t iterations = 1;
+    double time = 0.0;
+    while ((time = time_run(bench, context, iterations)) < min_time) {
+        double factor = time > 0.0 ? 1.5*min_time/time : 10.0;
+        iterations = (uint64_t)(iterations*(factor < 10.0 ? factor : 10.0)) + 1;
+    }
+    time_run(bench, context, iterations);
+
+    double samples[reps];
+    double sum = 0.0;
+    for (int r=0; r<reps; r++) {
+        double ops = iterations*bench->ops_per_iteration;
+        samples[r] = time_run(bench, context, iterations)*1e9/ops;
+        sum += samples[r];
+    }
+
+    double mean = sum/reps;
+    double squares = 0.0;
+    for (int r=0; r<reps; r++) {
+        squares += (samples[r] - mean)*(samples[r] - mean);
+    }
+    qsort(samples, reps, sizeof(samples[0]), compare_doubles);
+
+    snprintf(result->name, sizeof(result->name), "%s", bench->name);
+    result->iterations = iterations;
+    result->reps = reps;
+    result->median = reps % 2 ? samples[reps/2] : (samples[reps/2-1] + samples[reps/2])/2;
+    result->mean = mean;
+    result->stddev = reps > 1 ? sqrt(squares/(reps - 1)) : 0.0;
+    result->min = samples[0];
+    result->max = samples[reps-1];
+}
+
+
+static size_t baseline_read(const char * path, Bench_Result * baseline, size_t capacity) {
+    /* Read results written by --csv. Returns how many were read. */
+
+    FILE * file = fopen(path, "r");
+    if (!file) {
+        return 0;
+    }
+    char line[256];
+    size_t count = 0;
+    while (count < capacity && fgets(line, sizeof(line), file)) {
+        Bench_Result * result = &baseline[count];
+        unsigned long long iterations;
+        if (sscanf(line, "%63[^,],%llu,%d,%lf,%lf,%lf,%lf,%lf",
+                   result->name, &iterations, &result->reps, &result->median,
+                   &result->mean, &result->stddev, &result->min, &result->max) == 8) {
+            result->iterations = iterations;
+            count++;
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+
+static void usage(const char * name) {
+    fprintf(stderr, "usage: %s [--filter text] [--reps n] [--min-time ms] [--cpu n]\n"
+                    "       [--csv path] [--baseline path]\n", name);
+    exit(EXIT_FAILURE);
+}
+
+
+int main(int argc, char ** argv) {
+
+    /* Benchmarks whose name contains 'filter', repetitions each, least
+     * seconds per repetition, core to pin to and where results go to and
+     * come from. */
+    const char * filter = "";
+    int reps = 15;
+    double min_time = 0.02;
+    int cpu = -1;
+    const char * path_csv = NULL;
+    const char * path_baseline = NULL;
+
+    for (int i=1; i<argc; i++) {
+        if (i+1 >= argc) {
+            usage(argv[0]);
+        }
+        if (strcmp(argv[i], "--filter") == 0) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--reps") == 0) {
+            reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--min-time") == 0) {
+            min_time = atof(argv[++i])/1000.0;
+        } else if (strcmp(argv[i], "--cpu") == 0) {
+            cpu = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--csv") == 0) {
+            path_csv = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0) {
+            path_baseline = argv[++i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (reps < 1 || min_time <= 0.0) {
+        usage(argv[0]);
+    }
+
+    /* Stay on one core, so that migrations do not show up as noise. */
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+            fprintf(stderr, "Could not pin to cpu %d.\n", cpu);
+        }
+    }
+
+    static Bench_Result baseline[BENCH_MAX_BASELINE];
+    size_t num_baseline = 0;
+    if (path_baseline) {
+        num_baseline = baseline_read(path_baseline, baseline, BENCH_MAX_BASELINE);
+        if (num_baseline == 0) {
+            fprintf(stderr, "Could not read a baseline from %s.\n", path_baseline);
+            return EXIT_FAILURE;
+        }
+    }
+
+    FILE * csv = NULL;
+    if (path_csv) {
+        csv = fopen(path_csv, "w");
+        if (!csv) {
+            fprintf(stderr, "Could not open %s.\n", path_csv);
+            return EXIT_FAILURE;
+        }
+        fprintf(csv, "name,iterations,reps,median_ns,mean_ns,stddev_ns,min_ns,max_ns\n");
+    }
+
+    Bench_Context * context = malloc(sizeof(*context));
+    if (!context) {
+        return EXIT_FAILURE;
+    }
+    sim_init(&context->sim, 800, 600);
+    if (batch_init(&context->batch, BENCH_GAMES, &context->sim) != 0) {
+        fprintf(stderr, "Could not allocate %d games.\n", BENCH_GAMES);
+        return EXIT_FAILURE;
+    }
+    context->ball_vertices = malloc(BENCH_BALLS*SPRITE_FLOATS*sizeof(float));
+    context->ball_offsets = malloc(2*BENCH_BALLS*sizeof(float));
+    if (balls_init(&context->balls, BENCH_BALLS) != 0 ||
+        !context->ball_vertices || !context->ball_offsets) {
+        fprintf(stderr, "Could not allocate %d balls.\n", BENCH_BALLS);
+        return EXIT_FAILURE;
+    }
+    balls_spawn(&context->balls, BENCH_BALLS, &context->sim, 1);
+    context->frame_vertices = malloc((3 + 2*DISPLAY_MAX_CELLS)*SPRITE_FLOATS*sizeof(float));
+    if (!context->frame_vertices ||
+        raster_init(&context->raster, 800, 600, 1) != 0 ||
+        raster_init(&context->thumbnail, 160, 120, 1) != 0) {
+        fprintf(stderr, "Could not allocate the framebuffers.\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%-28s %12s %10s %10s %10s %10s %8s%s\n", "benchmark", "iterations",
+           "median ns", "mean ns", "stddev", "min ns", "cv", path_baseline ? "   change" : "");
+
+    for (size_t b=0; b<sizeof(benches)/sizeof(benches[0]); b++) {
+        const Bench * bench = &benches[b];
+        if (!strstr(bench->name, filter)) {
+            continue;
+        }
+
+        Bench_Result result;
+        bench_measure(bench, context, reps, min_time, &result);
+
+        printf("%-28s %12llu %10.3f %10.3f %10.3f %10.3f %7.2f%%",
+               result.name, (unsigned long long)result.iterations, result.median,
+               result.mean, result.stddev, result.min, 100.0*result.stddev/result.mean);
+
+        /* A change is worth a look once it is clear of both runs' noise. */
+        for (size_t i=0; i<num_baseline; i++) {
+            const Bench_Result * before = &baseline[i];
+            if (strcmp(before->name, result.name) != 0) {
+                continue;
+            }
+            double change = result.median/before->median - 1.0;
+            double noise = 2.0*(result.stddev + before->stddev)/before->median;
+            printf(" %+7.1f%%%s", 100.0*change, fabs(change) > noise ? " *" : "");
+        }
+        printf("\n");
+
+        if (csv) {
+            fprintf(csv, "%s,%llu,%d,%.4f,%.4f,%.4f,%.4f,%.4f\n",
+                    result.name, (unsigned long long)result.iterations, result.reps,
+                    result.median, result.mean, result.stddev, result.min, result.max);
+        }
+    }
+
+    if (path_baseline) {
+        printf("* change larger than twice the combined standard deviation\n");
+    }
+    if (csv && fclose(csv) != 0) {
+        fprintf(stderr, "Could not write %s.\n", path_csv);
+        return EXIT_FAILURE;
+    }
+    batch_free(&context->batch);
+    balls_free(&context->balls);
+    free(context->ball_vertices);
+    free(context->ball_offsets);
+    free(context->frame_vertices);
+    raster_free(&context->raster);
+    raster_free(&context->thumbnail);
+    free(context);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,93 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "sim.h"
+#include "balls.h"
+#include "collide.h"
+
+/* Collision benchmark: pairs tested and time per tick for the grid
+ * broadphase against the brute force O(n^2) reference, at a constant
+ * ball density so that only the number of bodies changes. */
+
+
+/* Fraction of the arena covered by balls. */
+#define DENSITY 0.05
+
+
+static double time_now(void) {
+    /* Return a monotonic timestamp in seconds. */
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+
+static void run(size_t num_balls, int num_ticks, int brute) {
+    /* Simulate 'num_ticks' ticks of 'num_balls' balls and print one result
+     * line. */
+
+    /* Size the arena (4:3) in pixels so that the density stays constant. */
+    Sim_State sim;
+    sim_init(&sim, 800, 600);
+    Item_Data ball = sim.items[ID_BALL];
+    double area = num_balls*ball.width*ball.height/DENSITY;
+    int width = sqrt(area*4.0/3.0);
+    int height = width*3/4;
+    sim_init(&sim, width, height);
+
+    Ball_Store balls;
+    Collide_Grid grid;
+    if (balls_init(&balls, num_balls) != 0 ||
+        collide_grid_init_arena(&grid, &sim, balls.capacity) != 0) {
+        fprintf(stderr, "Could not allocate %zu balls.\n", num_balls);
+        exit(EXIT_FAILURE);
+    }
+    balls_spawn(&balls, num_balls, &sim, 1);
+
+    Collide_Box paddles[2];
+    size_t num_paddles = collide_paddles(&sim, paddles);
+    Collide_Stats stats = {0};
+
+    double time_start = time_now();
+    for (int i=0; i<num_ticks; i++) {
+        balls_step(&balls);
+        if (brute) {
+            collide_balls_brute(&balls, paddles, num_paddles, &stats);
+        } else {
+            collide_balls(&grid, &balls, paddles, num_paddles, &stats);
+        }
+    }
+    double time_tick = (time_now() - time_start)/num_ticks;
+
+    printf("%-6s %8zu %6dx%-6d %14.0f %10.1f %12.3f\n",
+           brute ? "brute" : "grid",
+           num_balls,
+           width,
+           height,
+           (double)stats.pairs_tested/num_ticks,
+           (double)stats.contacts/num_ticks,
+           time_tick*1e3);
+
+    collide_grid_free(&grid);
+    balls_free(&balls);
+}
+
+
+int main(void) {
+
+    printf("%-6s %8s %13s %14s %10s %12s\n",
+           "mode", "bodies", "arena", "pairs/tick", "contacts", "ms/tick");
+
+    size_t sizes[] = {1000, 10000, 100000};
+    for (size_t i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++) {
+        run(sizes[i], 100, 0);
+    }
+
+    /* Brute force is only run where it finishes in reasonable time. */
+    run(1000, 100, 1);
+    run(10000, 5, 1);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,91 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "sim.h"
+#include "runner.h"
+
+/* Scaling benchmark for the multi-core runner: the same set of games is
+ * played with 1, 2, ... N workers, reporting games per second and the
+ * parallel efficiency relative to one worker. The checksum must not change
+ * with the number of workers. */
+
+
+static double time_now(void) {
+    /* Return a monotonic timestamp in seconds. */
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+
+static void usage(const char * name) {
+    fprintf(stderr, "usage: %s [--games n] [--ticks n] [--threads n]\n", name);
+    exit(EXIT_FAILURE);
+}
+
+
+int main(int argc, char ** argv) {
+
+    /* Number of games, ticks per game (ten seconds of play at the base
+     * tick rate) and the largest number of workers to try. */
+    uint64_t num_games = 1 << 16;
+    uint64_t num_ticks = 10*SIM_BASE_TICK_RATE;
+    int max_threads = runner_num_cpus();
+
+    for (int i=1; i<argc; i++) {
+        if (i+1 >= argc) {
+            usage(argv[0]);
+        }
+        if (strcmp(argv[i], "--games") == 0) {
+            num_games = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--ticks") == 0) {
+            num_ticks = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            max_threads = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (max_threads < 1) {
+        usage(argv[0]);
+    }
+
+    Sim_State sim;
+    sim_init(&sim, 800, 600);
+
+    printf("%8s %10s %10s %14s %10s %8s %18s\n",
+           "threads", "games", "seconds", "games/s", "efficiency", "stolen", "checksum");
+
+    double rate_single = 0.0;
+    uint64_t checksum_single = 0;
+    for (int threads=1; threads<=max_threads; threads++) {
+        Runner_Result result;
+        double time_start = time_now();
+        if (runner_run(&sim, num_games, num_ticks, threads, &result) != 0) {
+            fprintf(stderr, "Runner failed with %d threads.\n", threads);
+            return EXIT_FAILURE;
+        }
+        double time_elapsed = time_now() - time_start;
+
+        double rate = result.games/time_elapsed;
+        if (threads == 1) {
+            rate_single = rate;
+            checksum_single = result.checksum;
+        }
+
+        printf("%8d %10llu %10.3f %14.0f %9.1f%% %8llu %18llx%s\n",
+               threads,
+               (unsigned long long)result.games,
+               time_elapsed,
+               rate,
+               100.0*rate/(threads*rate_single),
+               (unsigned long long)result.tasks_stolen,
+               (unsigned long long)result.checksum,
+               result.checksum == checksum_single ? "" : " MISMATCH");
+    }
+
+    return EXIT_SUCCESS;
+}
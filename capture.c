@@ -0,0 +1,345 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture.h"
+#include "trace.h"
+
+
+static int ends_with(const char * string, const char * suffix) {
+    size_t length = strlen(string);
+    size_t length_suffix = strlen(suffix);
+    return length >= length_suffix &&
+           strcmp(string + length - length_suffix, suffix) == 0;
+}
+
+
+// ================================================================
+// == Encoding, on the worker.
+// ================================================================
+
+static size_t encoded_size(const Capture * capture) {
+    /* Bytes of the largest encoded frame, a PPM body or a 4:2:0 frame. */
+    size_t pixels = (size_t)capture->width*capture->height;
+    size_t chroma = (size_t)((capture->width + 1)/2)*((capture->height + 1)/2);
+    size_t yuv = pixels + 2*chroma;
+    return 3*pixels > yuv ? 3*pixels : yuv;
+}
+
+
+static void encode_rgb(const Capture * capture, const uint32_t * pixels, uint8_t * rgb) {
+    /* Turn a frame read by GL, bottom row first, into top-down RGB. */
+    int width = capture->width;
+    int height = capture->height;
+    for (int y=0; y<height; y++) {
+        const uint32_t * row = pixels + (size_t)(height - 1 - y)*width;
+        for (int x=0; x<width; x++) {
+            rgb[0] = row[x] >> 16 & 0xff;
+            rgb[1] = row[x] >> 8 & 0xff;
+            rgb[2] = row[x] & 0xff;
+            rgb += 3;
+        }
+    }
+}
+
+
+static void encode_yuv420(const Capture * capture, const uint32_t * pixels, uint8_t * yuv) {
+    /* Turn a frame read by GL, bottom row first, into top-down planar 4:2:0
+     * with the full range BT.601 coefficients of JPEG, in 16 bit fixed
+     * point. Chroma is taken from the average of each 2x2 block. */
+
+    int width = capture->width;
+    int height = capture->height;
+    int width_chroma = (width + 1)/2;
+    int height_chroma = (height + 1)/2;
+    uint8_t * plane_y = yuv;
+    uint8_t * plane_u = plane_y + (size_t)width*height;
+    uint8_t * plane_v = plane_u + (size_t)width_chroma*height_chroma;
+
+    for (int y=0; y<height; y++) {
+        const uint32_t * row = pixels + (size_t)(height - 1 - y)*width;
+        for (int x=0; x<width; x++) {
+            int32_t r = row[x] >> 16 & 0xff;
+            int32_t g = row[x] >> 8 & 0xff;
+            int32_t b = row[x] & 0xff;
+            plane_y[(size_t)y*width + x] = (19595*r + 38470*g + 7471*b + 32768) >> 16;
+        }
+    }
+
+    for (int y=0; y<height_chroma; y++) {
+        /* Rows 2y and 2y+1 from the top, the last one twice if odd. */
+        int top = 2*y;
+        int bottom = top + 1 < height ? top + 1 : top;
+        const uint32_t * rows[2] = {
+            pixels + (size_t)(height - 1 - top)*width,
+            pixels + (size_t)(height - 1 - bottom)*width,
+        };
+        for (int x=0; x<width_chroma; x++) {
+            int left = 2*x;
+            int right = left + 1 < width ? left + 1 : left;
+            int32_t r = 0, g = 0, b = 0;
+            for (int i=0; i<2; i++) {
+                uint32_t p0 = rows[i][left];
+                uint32_t p1 = rows[i][right];
+                r += (p0 >> 16 & 0xff) + (p1 >> 16 & 0xff);
+                g += (p0 >> 8 & 0xff) + (p1 >> 8 & 0xff);
+                b += (p0 & 0xff) + (p1 & 0xff);
+            }
+            /* Sums of four, so shift by two more. */
+            size_t index = (size_t)y*width_chroma + x;
+            plane_u[index] = (-11059*r - 21709*g + 32768*b + (128 << 18) + (1 << 17)) >> 18;
+            plane_v[index] = (32768*r - 27439*g - 5329*b + (128 << 18) + (1 << 17)) >> 18;
+        }
+    }
+}
+
+
+static int write_frame(Capture * capture, const uint8_t * frame, uint64_t index) {
+    /* Encode and write one frame. Returns 0 on success, -1 on failure. */
+
+    const uint32_t * pixels = (const uint32_t *)frame;
+    size_t pixels_frame = (size_t)capture->width*capture->height;
+
+    if (capture->y4m) {
+        size_t size = pixels_frame + 2*(size_t)((capture->width + 1)/2)*((capture->height + 1)/2);
+        encode_yuv420(capture, pixels, capture->encoded);
+        if (fputs("FRAME\n", capture->file) < 0 ||
+            fwrite(capture->encoded, 1, size, capture->file) != size) {
+            return -1;
+        }
+        return 0;
+    }
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s%06llu.ppm", capture->path, (unsigned long long)index);
+    FILE * file = fopen(path, "wb");
+    if (!file) {
+        return -1;
+    }
+    encode_rgb(capture, pixels, capture->encoded);
+    int result = 0;
+    if (fprintf(file, "P6\n%d %d\n255\n", capture->width, capture->height) < 0 ||
+        fwrite(capture->encoded, 3, pixels_frame, file) != pixels_frame) {
+        result = -1;
+    }
+    if (fclose(file) != 0) {
+        result = -1;
+    }
+    return result;
+}
+
+
+static void * worker_main(void * argument) {
+    /* Write the frames queued, in order, until told to quit and none are
+     * left. */
+
+    Capture * capture = argument;
+
+    pthread_mutex_lock(&capture->lock);
+    for (;;) {
+        while (!capture->quit && capture->written == capture->queued) {
+            pthread_cond_wait(&capture->wake, &capture->lock);
+        }
+        if (capture->written == capture->queued) {
+            break;
+        }
+        uint64_t index = capture->written;
+        pthread_mutex_unlock(&capture->lock);
+
+        int result = write_frame(capture, capture->frames[index % CAPTURE_QUEUE], index);
+
+        /* Under the lock, as the GL thread counts its own errors too. */
+        pthread_mutex_lock(&capture->lock);
+        if (result == 0) {
+            capture->stats.frames++;
+        } else {
+            capture->stats.errors++;
+        }
+        capture->written++;
+        pthread_cond_signal(&capture->done);
+    }
+    pthread_mutex_unlock(&capture->lock);
+    return NULL;
+}
+
+
+// ================================================================
+// == Readback, on the GL thread.
+// ================================================================
+
+int capture_open(Capture * capture, const char * path, int width, int height, int rate) {
+    /* Start capturing 'width' by 'height' frames to 'path' at 'rate' frames
+     * per second. Needs a current context. Returns 0 on success, -1 on
+     * failure. */
+
+    memset(capture, 0, sizeof(*capture));
+    if (width <= 0 || height <= 0) {
+        return -1;
+    }
+    capture->width = width;
+    capture->height = height;
+    capture->rate = rate > 0 ? rate : 60;
+    capture->path = path;
+    capture->y4m = ends_with(path, ".y4m");
+
+    size_t size_frame = (size_t)width*height*sizeof(uint32_t);
+    for (int i=0; i<CAPTURE_QUEUE; i++) {
+        capture->frames[i] = malloc(size_frame);
+        if (!capture->frames[i]) {
+            capture_close(capture);
+            return -1;
+        }
+    }
+    capture->encoded = malloc(encoded_size(capture));
+    if (!capture->encoded) {
+        capture_close(capture);
+        return -1;
+    }
+
+    if (capture->y4m) {
+        capture->file = fopen(path, "wb");
+        if (!capture->file ||
+            fprintf(capture->file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n",
+                    width, height, capture->rate) < 0) {
+            capture_close(capture);
+            return -1;
+        }
+    }
+
+    glGenBuffers(CAPTURE_PBOS, capture->pbos);
+    for (int i=0; i<CAPTURE_PBOS; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->pbos[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size_frame, NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    pthread_mutex_init(&capture->lock, NULL);
+    pthread_cond_init(&capture->wake, NULL);
+    pthread_cond_init(&capture->done, NULL);
+    if (pthread_create(&capture->thread, NULL, worker_main, capture) != 0) {
+        pthread_cond_destroy(&capture->done);
+        pthread_cond_destroy(&capture->wake);
+        pthread_mutex_destroy(&capture->lock);
+        capture_close(capture);
+        return -1;
+    }
+    capture->running = 1;
+
+    if (glGetError() != GL_NO_ERROR) {
+        capture_close(capture);
+        return -1;
+    }
+    return 0;
+}
+
+
+static void collect(Capture * capture, int slot, int block) {
+    /* Queue the frame read into 'slot', once the GPU is done with it. If the
+     * worker has no frame free, wait for one if 'block', else drop it. */
+
+    capture->stats.waits += gl_fence_wait(&capture->fences[slot]);
+
+    pthread_mutex_lock(&capture->lock);
+    while (block && capture->queued - capture->written >= CAPTURE_QUEUE) {
+        pthread_cond_wait(&capture->done, &capture->lock);
+    }
+    int full = capture->queued - capture->written >= CAPTURE_QUEUE;
+    pthread_mutex_unlock(&capture->lock);
+    if (full) {
+        capture->stats.dropped++;
+        return;
+    }
+
+    /* The frame at 'queued' is not the worker's until it is counted. */
+    size_t size_frame = (size_t)capture->width*capture->height*sizeof(uint32_t);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->pbos[slot]);
+    const void * mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size_frame, GL_MAP_READ_BIT);
+    if (!mapped) {
+        pthread_mutex_lock(&capture->lock);
+        capture->stats.errors++;
+        pthread_mutex_unlock(&capture->lock);
+        return;
+    }
+    memcpy(capture->frames[capture->queued % CAPTURE_QUEUE], mapped, size_frame);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+
+    pthread_mutex_lock(&capture->lock);
+    capture->queued++;
+    pthread_cond_signal(&capture->wake);
+    pthread_mutex_unlock(&capture->lock);
+}
+
+
+void capture_frame(Capture * capture) {
+    /* Start reading the frame just drawn from the framebuffer bound for
+     * reading, and queue the one read CAPTURE_PBOS-1 frames ago. Call after
+     * drawing and before swapping. */
+
+    double time_start = trace_now();
+    int slot = capture->reads % CAPTURE_PBOS;
+
+    if (capture->fences[slot]) {
+        collect(capture, slot, 0);
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->pbos[slot]);
+    glReadPixels(0, 0, capture->width, capture->height,
+                 GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, (GLvoid*)0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    capture->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    capture->reads++;
+
+    histogram_add(&capture->overhead, trace_now() - time_start);
+}
+
+
+int capture_close(Capture * capture) {
+    /* Queue the frames still being read, wait for the worker to write them
+     * and free everything. Returns 0 if every frame was written, -1
+     * otherwise. */
+
+    if (capture->running) {
+        /* Oldest first, to keep the order. */
+        for (int i=0; i<CAPTURE_PBOS; i++) {
+            int slot = (capture->reads + i) % CAPTURE_PBOS;
+            if (capture->fences[slot]) {
+                collect(capture, slot, 1);
+            }
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        pthread_mutex_lock(&capture->lock);
+        capture->quit = 1;
+        pthread_cond_signal(&capture->wake);
+        pthread_mutex_unlock(&capture->lock);
+        pthread_join(capture->thread, NULL);
+        pthread_cond_destroy(&capture->done);
+        pthread_cond_destroy(&capture->wake);
+        pthread_mutex_destroy(&capture->lock);
+    }
+
+    for (int i=0; i<CAPTURE_PBOS; i++) {
+        if (capture->fences[i]) {
+            glDeleteSync(capture->fences[i]);
+            capture->fences[i] = 0;
+        }
+    }
+    if (capture->pbos[0]) {
+        glDeleteBuffers(CAPTURE_PBOS, capture->pbos);
+    }
+
+    int result = capture->stats.errors == 0 ? 0 : -1;
+    if (capture->file && fclose(capture->file) != 0) {
+        result = -1;
+    }
+    capture->file = NULL;
+    for (int i=0; i<CAPTURE_QUEUE; i++) {
+        free(capture->frames[i]);
+        capture->frames[i] = NULL;
+    }
+    free(capture->encoded);
+    capture->encoded = NULL;
+    capture->running = 0;
+    return result;
+}
@@ -0,0 +1,76 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <GL/glew.h>
+
+#include "gl_state.h"
+#include "histogram.h"
+
+/* Video capture from the back buffer without waiting on the GPU.
+ *
+ * Each frame is read into the next of CAPTURE_PBOS pixel buffer objects
+ * with glReadPixels, which returns at once, and fenced. By the time the ring
+ * comes around the copy is done, so the buffer is mapped, its pixels copied
+ * into a free frame of the queue and handed to a worker thread, which
+ * writes them out. If the worker falls behind and no frame is free, the
+ * frame is dropped rather than the game slowed down. The time spent per
+ * frame on the GL thread is kept in a histogram.
+ *
+ * A path ending in ".y4m" gets a YUV4MPEG2 stream, 4:2:0 in full range
+ * and marked so in its header, which ffmpeg and most players read. Any
+ * other path is a prefix for a sequence of PPM files. */
+
+
+/* Frames being read back by the GPU at once. */
+#define CAPTURE_PBOS 3
+
+/* Frames waiting for the worker at most. */
+#define CAPTURE_QUEUE 8
+
+
+typedef struct Capture_Stats {
+    uint64_t frames; /* Written. */
+    uint64_t dropped; /* No free frame in the queue. */
+    uint64_t waits; /* Readbacks not done when their turn came. */
+    uint64_t errors; /* Frames that could not be written. */
+} Capture_Stats;
+
+
+typedef struct Capture {
+    int width;
+    int height;
+    int rate; /* Frames per second written into the stream header. */
+    int y4m;
+    const char * path;
+    FILE * file; /* The stream, if y4m. */
+
+    GLuint pbos[CAPTURE_PBOS];
+    GLsync fences[CAPTURE_PBOS];
+    uint64_t reads; /* Readbacks started. */
+
+    /* Frames of BGRA pixels, bottom row first as GL reads them, passed to
+     * the worker in order and back. */
+    uint8_t * frames[CAPTURE_QUEUE];
+    uint64_t queued; /* Frames handed to the worker. */
+    uint64_t written; /* Frames the worker is done with. */
+    uint8_t * encoded; /* The worker's frame being written. */
+    int running; /* Worker started. */
+    int quit;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake; /* Worker, for a frame queued or quitting. */
+    pthread_cond_t done; /* Closing, for a frame written. */
+
+    Histogram overhead; /* Seconds per frame spent capturing. */
+    Capture_Stats stats;
+} Capture;
+
+
+int capture_open(Capture * capture, const char * path, int width, int height, int rate);
+void capture_frame(Capture * capture);
+int capture_close(Capture * capture);
+
+#endif
@@ -0,0 +1,353 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "collide.h"
+
+
+int collide_grid_init(Collide_Grid * grid,
+                      float min_x,
+                      float min_y,
+                      float max_x,
+                      float max_y,
+                      float cell_size,
+                      size_t capacity) {
+    /* Set up a grid covering [min_x, max_x] x [min_y, max_y] for up to
+     * 'capacity' balls. 'cell_size' must be at least the largest ball's full
+     * width and height. Returns 0 on success. */
+
+    memset(grid, 0, sizeof(*grid));
+
+    grid->min_x = min_x;
+    grid->min_y = min_y;
+    grid->cell_size = cell_size;
+    grid->inv_cell_size = 1.0f/cell_size;
+    grid->cells_x = ceilf((max_x-min_x)*grid->inv_cell_size);
+    grid->cells_y = ceilf((max_y-min_y)*grid->inv_cell_size);
+    grid->cells_x = grid->cells_x > 0 ? grid->cells_x : 1;
+    grid->cells_y = grid->cells_y > 0 ? grid->cells_y : 1;
+    grid->capacity = capacity;
+
+    /* At least two buckets per ball, as a power of two. */
+    size_t num_buckets = 1;
+    while (num_buckets < 2*capacity) {
+        num_buckets *= 2;
+    }
+    grid->bucket_mask = num_buckets-1;
+
+    grid->bucket_start = malloc((num_buckets+1)*sizeof(uint32_t));
+    grid->bucket_items = malloc(capacity*sizeof(uint32_t));
+    grid->bucket_cells = malloc(capacity*sizeof(uint32_t));
+    grid->bucket_boxes = malloc(capacity*sizeof(Collide_Box));
+    grid->ball_cell = malloc(capacity*sizeof(uint32_t));
+
+    if (!grid->bucket_start || !grid->bucket_items ||
+        !grid->bucket_cells || !grid->bucket_boxes || !grid->ball_cell) {
+        collide_grid_free(grid);
+        return -1;
+    }
+    return 0;
+}
+
+
+int collide_grid_init_arena(Collide_Grid * grid, const Sim_State * state, size_t capacity) {
+    /* Set up a grid over the whole arena of 'state' with cells sized from
+     * the pixel size of its ball. */
+    Item_Data ball = state->items[ID_BALL];
+    Data_Environment env = state->env;
+    float size_x = ball.width*env.delta_width;
+    float size_y = ball.height*env.delta_height;
+    float cell_size = size_x > size_y ? size_x : size_y;
+    return collide_grid_init(grid, -1.0f, -1.0f, 1.0f, 1.0f, cell_size, capacity);
+}
+
+
+size_t collide_paddles(const Sim_State * state, Collide_Box * paddles) {
+    /* Store the boxes of both paddles of 'state' in 'paddles' and return
+     * how many were stored. */
+    int ids[] = {ID_PADDLE_RIGHT, ID_PADDLE_LEFT};
+    for (size_t i=0; i<2; i++) {
+        Item_Data item = state->items[ids[i]];
+        v3 position = sim_to_ndc(&state->env, state->positions[ids[i]]);
+        paddles[i] = (Collide_Box){
+            .x = position.x,
+            .y = position.y,
+            .half_width = item.width*state->env.delta_width*0.5f,
+            .half_height = item.height*state->env.delta_height*0.5f,
+        };
+    }
+    return 2;
+}
+
+
+void collide_grid_free(Collide_Grid * grid) {
+    free(grid->bucket_start);
+    free(grid->bucket_items);
+    free(grid->bucket_cells);
+    free(grid->bucket_boxes);
+    free(grid->ball_cell);
+    memset(grid, 0, sizeof(*grid));
+}
+
+
+static inline int grid_coordinate(float pos, float min, float inv_cell_size, int num_cells) {
+    /* Return the clamped cell coordinate of 'pos' along one axis. */
+    int cell = (pos - min)*inv_cell_size;
+    if (cell < 0) {
+        return 0;
+    }
+    return cell < num_cells ? cell : num_cells-1;
+}
+
+
+static inline Collide_Box ball_box(const Ball_Store * balls, uint32_t i) {
+    return (Collide_Box){
+        balls->x[i], balls->y[i], balls->half_width[i], balls->half_height[i],
+    };
+}
+
+
+static inline uint32_t grid_bucket(const Collide_Grid * grid, uint32_t cell) {
+    /* Fold a cell index into a bucket. Plain masking keeps neighbouring
+     * cells in neighbouring buckets, so the sweep below stays cache
+     * friendly. */
+    return cell & grid->bucket_mask;
+}
+
+
+void collide_grid_build(Collide_Grid * grid, const Ball_Store * balls) {
+    /* Bucket all balls by the cell of their center with a counting sort. */
+
+    size_t count = balls->count < grid->capacity ? balls->count : grid->capacity;
+    size_t num_buckets = (size_t)grid->bucket_mask+1;
+    uint32_t * bucket_start = grid->bucket_start;
+
+    memset(bucket_start, 0, (num_buckets+1)*sizeof(uint32_t));
+
+    /* Count balls per bucket. */
+    for (size_t i=0; i<count; i++) {
+        int cx = grid_coordinate(balls->x[i], grid->min_x, grid->inv_cell_size, grid->cells_x);
+        int cy = grid_coordinate(balls->y[i], grid->min_y, grid->inv_cell_size, grid->cells_y);
+        uint32_t cell = cx + cy*grid->cells_x;
+        grid->ball_cell[i] = cell;
+        bucket_start[grid_bucket(grid, cell)]++;
+    }
+
+    /* Turn counts into start offsets. */
+    uint32_t sum = 0;
+    for (size_t b=0; b<num_buckets; b++) {
+        uint32_t num = bucket_start[b];
+        bucket_start[b] = sum;
+        sum += num;
+    }
+    bucket_start[num_buckets] = sum;
+
+    /* Scatter ball indices, advancing each start to the next bucket's
+     * start. */
+    for (size_t i=0; i<count; i++) {
+        uint32_t cell = grid->ball_cell[i];
+        uint32_t index = bucket_start[grid_bucket(grid, cell)]++;
+        grid->bucket_items[index] = i;
+        grid->bucket_cells[index] = cell;
+        grid->bucket_boxes[index] = ball_box(balls, i);
+    }
+
+    /* Shift the starts back into place. */
+    for (size_t b=num_buckets; b>0; b--) {
+        bucket_start[b] = bucket_start[b-1];
+    }
+    bucket_start[0] = 0;
+}
+
+
+static void resolve_ball_ball(Ball_Store * balls, uint32_t a, uint32_t b) {
+    /* Push two overlapping balls apart along the axis of least penetration
+     * and exchange their speeds along it if they are approaching (equal
+     * mass elastic collision). */
+
+    float dx = balls->x[b] - balls->x[a];
+    float dy = balls->y[b] - balls->y[a];
+    float pen_x = balls->half_width[a] + balls->half_width[b] - fabsf(dx);
+    float pen_y = balls->half_height[a] + balls->half_height[b] - fabsf(dy);
+
+    float * pos;
+    float * vel;
+    float pen, delta;
+    if (pen_x < pen_y) {
+        pos = balls->x;
+        vel = balls->vx;
+        pen = pen_x;
+        delta = dx;
+    } else {
+        pos = balls->y;
+        vel = balls->vy;
+        pen = pen_y;
+        delta = dy;
+    }
+
+    float direction = delta < 0.0f ? -1.0f : 1.0f;
+    pos[a] -= direction*pen*0.5f;
+    pos[b] += direction*pen*0.5f;
+
+    if ((vel[b] - vel[a])*direction < 0.0f) {
+        float temp = vel[a];
+        vel[a] = vel[b];
+        vel[b] = temp;
+    }
+}
+
+
+static void resolve_ball_paddle(Ball_Store * balls, uint32_t i, Collide_Box paddle) {
+    /* Place the ball against the paddle face on its side and send it away
+     * from the paddle. */
+    float direction = balls->x[i] < paddle.x ? -1.0f : 1.0f;
+    balls->x[i] = paddle.x + direction*(paddle.half_width + balls->half_width[i]);
+    balls->vx[i] = direction*fabsf(balls->vx[i]);
+}
+
+
+void collide_balls(Collide_Grid * grid,
+                   Ball_Store * balls,
+                   const Collide_Box * paddles,
+                   size_t num_paddles,
+                   Collide_Stats * stats) {
+    /* Find and resolve all ball-ball and ball-paddle contacts using the grid
+     * broadphase. Rebuilds the grid from the current positions. */
+
+    Collide_Stats local = {0};
+    collide_grid_build(grid, balls);
+
+    const uint32_t * bucket_start = grid->bucket_start;
+    const uint32_t * bucket_items = grid->bucket_items;
+    const uint32_t * bucket_cells = grid->bucket_cells;
+    Collide_Box * boxes = grid->bucket_boxes;
+    int cells_x = grid->cells_x;
+    int cells_y = grid->cells_y;
+    size_t count = bucket_start[grid->bucket_mask+1];
+
+    /* Neighbour cells visited from each cell so that every pair of cells is
+     * only visited once. */
+    const int neighbours[][2] = {{1, 0}, {-1, 1}, {0, 1}, {1, 1}};
+
+    /* Ball-ball, walking the balls in bucket order. Buckets can hold
+     * several cells, so entries are filtered by their exact cell. Tests
+     * read the sorted copies of the boxes, which are refreshed whenever a
+     * contact moves a ball. */
+    for (size_t i=0; i<count; i++) {
+        uint32_t a = bucket_items[i];
+        uint32_t cell = bucket_cells[i];
+        uint32_t end = bucket_start[grid_bucket(grid, cell)+1];
+
+        /* Later balls in the same cell. */
+        for (uint32_t j=i+1; j<end; j++) {
+            if (bucket_cells[j] != cell) {
+                continue;
+            }
+            local.pairs_tested++;
+            if (collide_overlap(boxes[i], boxes[j])) {
+                uint32_t b = bucket_items[j];
+                local.contacts++;
+                resolve_ball_ball(balls, a, b);
+                boxes[i] = ball_box(balls, a);
+                boxes[j] = ball_box(balls, b);
+            }
+        }
+
+        /* Balls in the forward neighbour cells. */
+        int cx = cell % cells_x;
+        int cy = cell / cells_x;
+        for (size_t n=0; n<sizeof(neighbours)/sizeof(neighbours[0]); n++) {
+            int nx = cx + neighbours[n][0];
+            int ny = cy + neighbours[n][1];
+            if (nx < 0 || nx >= cells_x || ny >= cells_y) {
+                continue;
+            }
+            uint32_t other = nx + ny*cells_x;
+            uint32_t bucket = grid_bucket(grid, other);
+            for (uint32_t j=bucket_start[bucket]; j<bucket_start[bucket+1]; j++) {
+                if (bucket_cells[j] != other) {
+                    continue;
+                }
+                local.pairs_tested++;
+                if (collide_overlap(boxes[i], boxes[j])) {
+                    uint32_t b = bucket_items[j];
+                    local.contacts++;
+                    resolve_ball_ball(balls, a, b);
+                    boxes[i] = ball_box(balls, a);
+                    boxes[j] = ball_box(balls, b);
+                }
+            }
+        }
+    }
+
+    /* Ball-paddle: visit the cells whose balls can reach each paddle. */
+    for (size_t p=0; p<num_paddles; p++) {
+        Collide_Box paddle = paddles[p];
+        float reach = grid->cell_size;
+        int x0 = grid_coordinate(paddle.x - paddle.half_width - reach,
+                                 grid->min_x, grid->inv_cell_size, cells_x);
+        int x1 = grid_coordinate(paddle.x + paddle.half_width + reach,
+                                 grid->min_x, grid->inv_cell_size, cells_x);
+        int y0 = grid_coordinate(paddle.y - paddle.half_height - reach,
+                                 grid->min_y, grid->inv_cell_size, cells_y);
+        int y1 = grid_coordinate(paddle.y + paddle.half_height + reach,
+                                 grid->min_y, grid->inv_cell_size, cells_y);
+
+        for (int cy=y0; cy<=y1; cy++) {
+            for (int cx=x0; cx<=x1; cx++) {
+                uint32_t cell = cx + cy*cells_x;
+                uint32_t bucket = grid_bucket(grid, cell);
+                for (uint32_t i=bucket_start[bucket]; i<bucket_start[bucket+1]; i++) {
+                    if (bucket_cells[i] != cell) {
+                        continue;
+                    }
+                    local.pairs_tested++;
+                    if (collide_overlap(boxes[i], paddle)) {
+                        uint32_t a = bucket_items[i];
+                        local.contacts++;
+                        resolve_ball_paddle(balls, a, paddle);
+                        boxes[i] = ball_box(balls, a);
+                    }
+                }
+            }
+        }
+    }
+
+    if (stats) {
+        stats->pairs_tested += local.pairs_tested;
+        stats->contacts += local.contacts;
+    }
+}
+
+
+void collide_balls_brute(Ball_Store * balls,
+                         const Collide_Box * paddles,
+                         size_t num_paddles,
+                         Collide_Stats * stats) {
+    /* Reference O(n^2) version of collide_balls, for benchmarking. */
+
+    Collide_Stats local = {0};
+    uint32_t count = balls->count;
+
+    for (uint32_t a=0; a<count; a++) {
+        for (uint32_t b=a+1; b<count; b++) {
+            local.pairs_tested++;
+            if (collide_overlap(ball_box(balls, a), ball_box(balls, b))) {
+                local.contacts++;
+                resolve_ball_ball(balls, a, b);
+            }
+        }
+        for (size_t p=0; p<num_paddles; p++) {
+            local.pairs_tested++;
+            if (collide_overlap(ball_box(balls, a), paddles[p])) {
+                local.contacts++;
+                resolve_ball_paddle(balls, a, paddles[p]);
+            }
+        }
+    }
+
+    if (stats) {
+        stats->pairs_tested += local.pairs_tested;
+        stats->contacts += local.contacts;
+    }
+}
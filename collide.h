@@ -0,0 +1,83 @@
+#ifndef COLLIDE_H
+#define COLLIDE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "balls.h"
+
+/* Collision detection for many-ball arenas. A uniform grid broadphase
+ * buckets balls by the cell holding their center (counting sort, no
+ * per-cell allocation), so only balls in neighbouring cells are tested by
+ * the AABB narrowphase. With cells at least as large as the largest ball,
+ * the number of pairs tested grows with the number of balls instead of its
+ * square. Cells are hashed into a table sized from the number of balls, so
+ * large sparse arenas do not pay for their empty cells. All coordinates are
+ * normalized device coordinates. */
+
+
+/* Axis-aligned box given by its center and half extents. */
+typedef struct Collide_Box {
+    float x;
+    float y;
+    float half_width;
+    float half_height;
+} Collide_Box;
+
+
+typedef struct Collide_Grid {
+    float min_x;
+    float min_y;
+    float cell_size;
+    float inv_cell_size;
+    int cells_x;
+    int cells_y;
+    size_t capacity; /* Maximum number of balls. */
+    uint32_t bucket_mask; /* Number of hash buckets minus one. */
+    uint32_t * bucket_start; /* bucket_mask+2 offsets into bucket_items. */
+    uint32_t * bucket_items; /* Ball indices sorted by bucket. */
+    uint32_t * bucket_cells; /* Cell of each entry in bucket_items. */
+    Collide_Box * bucket_boxes; /* Box of each entry in bucket_items. */
+    uint32_t * ball_cell; /* Cell of each ball, cx + cy*cells_x. */
+} Collide_Grid;
+
+
+typedef struct Collide_Stats {
+    uint64_t pairs_tested; /* Narrowphase tests run. */
+    uint64_t contacts; /* Tests that found an overlap. */
+} Collide_Stats;
+
+
+static inline bool collide_overlap(Collide_Box a, Collide_Box b) {
+    /* AABB narrowphase. */
+    float dx = a.x - b.x;
+    float dy = a.y - b.y;
+    dx = dx < 0.0f ? -dx : dx;
+    dy = dy < 0.0f ? -dy : dy;
+    return dx < a.half_width + b.half_width && dy < a.half_height + b.half_height;
+}
+
+
+int collide_grid_init(Collide_Grid * grid,
+                      float min_x,
+                      float min_y,
+                      float max_x,
+                      float max_y,
+                      float cell_size,
+                      size_t capacity);
+int collide_grid_init_arena(Collide_Grid * grid, const Sim_State * state, size_t capacity);
+size_t collide_paddles(const Sim_State * state, Collide_Box * paddles);
+void collide_grid_free(Collide_Grid * grid);
+void collide_grid_build(Collide_Grid * grid, const Ball_Store * balls);
+void collide_balls(Collide_Grid * grid,
+                   Ball_Store * balls,
+                   const Collide_Box * paddles,
+                   size_t num_paddles,
+                   Collide_Stats * stats);
+void collide_balls_brute(Ball_Store * balls,
+                         const Collide_Box * paddles,
+                         size_t num_paddles,
+                         Collide_Stats * stats);
+
+#endif
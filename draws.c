@@ -0,0 +1,389 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "draws.h"
+
+#define UNUSED(x) (void) x
+
+#define SIZE(x) sizeof(x)/sizeof(x[0])
+
+/* Floats of a square, two triangles of three coordinates per vertex. */
+#define SQUARE_FLOATS (2*3*3)
+
+
+static void setup_instanced_vao(GLuint vertex_array,
+                                GLuint VBO_square,
+                                GLvoid * ptr_offset,
+                                GLuint VBO_instances,
+                                size_t size_instances) {
+    /* Set up 'vertex_array' to draw the square at 'ptr_offset' in
+     * 'VBO_square' once per 2D offset stored in 'VBO_instances'. */
+
+    glBindVertexArray(vertex_array);
+
+    /* Square vertices. */
+    glBindBuffer(GL_ARRAY_BUFFER, VBO_square);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(GLfloat), ptr_offset);
+    glEnableVertexAttribArray(0);
+
+    /* Per-instance offsets, advanced once per square. */
+    glBindBuffer(GL_ARRAY_BUFFER, VBO_instances);
+    glBufferData(GL_ARRAY_BUFFER, size_instances, NULL, GL_STREAM_DRAW);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 2*sizeof(GLfloat), (GLvoid*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, 1);
+
+    /* Unbind vertex and buffer array. */
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+int draws_init(Draws * draws,
+               const Sim_State * sim,
+               GLuint program_shader,
+               const Transform_Ring * transforms,
+               Display_Batch * display_batch,
+               Ball_Batch * ball_batch,
+               size_t num_balls) {
+    /* Create the buffers and vertex arrays of the default path for up to
+     * 'num_balls' extra balls, with their instance buffers in the batches,
+     * and the render data that draws them with 'program_shader'. Binds
+     * behind the back of any Gl_State. Returns 0 on success, -1 on
+     * failure. */
+
+    memset(draws, 0, sizeof(*draws));
+
+    /* Both squares in one buffer, at their items' offsets. */
+    GLfloat vertices[2*SQUARE_FLOATS];
+    square(vertices, sim->items[ID_PADDLE_LEFT], sim->env);
+    square(vertices, sim->items[ID_BALL], sim->env);
+    size_t offset_ball = sim->items[ID_BALL].offset*SQUARE_FLOATS*sizeof(GLfloat);
+    GLvoid * ptr_ball = (GLvoid *)offset_ball;
+
+    glGenBuffers(1, &draws->VBO_squares);
+    glBindBuffer(GL_ARRAY_BUFFER, draws->VBO_squares);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+    /* Paddle and ball, one square each. */
+    glGenVertexArrays(1, &draws->VAO_paddles);
+    glBindVertexArray(draws->VAO_paddles);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(GLfloat), (GLvoid*)0);
+    glEnableVertexAttribArray(0);
+
+    glGenVertexArrays(1, &draws->VAO_ball);
+    glBindVertexArray(draws->VAO_ball);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(GLfloat), ptr_ball);
+    glEnableVertexAttribArray(0);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    /* Display cells, sharing the ball's square. */
+    glGenVertexArrays(1, &draws->VAO_display);
+    glGenBuffers(1, &display_batch->VBO_instances);
+    setup_instanced_vao(draws->VAO_display,
+                        draws->VBO_squares,
+                        ptr_ball,
+                        display_batch->VBO_instances,
+                        sizeof(display_batch->offsets));
+
+    /* Extra balls, likewise. */
+    if (num_balls > 0) {
+        ball_batch->offsets = malloc(2*num_balls*sizeof(GLfloat));
+        if (!ball_batch->offsets) {
+            return -1;
+        }
+        glGenVertexArrays(1, &draws->VAO_balls);
+        glGenBuffers(1, &ball_batch->VBO_instances);
+        setup_instanced_vao(draws->VAO_balls,
+                            draws->VBO_squares,
+                            ptr_ball,
+                            ball_batch->VBO_instances,
+                            2*num_balls*sizeof(GLfloat));
+    }
+
+    /* Both paddles are instances of one draw, the left one's slot right
+     * after the right one's. The ball, the displays and the extra balls
+     * each keep to one matrix. */
+    transform_ring_attach(transforms, draws->VAO_paddles, ID_PADDLE_RIGHT, 1);
+    transform_ring_attach(transforms, draws->VAO_ball, ID_BALL, 0);
+    transform_ring_attach(transforms, draws->VAO_display, ID_DISPLAY_RIGHT, 0);
+    if (draws->VAO_balls) {
+        transform_ring_attach(transforms, draws->VAO_balls, TRANSFORM_UNITY, 0);
+    }
+
+    draws->paddles = (Render_Data){
+        .VAO = draws->VAO_paddles,
+        .program_shader = program_shader,
+        .size_data = SQUARE_FLOATS,
+        .render_function = &render_basic,
+    };
+    draws->ball = (Render_Data){
+        .VAO = draws->VAO_ball,
+        .program_shader = program_shader,
+        .size_data = SQUARE_FLOATS,
+        .render_function = &render_basic,
+    };
+    draws->balls = (Render_Data){
+        .VAO = draws->VAO_balls,
+        .program_shader = program_shader,
+        .size_data = SQUARE_FLOATS,
+        .render_function = &render_balls,
+    };
+    draws->display = (Render_Data){
+        .VAO = draws->VAO_display,
+        .program_shader = program_shader,
+        .size_data = SQUARE_FLOATS,
+        .render_function = &render_display,
+    };
+    return glGetError() == GL_NO_ERROR ? 0 : -1;
+}
+
+
+void draws_free(Draws * draws, Display_Batch * display_batch, Ball_Batch * ball_batch) {
+    /* Delete what draws_init created, leaving the balls to their owner. */
+    GLuint vertex_arrays[] = {
+        draws->VAO_paddles, draws->VAO_ball, draws->VAO_display, draws->VAO_balls,
+    };
+    GLuint buffers[] = {
+        draws->VBO_squares, display_batch->VBO_instances, ball_batch->VBO_instances,
+    };
+    glDeleteVertexArrays(SIZE(vertex_arrays), vertex_arrays);
+    glDeleteBuffers(SIZE(buffers), buffers);
+    free(ball_batch->offsets);
+    ball_batch->offsets = NULL;
+    ball_batch->VBO_instances = 0;
+    display_batch->VBO_instances = 0;
+    memset(draws, 0, sizeof(*draws));
+}
+
+
+void draws_queue(const Draws * draws,
+                 Render_Queue * queue,
+                 Display_Batch * display_batch,
+                 Ball_Batch * ball_batch) {
+    /* Queue the frame's draws of the default path. */
+
+    /* Render both paddles, one instance each. */
+    render(queue, draws->paddles, (void*)0, 2);
+
+    /* Render the ball. */
+    render(queue, draws->ball, (void*)0, 0);
+
+    /* Render the extra balls. */
+    if (ball_batch->balls.count > 0) {
+        render(queue, draws->balls, (void*)ball_batch, ball_batch->balls.count);
+    }
+
+    /* Render both displays. */
+    render(queue, draws->display, (void*)display_batch, MAX_DISPLAYS);
+}
+
+
+void render_basic(Gl_State * state,
+                  GLuint vertex_array,
+                  GLuint program_shader,
+                  size_t s_vertices,
+                  void * data,
+                  size_t size_data) {
+    /* Render function for objects of one square each. Draws 'size_data'
+     * instances, one per object from the vertex array's matrix slot on, or
+     * a single object if 0. */
+
+    UNUSED(data);
+
+    /* Set the current linker program that should be used. */
+    gl_use_program(state, program_shader);
+
+    /* Bind the VAO that should be used. */
+    gl_bind_vertex_array(state, vertex_array);
+
+    /* Draw the vertices as triangles. */
+    gl_draw_arrays(state, 0, s_vertices/3, size_data);
+}
+
+
+void render_display(Gl_State * state,
+                    GLuint vertex_array,
+                    GLuint program_shader,
+                    size_t s_vertices,
+                    void * data,
+                    size_t size_data) {
+    /* Render function for the display entities. Collects the offsets of
+     * every lit cell of every digit of every display in 'data' into the
+     * instance buffer and draws them all with a single instanced draw
+     * call. */
+
+    /* Unpack data. */
+    Display_Batch * batch = (Display_Batch*)data;
+    size_t num_displays = size_data;
+
+    /* Collect offsets for all lit cells. */
+    size_t num_instances = 0;
+    for (size_t i=0; i<num_displays; i++) {
+        num_instances += display_cells(batch->displays[i],
+                                       &batch->offsets[num_instances]);
+    }
+
+    if (num_instances == 0) {
+        return;
+    }
+
+    /* Upload offsets, orphaning the previous contents. */
+    size_t size_offsets = num_instances*sizeof(batch->offsets[0]);
+    gl_stream_upload(state, batch->VBO_instances, sizeof(batch->offsets),
+                     batch->offsets, size_offsets);
+
+    /* Set the current linker program that should be used. */
+    gl_use_program(state, program_shader);
+
+    /* Bind the VAO that should be used. */
+    gl_bind_vertex_array(state, vertex_array);
+
+    /* Draw one square per lit element. */
+    gl_draw_arrays(state, 0, s_vertices/3, num_instances);
+}
+
+
+void render_balls(Gl_State * state,
+                  GLuint vertex_array,
+                  GLuint program_shader,
+                  size_t s_vertices,
+                  void * data,
+                  size_t size_data) {
+    /* Render function for the multi-ball mode. Interleaves the positions
+     * from the struct-of-arrays store into the instance buffer and draws
+     * every ball with a single instanced draw call. */
+
+    /* Unpack data. */
+    Ball_Batch * batch = (Ball_Batch*)data;
+    Ball_Store * balls = &batch->balls;
+    size_t num_balls = size_data;
+
+    if (num_balls == 0) {
+        return;
+    }
+
+    /* Interleave positions. */
+    for (size_t i=0; i<num_balls; i++) {
+        batch->offsets[2*i+0] = balls->x[i];
+        batch->offsets[2*i+1] = balls->y[i];
+    }
+
+    /* Upload offsets, orphaning the previous contents. */
+    size_t size_offsets = 2*num_balls*sizeof(GLfloat);
+    gl_stream_upload(state, batch->VBO_instances, size_offsets,
+                     batch->offsets, size_offsets);
+
+    /* Set the current linker program that should be used. */
+    gl_use_program(state, program_shader);
+
+    /* Bind the VAO that should be used. */
+    gl_bind_vertex_array(state, vertex_array);
+
+    /* Draw one square per ball. */
+    gl_draw_arrays(state, 0, s_vertices/3, num_balls);
+}
+
+
+void render_sprites(Gl_State * state,
+                    GLuint vertex_array,
+                    GLuint program_shader,
+                    size_t s_vertices,
+                    void * data,
+                    size_t size_data) {
+    /* Render function for the sprite batcher. Draws every square of the
+     * frame, already written to the stream in 'data', with one draw call. */
+
+    UNUSED(s_vertices);
+    UNUSED(size_data);
+
+    Sprite_Stream * stream = (Sprite_Stream*)data;
+    if (stream->count == 0) {
+        return;
+    }
+
+    /* Set the current linker program that should be used. */
+    gl_use_program(state, program_shader);
+
+    /* Bind the stream's VAO. */
+    gl_bind_vertex_array(state, vertex_array);
+
+    /* Draw two triangles per square. */
+    gl_draw_arrays(state, stream->first, stream->count*SPRITE_VERTICES, 0);
+}
+
+
+void sprites_build(Sprite_Batch * batch,
+                   m4 * transformation_matrices,
+                   const Sim_State * sim,
+                   const Ball_Batch * ball_batch,
+                   Display_Batch * display_batch,
+                   size_t num_displays) {
+    /* Append every square of the frame to 'batch', with the paddles and the
+     * ball where their transformations put them. */
+
+    v3 positions[ID_NUM];
+    for (size_t i=0; i<ID_NUM; i++) {
+        positions[i] = (v3){
+            .x = transformation_matrices[i][0][3],
+            .y = transformation_matrices[i][1][3],
+        };
+    }
+
+    const Ball_Store * balls = ball_batch->balls.count > 0 ? &ball_batch->balls : NULL;
+    scene_sprites(batch, sim, positions, balls, display_batch->displays, num_displays,
+                  display_batch->offsets);
+}
+
+
+void render_software(Gl_State * state,
+                     GLuint vertex_array,
+                     GLuint program_shader,
+                     size_t s_vertices,
+                     void * data,
+                     size_t size_data) {
+    /* Render function for the software backend. Rasterizes every square of
+     * the frame, already in the batch of 'data', on the CPU and copies the
+     * result to the window. */
+
+    UNUSED(vertex_array);
+    UNUSED(program_shader);
+    UNUSED(s_vertices);
+    UNUSED(size_data);
+
+    Software_Frame * frame = (Software_Frame*)data;
+    Raster_Target * target = &frame->raster.target;
+
+    raster_draw(&frame->raster, &frame->batch, 0xff000000, 0xffffffff);
+
+    /* Upload the pixels and blit them over the window, flipping the rows
+     * since the framebuffer starts at the top. */
+    glBindTexture(GL_TEXTURE_2D, frame->texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, target->width, target->height,
+                    GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, target->pixels);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, frame->framebuffer);
+    glBlitFramebuffer(0, 0, target->width, target->height,
+                      0, frame->height, frame->width, 0,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    state->frame.calls += 5;
+    state->frame.draws++;
+}
+
+
+void sync_transformations(m4 * transformation_matrices,
+                          const Sim_Vec * positions_previous,
+                          const Sim_State * state,
+                          GLfloat alpha) {
+    /* Interpolate between the previous and current simulated positions and
+     * store the result in the translation part of the transformation
+     * matrices used for rendering. */
+    for (size_t i=0; i<ID_NUM; i++) {
+        v3 previous = sim_to_ndc(&state->env, positions_previous[i]);
+        v3 current = sim_to_ndc(&state->env, state->positions[i]);
+        transformation_matrices[i][0][3] = previous.x + (current.x-previous.x)*alpha;
+        transformation_matrices[i][1][3] = previous.y + (current.y-previous.y)*alpha;
+    }
+}
@@ -0,0 +1,139 @@
+#ifndef DRAWS_H
+#define DRAWS_H
+
+#include <stddef.h>
+#include <GL/glew.h>
+
+#include "sim.h"
+#include "balls.h"
+#include "collide.h"
+#include "scene.h"
+#include "sprites.h"
+#include "raster.h"
+#include "gl_state.h"
+#include "transforms.h"
+#include "sprite_stream.h"
+#include "render_queue.h"
+
+/* GL side of what is drawn: the vertex arrays of the paddles, the ball,
+ * the extra balls and the displays, and the render functions that the
+ * render queue calls for them and for the sprite and software backends.
+ * Shared by the game and the golden image harness, so that the harness
+ * checks the draws the game makes.
+ *
+ * Every square is one of the two squares of a single vertex buffer, the
+ * paddle's and the ball's, moved by a matrix of the transformation ring.
+ * Both paddles are instances of one draw, and the displays and the extra
+ * balls are instances offset from their square. */
+
+
+/* Transformation slot of the unity matrix, for things placed in normalized
+ * device coordinates already. */
+#define TRANSFORM_UNITY ID_NUM
+#define NUM_TRANSFORMS (ID_NUM + 1)
+
+/* Maximum number of displays drawn in one batch. */
+#define MAX_DISPLAYS 2
+
+
+/* Displays drawn together with one instanced draw call. */
+typedef struct Display_Batch {
+    Display * displays[MAX_DISPLAYS];
+    GLuint VBO_instances;
+    GLfloat offsets[MAX_DISPLAYS*DISPLAY_MAX_CELLS][2];
+} Display_Batch;
+
+
+/* Extra balls of the multi-ball mode, drawn with one instanced call. */
+typedef struct Ball_Batch {
+    Ball_Store balls;
+    Collide_Grid grid;
+    GLuint VBO_instances;
+    GLfloat * offsets; /* Interleaved x, y per ball. */
+} Ball_Batch;
+
+
+/* Frame drawn by the software backend, and the texture and framebuffer it
+ * is shown through. */
+typedef struct Software_Frame {
+    Raster raster;
+    Sprite_Batch batch;
+    float * vertices;
+    size_t capacity; /* Squares. */
+    GLuint texture;
+    GLuint framebuffer;
+    int width; /* Window framebuffer size to blit to. */
+    int height;
+} Software_Frame;
+
+
+/* Buffers and render data of the default path. */
+typedef struct Draws {
+    GLuint VBO_squares; /* The paddle's square, then the ball's. */
+    GLuint VAO_paddles;
+    GLuint VAO_ball;
+    GLuint VAO_display;
+    GLuint VAO_balls; /* 0 without extra balls. */
+    Render_Data paddles;
+    Render_Data ball;
+    Render_Data balls;
+    Render_Data display;
+} Draws;
+
+
+int draws_init(Draws * draws,
+               const Sim_State * sim,
+               GLuint program_shader,
+               const Transform_Ring * transforms,
+               Display_Batch * display_batch,
+               Ball_Batch * ball_batch,
+               size_t num_balls);
+void draws_free(Draws * draws, Display_Batch * display_batch, Ball_Batch * ball_batch);
+void draws_queue(const Draws * draws,
+                 Render_Queue * queue,
+                 Display_Batch * display_batch,
+                 Ball_Batch * ball_batch);
+
+void render_basic(Gl_State * state,
+                  GLuint vertex_array,
+                  GLuint program_shader,
+                  size_t s_vertices,
+                  void * data,
+                  size_t size_data);
+void render_display(Gl_State * state,
+                    GLuint vertex_array,
+                    GLuint program_shader,
+                    size_t s_vertices,
+                    void * data,
+                    size_t size_data);
+void render_balls(Gl_State * state,
+                  GLuint vertex_array,
+                  GLuint program_shader,
+                  size_t s_vertices,
+                  void * data,
+                  size_t size_data);
+void render_sprites(Gl_State * state,
+                    GLuint vertex_array,
+                    GLuint program_shader,
+                    size_t s_vertices,
+                    void * data,
+                    size_t size_data);
+void render_software(Gl_State * state,
+                     GLuint vertex_array,
+                     GLuint program_shader,
+                     size_t s_vertices,
+                     void * data,
+                     size_t size_data);
+
+void sprites_build(Sprite_Batch * batch,
+                   m4 * transformation_matrices,
+                   const Sim_State * sim,
+                   const Ball_Batch * ball_batch,
+                   Display_Batch * display_batch,
+                   size_t num_displays);
+void sync_transformations(m4 * transformation_matrices,
+                          const Sim_Vec * positions_previous,
+                          const Sim_State * state,
+                          GLfloat alpha);
+
+#endif
@@ -0,0 +1,129 @@
+#include <string.h>
+
+#include "gl_state.h"
+
+
+/* Binding that matches no object, so that the next bind is always made. */
+#define GL_STATE_UNKNOWN ((GLuint)-1)
+
+/* Nanoseconds to wait for a fence per try, before checking again. */
+#define GL_FENCE_WAIT_NS 1000000
+
+
+void gl_state_reset(Gl_State * state) {
+    /* Forget what is bound, keeping the counts. */
+    state->program = GL_STATE_UNKNOWN;
+    state->vertex_array = GL_STATE_UNKNOWN;
+    state->array_buffer = GL_STATE_UNKNOWN;
+    for (size_t i=0; i<GL_STATE_UNIFORM_BINDINGS; i++) {
+        state->uniform_ranges[i] = (Gl_Uniform_Range){GL_STATE_UNKNOWN, 0, 0};
+    }
+}
+
+
+void gl_state_frame(Gl_State * state) {
+    /* Start counting the calls of a new frame. */
+    state->total.calls += state->frame.calls;
+    state->total.skipped += state->frame.skipped;
+    state->total.draws += state->frame.draws;
+    state->frames++;
+    memset(&state->frame, 0, sizeof(state->frame));
+}
+
+
+void gl_use_program(Gl_State * state, GLuint program) {
+    if (state->program == program) {
+        state->frame.skipped++;
+        return;
+    }
+    glUseProgram(program);
+    state->program = program;
+    state->frame.calls++;
+}
+
+
+void gl_bind_vertex_array(Gl_State * state, GLuint vertex_array) {
+    if (state->vertex_array == vertex_array) {
+        state->frame.skipped++;
+        return;
+    }
+    glBindVertexArray(vertex_array);
+    state->vertex_array = vertex_array;
+    state->frame.calls++;
+}
+
+
+void gl_bind_array_buffer(Gl_State * state, GLuint buffer) {
+    if (state->array_buffer == buffer) {
+        state->frame.skipped++;
+        return;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    state->array_buffer = buffer;
+    state->frame.calls++;
+}
+
+
+void gl_bind_uniform_range(Gl_State * state, GLuint binding, GLuint buffer,
+                           GLintptr offset, GLsizeiptr size) {
+    /* Bind a range of 'buffer' to uniform buffer binding point 'binding'.
+     * Bindings past the ones tracked are bound every time. */
+    if (binding < GL_STATE_UNIFORM_BINDINGS) {
+        Gl_Uniform_Range * range = &state->uniform_ranges[binding];
+        if (range->buffer == buffer && range->offset == offset && range->size == size) {
+            state->frame.skipped++;
+            return;
+        }
+        *range = (Gl_Uniform_Range){buffer, offset, size};
+    }
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset, size);
+    state->frame.calls++;
+}
+
+
+void gl_stream_upload(Gl_State * state, GLuint buffer, size_t capacity,
+                      const void * data, size_t size) {
+    /* Replace the contents of the array buffer 'buffer', of 'capacity'
+     * bytes, with 'size' bytes of 'data', orphaning the previous contents so
+     * the upload does not wait for draws still reading them. */
+    gl_bind_array_buffer(state, buffer);
+    glBufferData(GL_ARRAY_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+    state->frame.calls += 2;
+}
+
+
+void gl_draw_arrays(Gl_State * state, GLint first, GLsizei count, GLsizei instances) {
+    /* Draw 'count' vertices of triangles from 'first' on in the bound vertex
+     * array, 'instances' times, or once without instancing if 0. */
+    if (instances > 0) {
+        glDrawArraysInstanced(GL_TRIANGLES, first, count, instances);
+    } else {
+        glDrawArrays(GL_TRIANGLES, first, count);
+    }
+    state->frame.calls++;
+    state->frame.draws++;
+}
+
+
+int gl_fence_wait(GLsync * fence) {
+    /* Wait until the GPU has passed '*fence', if set, and delete it. Returns
+     * 1 if that meant waiting, 0 if it had passed already. */
+
+    if (!*fence) {
+        return 0;
+    }
+
+    int waited = 0;
+    GLenum status = glClientWaitSync(*fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+        waited = 1;
+        do {
+            status = glClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                      GL_FENCE_WAIT_NS);
+        } while (status == GL_TIMEOUT_EXPIRED);
+    }
+    glDeleteSync(*fence);
+    *fence = 0;
+    return waited;
+}
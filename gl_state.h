@@ -0,0 +1,55 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <GL/glew.h>
+
+/* Shadow of the GL bindings the renderer changes, so that binding what is
+ * bound already costs no GL call. Everything that draws a frame goes
+ * through it and counts its GL calls, both those made and those the cache
+ * saved. Code that binds behind its back must call gl_state_reset. */
+
+
+/* Uniform buffer binding points whose ranges are kept track of. */
+#define GL_STATE_UNIFORM_BINDINGS 4
+
+
+typedef struct Gl_State_Stats {
+    uint64_t calls; /* GL calls made. */
+    uint64_t skipped; /* Binds left out as redundant. */
+    uint64_t draws;
+} Gl_State_Stats;
+
+
+typedef struct Gl_Uniform_Range {
+    GLuint buffer;
+    GLintptr offset;
+    GLsizeiptr size;
+} Gl_Uniform_Range;
+
+
+typedef struct Gl_State {
+    GLuint program;
+    GLuint vertex_array;
+    GLuint array_buffer;
+    Gl_Uniform_Range uniform_ranges[GL_STATE_UNIFORM_BINDINGS]; /* Per binding. */
+    Gl_State_Stats frame; /* Since the last gl_state_frame. */
+    Gl_State_Stats total;
+    uint64_t frames;
+} Gl_State;
+
+
+void gl_state_reset(Gl_State * state);
+void gl_state_frame(Gl_State * state);
+void gl_use_program(Gl_State * state, GLuint program);
+void gl_bind_vertex_array(Gl_State * state, GLuint vertex_array);
+void gl_bind_array_buffer(Gl_State * state, GLuint buffer);
+void gl_bind_uniform_range(Gl_State * state, GLuint binding, GLuint buffer,
+                           GLintptr offset, GLsizeiptr size);
+void gl_stream_upload(Gl_State * state, GLuint buffer, size_t capacity,
+                      const void * data, size_t size);
+void gl_draw_arrays(Gl_State * state, GLint first, GLsizei count, GLsizei instances);
+int gl_fence_wait(GLsync * fence);
+
+#endif
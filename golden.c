@@ -0,0 +1,550 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "sim.h"
+#include "balls.h"
+#include "collide.h"
+#include "scene.h"
+#include "sprites.h"
+#include "raster.h"
+#include "histogram.h"
+#include "offscreen.h"
+#include "gl_state.h"
+#include "transforms.h"
+#include "sprite_stream.h"
+#include "render_queue.h"
+#include "draws.h"
+#include "shaders.h"
+
+/* Golden image regression harness: steps scripted matches, draws a frame of
+ * each into an offscreen context and compares it to the image kept for it.
+ * Every frame is drawn twice, through the game's sprite path and through
+ * its default path of instanced draws, both with the game's own render
+ * functions and render queue, and both must match the same image. Needs no
+ * window or display server, so it runs in CI on Mesa's llvmpipe.
+ *
+ * Prints one line per frame and path and exits with failure if any frame
+ * differs. The frames that differ are written next to their golden images
+ * with an '.actual.ppm' suffix. With --update the golden images are written
+ * from the sprite path instead, and the default path is checked against
+ * them. With --software the frames are drawn by the software rasterizer,
+ * which must agree with the GPU, and with --bench the script is drawn over
+ * and over to time each render path end to end. */
+
+
+#define GOLDEN_DIR "golden"
+
+/* Size of the golden images. A fifth of the arena, so that the edges of
+ * squares at whole arena pixels never run through pixel centers. */
+#define GOLDEN_WIDTH 160
+#define GOLDEN_HEIGHT 120
+
+
+/* Arena size of the game window, which the script runs in whatever the
+ * size of the images. */
+#define ARENA_WIDTH 800
+#define ARENA_HEIGHT 600
+
+
+typedef struct Golden_Frame {
+    const char * name;
+    uint64_t ticks; /* Stepped before drawing. */
+    size_t num_balls; /* Extra balls. */
+} Golden_Frame;
+
+
+/* Each frame starts a match from scratch with the same scripted input. */
+static const Golden_Frame script[] = {
+    {"start", 0, 0},
+    {"rally", 90, 0},
+    {"score", 3000, 0},
+    {"balls", 240, 64},
+};
+
+
+/* A match played up to a frame of the script. */
+typedef struct Golden_Scene {
+    Sim_State sim;
+    Ball_Store balls;
+    Display displays[2];
+} Golden_Scene;
+
+
+/* Ways of drawing a frame, each one of the game's. */
+typedef enum Golden_Path {
+    PATH_SOFTWARE,
+    PATH_SPRITES,
+    PATH_BASIC,
+} Golden_Path;
+
+
+static const char * const path_names[] = {"software", "sprites", "basic"};
+
+
+typedef struct Renderer {
+    int software;
+    Offscreen offscreen;
+    Gl_State state;
+    GLuint program;
+    Transform_Ring transforms;
+    Sprite_Stream stream;
+    Render_Queue queue;
+    Render_Data sprites;
+    Draws draws;
+    Display_Batch display_batch;
+    Ball_Batch ball_batch; /* Shares the balls of the scene drawn. */
+    Raster raster;
+    float * vertices; /* Of the batch, if software. */
+    size_t capacity; /* Squares per frame. */
+} Renderer;
+
+
+static double time_now(void) {
+    /* Return a monotonic timestamp in seconds. */
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+
+static Sim_Input scripted_input(uint32_t * rng) {
+    /* Produce pseudo-random but reproducible input bits (xorshift32). */
+    uint32_t x = *rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *rng = x;
+    return x & (INPUT_RIGHT_UP | INPUT_RIGHT_DOWN |
+                INPUT_LEFT_UP | INPUT_LEFT_DOWN);
+}
+
+
+// ================================================================
+// == Images.
+// ================================================================
+
+static int read_ppm(const char * path, Raster_Target * target) {
+    /* Read the binary PPM at 'path' into a freshly allocated 'target'.
+     * Returns 0 on success, -1 on failure. */
+
+    FILE * file = fopen(path, "rb");
+    if (!file) {
+        return -1;
+    }
+    int width, height, max;
+    if (fscanf(file, "P6 %d %d %d", &width, &height, &max) != 3 ||
+        fgetc(file) == EOF || width <= 0 || height <= 0 || max != 255) {
+        fclose(file);
+        return -1;
+    }
+
+    size_t num_pixels = (size_t)width*height;
+    unsigned char * rgb = malloc(3*num_pixels);
+    target->pixels = malloc(num_pixels*sizeof(uint32_t));
+    int result = rgb && target->pixels &&
+                 fread(rgb, 3, num_pixels, file) == num_pixels ? 0 : -1;
+    fclose(file);
+    if (result == 0) {
+        for (size_t i=0; i<num_pixels; i++) {
+            target->pixels[i] = 0xff000000u | (uint32_t)rgb[3*i] << 16 |
+                                (uint32_t)rgb[3*i+1] << 8 | rgb[3*i+2];
+        }
+        target->width = width;
+        target->height = height;
+    } else {
+        free(target->pixels);
+        target->pixels = NULL;
+    }
+    free(rgb);
+    return result;
+}
+
+
+static int write_ppm(const char * path, const Raster_Target * target) {
+    /* Write 'target' to 'path'. Returns 0 on success, -1 on failure. */
+    FILE * file = fopen(path, "wb");
+    if (!file) {
+        return -1;
+    }
+    int result = raster_write_ppm(target, file);
+    if (fclose(file) != 0) {
+        result = -1;
+    }
+    return result;
+}
+
+
+static size_t compare(const Raster_Target * expected, const Raster_Target * actual,
+                      int tolerance) {
+    /* Count the pixels where a color channel differs by more than
+     * 'tolerance'. Images of different sizes differ everywhere. */
+
+    size_t num_pixels = (size_t)actual->width*actual->height;
+    if (expected->width != actual->width || expected->height != actual->height) {
+        return num_pixels;
+    }
+    size_t differ = 0;
+    for (size_t i=0; i<num_pixels; i++) {
+        for (int shift=0; shift<24; shift+=8) {
+            int a = expected->pixels[i] >> shift & 0xff;
+            int b = actual->pixels[i] >> shift & 0xff;
+            if (abs(a - b) > tolerance) {
+                differ++;
+                break;
+            }
+        }
+    }
+    return differ;
+}
+
+
+// ================================================================
+// == Drawing.
+// ================================================================
+
+static int renderer_init(Renderer * renderer, int width, int height, int software,
+                         const Sim_State * sim, size_t num_balls) {
+    /* Set up drawing 'width' by 'height' frames of matches like 'sim' with
+     * up to 'num_balls' extra balls, on the GPU or in software. Returns 0 on
+     * success, -1 on failure. */
+
+    /* Room for the paddles, the ball, the extra balls and every display
+     * cell. */
+    size_t capacity = 3 + num_balls + MAX_DISPLAYS*DISPLAY_MAX_CELLS;
+
+    memset(renderer, 0, sizeof(*renderer));
+    renderer->software = software;
+    renderer->capacity = capacity;
+
+    if (software) {
+        renderer->vertices = malloc(capacity*SPRITE_FLOATS*sizeof(float));
+        if (!renderer->vertices || raster_init(&renderer->raster, width, height, 1) != 0) {
+            return -1;
+        }
+        return 0;
+    }
+
+    if (offscreen_init(&renderer->offscreen, width, height) != 0) {
+        fprintf(stderr, "Could not create an offscreen GL 3.3 context.\n");
+        return -1;
+    }
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+
+    char buffer_info[1024];
+    renderer->program = glCreateProgram();
+    if (!program_build(renderer->program, buffer_info, sizeof(buffer_info))) {
+        fprintf(stderr, "Error building the shader program:\n%s", buffer_info);
+        return -1;
+    }
+    GLuint uindex_transform = glGetUniformBlockIndex(renderer->program, "Transform");
+    glUniformBlockBinding(renderer->program, uindex_transform, TRANSFORMS_BINDING);
+
+    /* The game's matrices, buffers and vertex arrays. */
+    if (transform_ring_init(&renderer->transforms, NUM_TRANSFORMS) != 0 ||
+        (sprite_stream_init(&renderer->stream, capacity, 1) != 0 &&
+         sprite_stream_init(&renderer->stream, capacity, 0) != 0) ||
+        draws_init(&renderer->draws, sim, renderer->program, &renderer->transforms,
+                   &renderer->display_batch, &renderer->ball_batch, num_balls) != 0) {
+        return -1;
+    }
+    transform_ring_attach(&renderer->transforms, renderer->stream.vertex_array,
+                          TRANSFORM_UNITY, 0);
+    renderer->sprites = (Render_Data){
+        .VAO = renderer->stream.vertex_array,
+        .program_shader = renderer->program,
+        .render_function = &render_sprites,
+    };
+    gl_state_reset(&renderer->state);
+    return 0;
+}
+
+
+static void renderer_free(Renderer * renderer) {
+    if (renderer->software) {
+        raster_free(&renderer->raster);
+        free(renderer->vertices);
+        return;
+    }
+    if (renderer->offscreen.context == EGL_NO_CONTEXT) {
+        return;
+    }
+    draws_free(&renderer->draws, &renderer->display_batch, &renderer->ball_batch);
+    sprite_stream_free(&renderer->stream);
+    transform_ring_free(&renderer->transforms);
+    glDeleteProgram(renderer->program);
+    offscreen_free(&renderer->offscreen);
+}
+
+
+static int draw(Renderer * renderer, Golden_Path path, Golden_Scene * scene) {
+    /* Draw the frame of 'scene' as the game does along 'path'. Returns 0
+     * on success, -1 on failure. */
+
+    /* The matrices of the game, at the tick drawn. */
+    const Sim_State * sim = &scene->sim;
+    m4 matrices[NUM_TRANSFORMS];
+    for (size_t i=0; i<NUM_TRANSFORMS; i++) {
+        m4_set(matrices[i], m4_unity);
+    }
+    sync_transformations(matrices, sim->positions, sim, 1.0f);
+
+    Display_Batch * display_batch = &renderer->display_batch;
+    Ball_Batch * ball_batch = &renderer->ball_batch;
+    display_batch->displays[0] = &scene->displays[0];
+    display_batch->displays[1] = &scene->displays[1];
+    ball_batch->balls = scene->balls;
+
+    Sprite_Batch batch;
+    if (path == PATH_SOFTWARE) {
+        sprite_batch_begin(&batch, renderer->vertices, renderer->capacity);
+        sprites_build(&batch, matrices, sim, ball_batch, display_batch, MAX_DISPLAYS);
+        raster_draw(&renderer->raster, &batch, 0xff000000, 0xffffffff);
+        return 0;
+    }
+
+    Gl_State * state = &renderer->state;
+    gl_state_frame(state);
+    if (transform_ring_upload(&renderer->transforms, matrices) != 0) {
+        return -1;
+    }
+    if (path == PATH_SPRITES) {
+        if (sprite_stream_begin(&renderer->stream, state, &batch) != 0) {
+            return -1;
+        }
+        sprites_build(&batch, matrices, sim, ball_batch, display_batch, MAX_DISPLAYS);
+        sprite_stream_end(&renderer->stream, state, &batch);
+        render(&renderer->queue, renderer->sprites, (void*)&renderer->stream, batch.count);
+    } else {
+        draws_queue(&renderer->draws, &renderer->queue, display_batch, ball_batch);
+    }
+
+    glClear(GL_COLOR_BUFFER_BIT);
+    transform_ring_bind(&renderer->transforms, state);
+    render_queue_submit(&renderer->queue, state);
+    transform_ring_fence(&renderer->transforms);
+    sprite_stream_fence(&renderer->stream);
+    return 0;
+}
+
+
+static int read_frame(Renderer * renderer, Raster_Target * target) {
+    /* Copy the frame drawn last into 'target', of the frame's size. Returns
+     * 0 on success, -1 on failure. */
+    if (renderer->software) {
+        const Raster_Target * drawn = &renderer->raster.target;
+        memcpy(target->pixels, drawn->pixels,
+               (size_t)drawn->width*drawn->height*sizeof(uint32_t));
+        return 0;
+    }
+    return offscreen_read(&renderer->offscreen, target);
+}
+
+
+static int play(Golden_Scene * scene, const Golden_Frame * frame) {
+    /* Play the script up to 'frame' into 'scene'. Returns 0 on success, -1
+     * on failure. */
+
+    memset(scene, 0, sizeof(*scene));
+    Sim_State * sim = &scene->sim;
+    sim_init(sim, ARENA_WIDTH, ARENA_HEIGHT);
+    sim_set_tick_rate(sim, 120);
+
+    Collide_Grid grid = {0};
+    Collide_Box paddles[2];
+    if (frame->num_balls > 0) {
+        if (balls_init(&scene->balls, frame->num_balls) != 0 ||
+            collide_grid_init_arena(&grid, sim, scene->balls.capacity) != 0) {
+            balls_free(&scene->balls);
+            return -1;
+        }
+        balls_spawn(&scene->balls, frame->num_balls, sim, 1);
+    }
+
+    uint32_t rng = 0x9e3779b9u;
+    for (uint64_t i=0; i<frame->ticks; i++) {
+        sim_step(sim, scripted_input(&rng));
+        if (frame->num_balls > 0) {
+            balls_step(&scene->balls);
+            size_t num_paddles = collide_paddles(sim, paddles);
+            collide_balls(&grid, &scene->balls, paddles, num_paddles, NULL);
+        }
+    }
+    if (frame->num_balls > 0) {
+        collide_grid_free(&grid);
+    }
+
+    scene_displays(&scene->displays[0], &scene->displays[1], sim->items, &sim->env);
+    display_set(&scene->displays[0], sim->score[ID_PADDLE_RIGHT]);
+    display_set(&scene->displays[1], sim->score[ID_PADDLE_LEFT]);
+    return 0;
+}
+
+
+// ================================================================
+// == Harness.
+// ================================================================
+
+static void usage(const char * name) {
+    fprintf(stderr, "usage: %s [--update] [--dir path] [--size WxH] [--tolerance n]\n"
+                    "       [--software] [--bench frames]\n", name);
+    exit(EXIT_FAILURE);
+}
+
+
+int main(int argc, char ** argv) {
+
+    const char * dir = GOLDEN_DIR;
+    int width = GOLDEN_WIDTH;
+    int height = GOLDEN_HEIGHT;
+    int tolerance = 0;
+    int update = 0;
+    int software = 0;
+    uint64_t num_bench = 0;
+
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "--update") == 0) {
+            update = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--software") == 0) {
+            software = 1;
+            continue;
+        }
+        if (i+1 >= argc) {
+            usage(argv[0]);
+        }
+        if (strcmp(argv[i], "--dir") == 0) {
+            dir = argv[++i];
+        } else if (strcmp(argv[i], "--size") == 0) {
+            if (sscanf(argv[++i], "%dx%d", &width, &height) != 2) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--tolerance") == 0) {
+            tolerance = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            num_bench = strtoull(argv[++i], NULL, 10);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (width <= 0 || height <= 0 || tolerance < 0) {
+        usage(argv[0]);
+    }
+
+    /* The most extra balls of the script. */
+    size_t num_balls = 0;
+    for (size_t i=0; i<sizeof(script)/sizeof(script[0]); i++) {
+        num_balls = script[i].num_balls > num_balls ? script[i].num_balls : num_balls;
+    }
+
+    /* The software rasterizer draws alone, the GPU along both paths, the
+     * first one writing the images with --update. */
+    static const Golden_Path paths_software[] = {PATH_SOFTWARE};
+    static const Golden_Path paths_gpu[] = {PATH_SPRITES, PATH_BASIC};
+    const Golden_Path * paths = software ? paths_software : paths_gpu;
+    size_t num_paths = software ? 1 : 2;
+
+    static Renderer renderer;
+    static Golden_Scene scenes[sizeof(script)/sizeof(script[0])];
+    Raster_Target actual = {
+        .pixels = malloc((size_t)width*height*sizeof(uint32_t)),
+        .width = width,
+        .height = height,
+    };
+
+    /* The squares are sized for the arena every match of the script is
+     * played in. */
+    static Sim_State arena;
+    sim_init(&arena, ARENA_WIDTH, ARENA_HEIGHT);
+    if (!actual.pixels ||
+        renderer_init(&renderer, width, height, software, &arena, num_balls) != 0) {
+        fprintf(stderr, "Could not set up drawing %dx%d frames.\n", width, height);
+        renderer_free(&renderer);
+        return EXIT_FAILURE;
+    }
+    if (!software) {
+        printf("renderer: %s\n", (const char *)glGetString(GL_RENDERER));
+    }
+
+    size_t num_frames = sizeof(script)/sizeof(script[0]);
+    int failed = 0;
+    for (size_t i=0; i<num_frames; i++) {
+        const Golden_Frame * frame = &script[i];
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s.ppm", dir, frame->name);
+
+        if (play(&scenes[i], frame) != 0) {
+            printf("%-8s error\n", frame->name);
+            failed = 1;
+            continue;
+        }
+
+        for (size_t k=0; k<num_paths; k++) {
+            const char * name = path_names[paths[k]];
+            if (draw(&renderer, paths[k], &scenes[i]) != 0 ||
+                read_frame(&renderer, &actual) != 0) {
+                printf("%-8s %-8s error\n", frame->name, name);
+                failed = 1;
+                continue;
+            }
+
+            if (update && k == 0) {
+                int result = write_ppm(path, &actual);
+                printf("%-8s %-8s %s %s\n", frame->name, name,
+                       result == 0 ? "wrote" : "could not write", path);
+                failed |= result != 0;
+                continue;
+            }
+
+            Raster_Target expected = {0};
+            if (read_ppm(path, &expected) != 0) {
+                printf("%-8s %-8s missing %s\n", frame->name, name, path);
+                failed = 1;
+                continue;
+            }
+            size_t differ = compare(&expected, &actual, tolerance);
+            free(expected.pixels);
+            if (differ == 0) {
+                printf("%-8s %-8s ok\n", frame->name, name);
+                continue;
+            }
+
+            /* Keep what was drawn for a look next to what was expected. */
+            failed = 1;
+            char path_actual[4096 + 32];
+            snprintf(path_actual, sizeof(path_actual), "%s/%s.%s.actual.ppm",
+                     dir, frame->name, name);
+            write_ppm(path_actual, &actual);
+            printf("%-8s %-8s FAILED, %zu pixels differ, see %s\n",
+                   frame->name, name, differ, path_actual);
+        }
+    }
+
+    /* Time whole frames, from building the batch to pixels read back, over
+     * and over through the scenes of the script, along each path. */
+    for (size_t k=0; k<num_paths && num_bench > 0; k++) {
+        static Histogram times;
+        memset(&times, 0, sizeof(times));
+        for (uint64_t i=0; i<num_bench; i++) {
+            double time_start = time_now();
+            if (draw(&renderer, paths[k], &scenes[i % num_frames]) != 0 ||
+                read_frame(&renderer, &actual) != 0) {
+                failed = 1;
+                break;
+            }
+            histogram_add(&times, time_now() - time_start);
+        }
+        char label[64];
+        snprintf(label, sizeof(label), "frame time %s", path_names[paths[k]]);
+        histogram_print(&times, label, stdout);
+    }
+
+    for (size_t i=0; i<num_frames; i++) {
+        balls_free(&scenes[i].balls);
+    }
+    renderer_free(&renderer);
+    free(actual.pixels);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,646 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "sim.h"
+#include "balls.h"
+#include "collide.h"
+#include "batch.h"
+#include "replay.h"
+#include "timestep.h"
+#include "netplay.h"
+#include "scene.h"
+#include "raster.h"
+#include "ai.h"
+
+/* Headless driver: steps the simulation as fast as possible with no window,
+ * no GL context and no output until the run is over. Networked matches are
+ * the exception and run in real time. With --render or --dump frames are
+ * drawn by the software rasterizer, and with --dump written out as PPM. */
+
+
+/* Seconds without progress before giving up on the peer, and seconds to
+ * keep answering it after the match. */
+#define PEER_TIMEOUT 10.0
+#define PEER_LINGER 1.0
+
+
+static double time_now(void) {
+    /* Return a monotonic timestamp in seconds. */
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+
+static Sim_Input scripted_input(uint32_t * rng) {
+    /* Produce pseudo-random but reproducible input bits (xorshift32). */
+    uint32_t x = *rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *rng = x;
+    return x & (INPUT_RIGHT_UP | INPUT_RIGHT_DOWN |
+                INPUT_LEFT_UP | INPUT_LEFT_DOWN);
+}
+
+
+static Sim_Input game_input(uint32_t * rng, Ai * ais, const Sim_State * state) {
+    /* Scripted input, or the computer's for both paddles if 'ais'. */
+    if (ais) {
+        return ai_input(&ais[0], state) | ai_input(&ais[1], state);
+    }
+    return scripted_input(rng);
+}
+
+
+static uint32_t state_checksum(const Sim_State * state) {
+    /* FNV-1a over the positions, used to keep the loop from being optimized
+     * away and to compare runs. */
+    const unsigned char * bytes = (const unsigned char *)state->positions;
+    uint32_t hash = 2166136261u;
+    for (size_t i=0; i<sizeof(state->positions); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+
+static int run_games(const Sim_State * initial, uint64_t num_ticks, size_t num_games) {
+    /* Step 'num_games' independent games in lockstep, each with its own
+     * scripted input, and report the aggregate rate. */
+
+    Batch_State batch;
+    Sim_Input * inputs = malloc(num_games*sizeof(*inputs));
+    uint32_t * rngs = malloc(num_games*sizeof(*rngs));
+    if (!inputs || !rngs || batch_init(&batch, num_games, initial) != 0) {
+        fprintf(stderr, "Could not allocate %zu games.\n", num_games);
+        return EXIT_FAILURE;
+    }
+    for (size_t g=0; g<num_games; g++) {
+        rngs[g] = 0x9e3779b9u + (uint32_t)g;
+    }
+
+    double time_start = time_now();
+    for (uint64_t i=0; i<num_ticks; i++) {
+        for (size_t g=0; g<num_games; g++) {
+            inputs[g] = scripted_input(&rngs[g]);
+        }
+        batch_step(&batch, inputs);
+    }
+    double time_elapsed = time_now() - time_start;
+
+    /* Fold every game into one checksum. */
+    uint32_t checksum = 0;
+    Sim_State state;
+    for (size_t g=0; g<num_games; g++) {
+        batch_get(&batch, g, &state);
+        checksum = checksum*31 + state_checksum(&state);
+    }
+
+    double game_ticks = (double)batch.tick*num_games;
+    printf("ticks: %llu\n", (unsigned long long)batch.tick);
+    printf("games: %zu\n", num_games);
+    printf("seconds: %f\n", time_elapsed);
+    printf("game ticks/s: %.0f\n", game_ticks/time_elapsed);
+    printf("checksum: %08x\n", checksum);
+
+    batch_free(&batch);
+    free(rngs);
+    free(inputs);
+    return EXIT_SUCCESS;
+}
+
+
+static int run_replay(const char * path, uint64_t seek) {
+    /* Play a recorded match back as fast as possible, optionally starting
+     * at tick 'seek'. */
+
+    Replay replay;
+    if (replay_open(&replay, path) != 0) {
+        fprintf(stderr, "Could not open replay %s.\n", path);
+        return EXIT_FAILURE;
+    }
+
+    Sim_State sim;
+    Replay_Cursor cursor;
+    double time_start = time_now();
+    if (replay_seek(&replay, &cursor, seek, &sim) != 0) {
+        fprintf(stderr, "Could not seek to tick %llu.\n", (unsigned long long)seek);
+        replay_close(&replay);
+        return EXIT_FAILURE;
+    }
+    double time_seek = time_now() - time_start;
+
+    Sim_Input input;
+    while (replay_next(&cursor, &input)) {
+        sim_step(&sim, input);
+    }
+    double time_elapsed = time_now() - time_start;
+
+    const Replay_Header * header = replay.header;
+    uint64_t played = header->num_ticks - seek;
+    printf("ticks: %llu\n", (unsigned long long)header->num_ticks);
+    printf("bytes: %zu\n", replay.size);
+    if (header->num_ticks > 0) {
+        printf("input bytes/tick: %.3f\n", (double)header->runs_size/header->num_ticks);
+    }
+    printf("seek ms: %.3f\n", time_seek*1e3);
+    printf("seconds: %f\n", time_elapsed);
+    printf("ticks/s: %.0f\n", played/time_elapsed);
+    printf("realtime factor: %.0f\n", played/time_elapsed/sim.tick_rate);
+    printf("score: %u:%u\n", sim.score[ID_PADDLE_LEFT], sim.score[ID_PADDLE_RIGHT]);
+    printf("checksum: %08x\n", state_checksum(&sim));
+
+    replay_close(&replay);
+    return EXIT_SUCCESS;
+}
+
+
+static void sleep_seconds(double seconds) {
+    struct timespec ts = {
+        .tv_sec = (time_t)seconds,
+        .tv_nsec = (long)((seconds - (time_t)seconds)*1e9),
+    };
+    nanosleep(&ts, NULL);
+}
+
+
+static int run_netplay(const Sim_State * initial, uint64_t num_ticks,
+                       const Netplay_Config * config) {
+    /* Play one side of a networked match in real time, with scripted input
+     * for the local paddle, and report how the rollback went. Run a host
+     * and a joining process next to each other: the final checksums must
+     * match. */
+
+    Netplay netplay;
+    if (netplay_open(&netplay, config, initial) != 0) {
+        fprintf(stderr, "Could not open the connection.\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Wait for the peer. */
+    int status;
+    double time_start = time_now();
+    while ((status = netplay_connect(&netplay, time_now())) == 0) {
+        if (time_now() - time_start > PEER_TIMEOUT) {
+            fprintf(stderr, "No peer showed up.\n");
+            netplay_close(&netplay);
+            return EXIT_FAILURE;
+        }
+        sleep_seconds(0.001);
+    }
+    if (status < 0) {
+        fprintf(stderr, "The peer plays with other settings.\n");
+        netplay_close(&netplay);
+        return EXIT_FAILURE;
+    }
+
+    /* Hold keys for a while like a player would, rather than changing them
+     * every tick, so that most predictions hold. */
+    uint32_t rng = netplay.hosting ? 0x9e3779b9u : 0x7f4a7c15u;
+    Sim_Input input = 0;
+
+    Rollback_Session * session = &netplay.session;
+    Timestep timestep;
+    time_start = time_now();
+    timestep_init(&timestep, initial->tick_rate, time_start);
+    double time_progress = time_start;
+    uint64_t confirmed = 0;
+
+    /* Play until both sides have every input of the match. */
+    while (session->tick < num_ticks || netplay_confirmed(&netplay) < num_ticks) {
+        double now = time_now();
+        netplay_poll(&netplay, now);
+
+        int ticks = timestep_advance(&timestep, now);
+        for (int i=0; i<ticks && session->tick < num_ticks; i++) {
+            if (netplay_tick(&netplay, input, now)) {
+                Sim_Input next = scripted_input(&rng);
+                if ((rng >> 16 & 15) == 0) {
+                    input = next;
+                }
+            }
+        }
+
+        if (netplay_confirmed(&netplay) > confirmed) {
+            confirmed = netplay_confirmed(&netplay);
+            time_progress = now;
+        } else if (now - time_progress > PEER_TIMEOUT) {
+            fprintf(stderr, "Lost the peer at tick %llu.\n",
+                    (unsigned long long)session->tick);
+            netplay_close(&netplay);
+            return EXIT_FAILURE;
+        }
+        sleep_seconds(0.001);
+    }
+    double time_elapsed = time_now() - time_start;
+
+    /* Stay a little longer so the peer learns that we have its inputs. */
+    double time_end = time_now();
+    while (time_now() - time_end < PEER_LINGER) {
+        netplay_poll(&netplay, time_now());
+        sleep_seconds(0.001);
+    }
+
+    rollback_correct(session);
+    const Sim_State * sim = rollback_final_state(session, num_ticks);
+    const Rollback_Stats * stats = &session->stats;
+    const Net_Stats * net_stats = &netplay.net.stats;
+    printf("role: %s\n", netplay.hosting ? "host" : "join");
+    printf("ticks: %llu\n", (unsigned long long)session->tick);
+    printf("seconds: %f\n", time_elapsed);
+    printf("rtt ms: %.1f\n", netplay.rtt*1e3);
+    printf("rollbacks: %llu\n", (unsigned long long)stats->rollbacks);
+    printf("ticks resimulated: %llu\n", (unsigned long long)stats->ticks_resimulated);
+    printf("max rollback: %llu\n", (unsigned long long)stats->max_depth);
+    printf("stalls: %llu\n", (unsigned long long)stats->stalls);
+    printf("ticks skipped: %llu\n", (unsigned long long)netplay.stats.ticks_skipped);
+    printf("packets sent: %llu\n", (unsigned long long)net_stats->sent);
+    printf("packets received: %llu\n", (unsigned long long)net_stats->received);
+    printf("packets dropped: %llu\n", (unsigned long long)net_stats->dropped);
+    printf("syncs checked: %llu\n", (unsigned long long)netplay.stats.syncs_checked);
+    printf("desyncs: %llu\n", (unsigned long long)netplay.stats.desyncs);
+    printf("score: %u:%u\n", sim->score[ID_PADDLE_LEFT], sim->score[ID_PADDLE_RIGHT]);
+    printf("checksum: %08x\n", state_checksum(sim));
+
+    netplay_close(&netplay);
+    return netplay.stats.desyncs == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+typedef struct Render_Config {
+    const char * prefix; /* Frames go to prefix000000.ppm on, if set. */
+    uint64_t every; /* Ticks per frame. */
+    int width;
+    int height;
+    int num_threads;
+} Render_Config;
+
+
+static int run_render(const Sim_State * initial, uint64_t num_ticks, size_t num_balls,
+                      const Render_Config * config) {
+    /* Step one game with scripted input, drawing a frame of it every
+     * config->every ticks, and report how quickly frames were drawn. */
+
+    Sim_State sim = *initial;
+    Data_Environment env = sim.env;
+    uint32_t rng = 0x9e3779b9u;
+
+    Ball_Store balls = {0};
+    Collide_Grid grid = {0};
+    Collide_Box paddles[2];
+    if (num_balls > 0) {
+        if (balls_init(&balls, num_balls) != 0 ||
+            collide_grid_init_arena(&grid, &sim, balls.capacity) != 0) {
+            fprintf(stderr, "Could not allocate %zu balls.\n", num_balls);
+            return EXIT_FAILURE;
+        }
+        balls_spawn(&balls, num_balls, &sim, 1);
+    }
+
+    Display displays[2];
+    Display * display_list[2] = {&displays[0], &displays[1]};
+    scene_displays(&displays[0], &displays[1], sim.items, &env);
+    static float cells[DISPLAY_MAX_CELLS][2];
+
+    size_t capacity = 3 + num_balls + 2*DISPLAY_MAX_CELLS;
+    float * vertices = malloc(capacity*SPRITE_FLOATS*sizeof(float));
+    Raster raster;
+    if (!vertices ||
+        raster_init(&raster, config->width, config->height, config->num_threads) != 0) {
+        fprintf(stderr, "Could not allocate a %dx%d framebuffer.\n",
+                config->width, config->height);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t frames = 0;
+    double time_render = 0.0;
+    double time_write = 0.0;
+    int result = EXIT_SUCCESS;
+    double time_start = time_now();
+    for (uint64_t i=0; i<num_ticks && result == EXIT_SUCCESS; i++) {
+        sim_step(&sim, scripted_input(&rng));
+        if (num_balls > 0) {
+            balls_step(&balls);
+            size_t num_paddles = collide_paddles(&sim, paddles);
+            collide_balls(&grid, &balls, paddles, num_paddles, NULL);
+        }
+        if ((i+1) % config->every != 0) {
+            continue;
+        }
+
+        /* Draw the frame. */
+        double time_frame = time_now();
+        display_set(&displays[0], sim.score[ID_PADDLE_RIGHT]);
+        display_set(&displays[1], sim.score[ID_PADDLE_LEFT]);
+        v3 positions[ID_NUM];
+        for (size_t id=0; id<ID_NUM; id++) {
+            positions[id] = sim_to_ndc(&env, sim.positions[id]);
+        }
+        Sprite_Batch batch;
+        sprite_batch_begin(&batch, vertices, capacity);
+        scene_sprites(&batch, &sim, positions, num_balls > 0 ? &balls : NULL,
+                      display_list, 2, cells);
+        raster_draw(&raster, &batch, 0xff000000, 0xffffffff);
+        double time_drawn = time_now();
+        time_render += time_drawn - time_frame;
+
+        /* Write it out. */
+        if (config->prefix) {
+            char path[4096];
+            snprintf(path, sizeof(path), "%s%06llu.ppm", config->prefix,
+                     (unsigned long long)frames);
+            FILE * file = fopen(path, "wb");
+            if (!file || raster_write_ppm(&raster.target, file) != 0) {
+                fprintf(stderr, "Could not write %s.\n", path);
+                result = EXIT_FAILURE;
+            }
+            if (file && fclose(file) != 0) {
+                fprintf(stderr, "Could not write %s.\n", path);
+                result = EXIT_FAILURE;
+            }
+            time_write += time_now() - time_drawn;
+        }
+        frames++;
+    }
+    double time_elapsed = time_now() - time_start;
+
+    printf("ticks: %llu\n", (unsigned long long)sim.tick);
+    printf("frames: %llu\n", (unsigned long long)frames);
+    printf("size: %dx%d\n", config->width, config->height);
+    printf("threads: %d\n", raster.num_workers + 1);
+    printf("seconds: %f\n", time_elapsed);
+    if (frames > 0) {
+        printf("render ms/frame: %.3f\n", time_render*1e3/frames);
+        printf("render frames/s: %.0f\n", frames/time_render);
+        if (config->prefix) {
+            printf("write ms/frame: %.3f\n", time_write*1e3/frames);
+        }
+    }
+    printf("checksum: %08x\n", state_checksum(&sim));
+
+    raster_free(&raster);
+    free(vertices);
+    if (num_balls > 0) {
+        collide_grid_free(&grid);
+        balls_free(&balls);
+    }
+    return result;
+}
+
+
+static void usage(const char * name) {
+    fprintf(stderr, "usage: %s [--ticks n] [--tick-rate hz] [--balls n] [--games n]\n"
+                    "       [--record path] [--replay path [--seek tick]]\n"
+                    "       [--host port | --join host:port] [--input-delay ticks]\n"
+                    "       [--net-delay ms] [--net-jitter ms] [--net-loss percent]\n"
+                    "       [--render | --dump prefix] [--every ticks] [--size wxh]\n"
+                    "       [--threads n] [--ai] [--ai-reaction ms] [--ai-error pixels]\n",
+            name);
+    exit(EXIT_FAILURE);
+}
+
+
+int main(int argc, char ** argv) {
+
+    /* Number of ticks to simulate, ticks per simulated second, number of
+     * extra balls for the multi-ball stress mode and number of independent
+     * games for the batched mode. */
+    uint64_t num_ticks = 10000000;
+    int tick_rate = SIM_BASE_TICK_RATE;
+    size_t num_balls = 0;
+    size_t num_games = 0;
+    const char * path_record = NULL;
+    const char * path_replay = NULL;
+    uint64_t seek = 0;
+
+    /* Networked match, hosted on a port or joined at an address, and the
+     * link conditions to simulate. Ten seconds long unless --ticks says
+     * otherwise. */
+    Netplay_Config netplay = {0};
+    char join_host[256];
+    int networked = 0;
+    int ticks_given = 0;
+
+    /* Frames drawn in software, and written out if there is a prefix. */
+    Render_Config render = {
+        .every = 1,
+        .width = 800,
+        .height = 600,
+        .num_threads = 1,
+    };
+    int rendering = 0;
+
+    /* The computer plays both paddles instead of the scripted input,
+     * reacting in 'ai_reaction' milliseconds and aiming within 'ai_error'
+     * pixels. */
+    int ai = 0;
+    int ai_reaction = 150;
+    int ai_error = 30;
+
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "--render") == 0) {
+            rendering = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--ai") == 0) {
+            ai = 1;
+            continue;
+        }
+        if (i+1 >= argc) {
+            usage(argv[0]);
+        }
+        if (strcmp(argv[i], "--ticks") == 0) {
+            num_ticks = strtoull(argv[++i], NULL, 10);
+            ticks_given = 1;
+        } else if (strcmp(argv[i], "--tick-rate") == 0) {
+            tick_rate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--balls") == 0) {
+            num_balls = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--games") == 0) {
+            num_games = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--record") == 0) {
+            path_record = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0) {
+            path_replay = argv[++i];
+        } else if (strcmp(argv[i], "--seek") == 0) {
+            seek = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--host") == 0) {
+            netplay.port = atoi(argv[++i]);
+            networked = 1;
+        } else if (strcmp(argv[i], "--join") == 0) {
+            if (net_parse_address(argv[++i], join_host, sizeof(join_host),
+                                  &netplay.port) != 0) {
+                usage(argv[0]);
+            }
+            netplay.host = join_host;
+            networked = 1;
+        } else if (strcmp(argv[i], "--input-delay") == 0) {
+            netplay.input_delay = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--net-delay") == 0) {
+            netplay.conditions.delay = atof(argv[++i])/1000.0;
+        } else if (strcmp(argv[i], "--net-jitter") == 0) {
+            netplay.conditions.jitter = atof(argv[++i])/1000.0;
+        } else if (strcmp(argv[i], "--net-loss") == 0) {
+            netplay.conditions.loss = atof(argv[++i])/100.0;
+        } else if (strcmp(argv[i], "--dump") == 0) {
+            render.prefix = argv[++i];
+            rendering = 1;
+        } else if (strcmp(argv[i], "--every") == 0) {
+            render.every = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--size") == 0) {
+            if (sscanf(argv[++i], "%dx%d", &render.width, &render.height) != 2) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            render.num_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ai-reaction") == 0) {
+            ai_reaction = atoi(argv[++i]);
+            ai = 1;
+        } else if (strcmp(argv[i], "--ai-error") == 0) {
+            ai_error = atoi(argv[++i]);
+            ai = 1;
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (tick_rate <= 0 || render.every == 0 || render.width <= 0 ||
+        render.height <= 0 || render.num_threads < 1 || ai_reaction < 0 || ai_error < 0) {
+        usage(argv[0]);
+    }
+
+    /* Only the single game loop records, with or without extra balls. */
+    if (path_record && (num_games > 0 || rendering || networked || path_replay)) {
+        fprintf(stderr, "--record does not go with --games, --render, --dump, "
+                        "--host, --join or --replay.\n");
+        return EXIT_FAILURE;
+    }
+
+    /* The computer plays in the single game loop only, and like the game
+     * not in a networked match. */
+    if (ai && (num_games > 0 || rendering || networked || path_replay)) {
+        fprintf(stderr, "--ai does not go with --games, --render, --dump, "
+                        "--host, --join or --replay.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (path_replay) {
+        return run_replay(path_replay, seek);
+    }
+
+    Sim_State sim;
+    sim_init(&sim, 800, 600);
+    sim_set_tick_rate(&sim, tick_rate);
+
+    if (networked) {
+        if (!ticks_given) {
+            num_ticks = 10*(uint64_t)tick_rate;
+        }
+        return run_netplay(&sim, num_ticks, &netplay);
+    }
+
+    if (num_games > 0) {
+        return run_games(&sim, num_ticks, num_games);
+    }
+
+    if (rendering) {
+        if (!ticks_given) {
+            num_ticks = 10*(uint64_t)tick_rate;
+        }
+        return run_render(&sim, num_ticks, num_balls, &render);
+    }
+
+    /* Set up the multi-ball store and its collision grid. */
+    Ball_Store balls = {0};
+    Collide_Grid grid = {0};
+    Collide_Stats stats = {0};
+    Collide_Box paddles[2];
+    if (num_balls > 0) {
+        if (balls_init(&balls, num_balls) != 0 ||
+            collide_grid_init_arena(&grid, &sim, balls.capacity) != 0) {
+            fprintf(stderr, "Could not allocate %zu balls.\n", num_balls);
+            return EXIT_FAILURE;
+        }
+        balls_spawn(&balls, num_balls, &sim, 1);
+    }
+
+    /* Record the match if asked to. The writer is large for its buffer. */
+    Replay_Writer * writer = NULL;
+    if (path_record) {
+        writer = malloc(sizeof(*writer));
+        if (!writer || replay_writer_open(writer, path_record, &sim, 0) != 0) {
+            fprintf(stderr, "Could not record to %s.\n", path_record);
+            return EXIT_FAILURE;
+        }
+    }
+
+    uint32_t rng = 0x9e3779b9u;
+
+    Ai ais[2];
+    for (int i=0; i<2; i++) {
+        Ai_Config config = {
+            .paddle = i == 0 ? ID_PADDLE_RIGHT : ID_PADDLE_LEFT,
+            .reaction_ticks = (uint32_t)((int64_t)ai_reaction*tick_rate/1000),
+            .error = ai_error,
+            .seed = 1 + i,
+        };
+        ai_init(&ais[i], &config);
+    }
+    Ai * players = ai ? ais : NULL;
+
+    double time_start = time_now();
+    if (num_balls > 0) {
+        for (uint64_t i=0; i<num_ticks; i++) {
+            Sim_Input input = game_input(&rng, players, &sim);
+            if (writer) {
+                replay_writer_tick(writer, &sim, input);
+            }
+            sim_step(&sim, input);
+            balls_step(&balls);
+            size_t num_paddles = collide_paddles(&sim, paddles);
+            collide_balls(&grid, &balls, paddles, num_paddles, &stats);
+        }
+    } else if (writer) {
+        for (uint64_t i=0; i<num_ticks; i++) {
+            Sim_Input input = game_input(&rng, players, &sim);
+            replay_writer_tick(writer, &sim, input);
+            sim_step(&sim, input);
+        }
+    } else {
+        for (uint64_t i=0; i<num_ticks; i++) {
+            sim_step(&sim, game_input(&rng, players, &sim));
+        }
+    }
+    double time_elapsed = time_now() - time_start;
+
+    if (writer) {
+        if (replay_writer_close(writer) != 0) {
+            fprintf(stderr, "Could not write %s.\n", path_record);
+            return EXIT_FAILURE;
+        }
+        free(writer);
+    }
+
+    printf("ticks: %llu\n", (unsigned long long)sim.tick);
+    printf("seconds: %f\n", time_elapsed);
+    printf("ticks/s: %.0f\n", sim.tick/time_elapsed);
+    if (ai) {
+        printf("score: %u - %u\n", sim.score[ID_PADDLE_LEFT], sim.score[ID_PADDLE_RIGHT]);
+        printf("predictions: %llu\n",
+               (unsigned long long)(ais[0].predictions + ais[1].predictions));
+    }
+    if (num_balls > 0) {
+        printf("balls: %zu\n", balls.count);
+        printf("ball updates/s: %.0f\n", sim.tick*(double)balls.count/time_elapsed);
+        printf("pairs tested/tick: %.1f\n", (double)stats.pairs_tested/sim.tick);
+        printf("contacts/tick: %.1f\n", (double)stats.contacts/sim.tick);
+        collide_grid_free(&grid);
+        balls_free(&balls);
+    }
+    printf("checksum: %08x\n", state_checksum(&sim));
+
+    return EXIT_SUCCESS;
+}
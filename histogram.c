@@ -0,0 +1,111 @@
+#include "histogram.h"
+
+
+/* Width of the bars printed for the most common row. */
+#define BAR_WIDTH 40
+
+
+static unsigned int bucket_of(uint64_t us) {
+    /* Index of the bucket holding 'us' microseconds. */
+    if (us < HISTOGRAM_SUB_BUCKETS) {
+        return us;
+    }
+    if (us >> 32) {
+        return HISTOGRAM_BUCKETS - 1;
+    }
+    int shift = 63 - __builtin_clzll(us) - HISTOGRAM_SUB_BITS;
+    return (shift + 1)*HISTOGRAM_SUB_BUCKETS + ((us >> shift) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+
+static uint64_t bucket_start(unsigned int bucket) {
+    /* Smallest value in microseconds that falls into 'bucket'. */
+    if (bucket < HISTOGRAM_SUB_BUCKETS) {
+        return bucket;
+    }
+    int shift = bucket/HISTOGRAM_SUB_BUCKETS - 1;
+    return (uint64_t)(HISTOGRAM_SUB_BUCKETS + bucket % HISTOGRAM_SUB_BUCKETS) << shift;
+}
+
+
+void histogram_add(Histogram * histogram, double seconds) {
+    if (seconds < 0.0) {
+        seconds = 0.0;
+    }
+    histogram->counts[bucket_of((uint64_t)(seconds*1e6))]++;
+    histogram->count++;
+    histogram->sum += seconds;
+    if (seconds > histogram->max) {
+        histogram->max = seconds;
+    }
+}
+
+
+double histogram_percentile(const Histogram * histogram, double fraction) {
+    /* Value in seconds below which 'fraction' of the values fall, taken
+     * as the middle of its bucket. */
+
+    if (histogram->count == 0) {
+        return 0.0;
+    }
+    uint64_t rank = (uint64_t)(fraction*histogram->count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (unsigned int b=0; b<HISTOGRAM_BUCKETS; b++) {
+        seen += histogram->counts[b];
+        if (seen >= rank) {
+            double start = bucket_start(b);
+            double end = b+1 < HISTOGRAM_BUCKETS ? bucket_start(b+1) : start;
+            double middle = (start + end)/2*1e-6;
+            return middle < histogram->max ? middle : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+
+void histogram_print(const Histogram * histogram, const char * name, FILE * file) {
+    /* Write a summary line and one bar per power of two that holds any
+     * values. */
+
+    fprintf(file, "%s: n %llu", name, (unsigned long long)histogram->count);
+    if (histogram->count == 0) {
+        fprintf(file, "\n");
+        return;
+    }
+    fprintf(file, " mean %.3f p50 %.3f p90 %.3f p99 %.3f p99.9 %.3f max %.3f ms\n",
+            histogram->sum/histogram->count*1e3,
+            histogram_percentile(histogram, 0.5)*1e3,
+            histogram_percentile(histogram, 0.9)*1e3,
+            histogram_percentile(histogram, 0.99)*1e3,
+            histogram_percentile(histogram, 0.999)*1e3,
+            histogram->max*1e3);
+
+    /* Rows of whole powers of two, the first one holding everything below
+     * HISTOGRAM_SUB_BUCKETS us. */
+    uint64_t rows[HISTOGRAM_BUCKETS/HISTOGRAM_SUB_BUCKETS] = {0};
+    uint64_t row_max = 0;
+    for (unsigned int b=0; b<HISTOGRAM_BUCKETS; b++) {
+        uint64_t * row = &rows[b/HISTOGRAM_SUB_BUCKETS];
+        *row += histogram->counts[b];
+        if (*row > row_max) {
+            row_max = *row;
+        }
+    }
+
+    unsigned int num_rows = HISTOGRAM_BUCKETS/HISTOGRAM_SUB_BUCKETS;
+    for (unsigned int r=0; r<num_rows; r++) {
+        if (rows[r] == 0) {
+            continue;
+        }
+        double start = bucket_start(r*HISTOGRAM_SUB_BUCKETS)*1e-3;
+        double end = r+1 < num_rows ? bucket_start((r+1)*HISTOGRAM_SUB_BUCKETS)*1e-3 : start;
+        int bar = (int)((rows[r]*BAR_WIDTH + row_max-1)/row_max);
+        fprintf(file, "  %9.3f - %9.3f ms %10llu %.*s\n", start, end,
+                (unsigned long long)rows[r], bar,
+                "########################################");
+    }
+}
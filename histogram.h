@@ -0,0 +1,32 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Fixed-size histogram of durations. Every power of two of microseconds is
+ * split into HISTOGRAM_SUB_BUCKETS equal buckets, so values from 1 us to
+ * over an hour are kept to within about 6% without allocating, and adding
+ * a value is a few instructions. */
+
+
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+
+/* Enough buckets for values below 2^32 us. */
+#define HISTOGRAM_BUCKETS ((32 - HISTOGRAM_SUB_BITS + 1)*HISTOGRAM_SUB_BUCKETS)
+
+
+typedef struct Histogram {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t count;
+    double sum; /* Seconds. */
+    double max;
+} Histogram;
+
+
+void histogram_add(Histogram * histogram, double seconds);
+double histogram_percentile(const Histogram * histogram, double fraction);
+void histogram_print(const Histogram * histogram, const char * name, FILE * file);
+
+#endif
@@ -0,0 +1,74 @@
+#include "input.h"
+
+
+// ================================================================
+// == Event queue.
+// ================================================================
+
+int input_queue_push(Input_Queue * queue, Input_Event event) {
+    /* Producer only. Returns 0 on success, -1 if the queue is full and the
+     * event was dropped. */
+
+    size_t slot;
+    if (spsc_reserve(&queue->ring, INPUT_QUEUE_SIZE, &slot) != 0) {
+        return -1;
+    }
+    queue->events[slot] = event;
+    spsc_publish(&queue->ring);
+    return 0;
+}
+
+
+int input_queue_peek(Input_Queue * queue, Input_Event * event) {
+    /* Consumer only. Copy the oldest event to 'event' without taking it.
+     * Returns 0 if the queue is empty. */
+
+    size_t slot;
+    if (!spsc_front(&queue->ring, INPUT_QUEUE_SIZE, &slot)) {
+        return 0;
+    }
+    *event = queue->events[slot];
+    return 1;
+}
+
+
+void input_queue_pop(Input_Queue * queue) {
+    /* Consumer only. Take the event last seen by input_queue_peek. */
+    spsc_release(&queue->ring);
+}
+
+
+// ================================================================
+// == Latency.
+// ================================================================
+
+void input_latency_applied(Input_Latency * latency, double time_input, double time_tick) {
+    /* Note that the event of 'time_input' was applied by the tick run at
+     * 'time_tick'. */
+
+    histogram_add(&latency->input_to_tick, time_tick - time_input);
+    if (latency->num_pending < INPUT_LATENCY_PENDING) {
+        latency->pending_input[latency->num_pending] = time_input;
+        latency->pending_tick[latency->num_pending] = time_tick;
+        latency->num_pending++;
+    }
+}
+
+
+void input_latency_swapped(Input_Latency * latency, double time_swap) {
+    /* Note that the buffer swap returned at 'time_swap', showing every
+     * event applied since the last one. */
+
+    for (size_t i=0; i<latency->num_pending; i++) {
+        histogram_add(&latency->tick_to_swap, time_swap - latency->pending_tick[i]);
+        histogram_add(&latency->input_to_swap, time_swap - latency->pending_input[i]);
+    }
+    latency->num_pending = 0;
+}
+
+
+void input_latency_print(const Input_Latency * latency, FILE * file) {
+    histogram_print(&latency->input_to_tick, "input to tick", file);
+    histogram_print(&latency->tick_to_swap, "tick to swap", file);
+    histogram_print(&latency->input_to_swap, "input to swap", file);
+}
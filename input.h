@@ -0,0 +1,58 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "histogram.h"
+#include "spsc.h"
+
+/* Timestamped key events, passed from the key callback to the simulation
+ * ticks through a lock-free single producer, single consumer queue. Each
+ * tick applies the events up to its own time, so presses and releases
+ * within one frame keep their order and none are lost.
+ *
+ * Input_Latency follows the events that steer a paddle from their
+ * timestamp to the tick that applied them and on to the buffer swap that
+ * showed that tick, and keeps a histogram of each step. */
+
+
+/* Events the queue holds, a power of two. */
+#define INPUT_QUEUE_SIZE 256
+
+/* Applied events waiting for the next swap, further ones are not timed. */
+#define INPUT_LATENCY_PENDING 64
+
+
+typedef struct Input_Event {
+    double time; /* Seconds, on the clock of the main loop. */
+    int key;
+    int pressed;
+} Input_Event;
+
+
+typedef struct Input_Queue {
+    Spsc_Ring ring;
+    Input_Event events[INPUT_QUEUE_SIZE];
+} Input_Queue;
+
+
+typedef struct Input_Latency {
+    Histogram input_to_tick;
+    Histogram tick_to_swap;
+    Histogram input_to_swap;
+    double pending_input[INPUT_LATENCY_PENDING];
+    double pending_tick[INPUT_LATENCY_PENDING];
+    size_t num_pending;
+} Input_Latency;
+
+
+int input_queue_push(Input_Queue * queue, Input_Event event);
+int input_queue_peek(Input_Queue * queue, Input_Event * event);
+void input_queue_pop(Input_Queue * queue);
+
+void input_latency_applied(Input_Latency * latency, double time_input, double time_tick);
+void input_latency_swapped(Input_Latency * latency, double time_swap);
+void input_latency_print(const Input_Latency * latency, FILE * file);
+
+#endif
@@ -0,0 +1,192 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "net.h"
+
+
+int net_open(Net_Socket * net, int port, const Net_Conditions * conditions) {
+    /* Open a socket on 'port', or any free port if 0, sending under
+     * 'conditions' if given. Returns 0 on success. */
+
+    memset(net, 0, sizeof(*net));
+    net->fd = -1;
+    net->rng = 0x2545f491u ^ (uint32_t)getpid();
+    if (conditions) {
+        net->conditions = *conditions;
+    }
+
+    net->queue = malloc(NET_QUEUE_SIZE*sizeof(*net->queue));
+    if (!net->queue) {
+        return -1;
+    }
+
+    net->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (net->fd < 0) {
+        net_close(net);
+        return -1;
+    }
+
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    int flags = fcntl(net->fd, F_GETFL, 0);
+    if (bind(net->fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        flags < 0 || fcntl(net->fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+        net_close(net);
+        return -1;
+    }
+    return 0;
+}
+
+
+int net_set_peer(Net_Socket * net, const char * host, int port) {
+    /* Send to and receive from 'host':'port' only. Returns 0 on success. */
+
+    struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_DGRAM,
+    };
+    struct addrinfo * result;
+    if (getaddrinfo(host, NULL, &hints, &result) != 0) {
+        return -1;
+    }
+    memcpy(&net->peer, result->ai_addr, sizeof(net->peer));
+    net->peer.sin_port = htons(port);
+    net->has_peer = 1;
+    freeaddrinfo(result);
+    return 0;
+}
+
+
+int net_parse_address(const char * text, char * host, size_t capacity, int * port) {
+    /* Split "host:port" into its parts. Returns 0 on success. */
+
+    const char * colon = strrchr(text, ':');
+    if (!colon || (size_t)(colon - text) >= capacity) {
+        return -1;
+    }
+    memcpy(host, text, colon - text);
+    host[colon - text] = '\0';
+
+    char * end;
+    long number = strtol(colon + 1, &end, 10);
+    if (*end != '\0' || number <= 0 || number > 65535) {
+        return -1;
+    }
+    *port = number;
+    return 0;
+}
+
+
+static double next_random(Net_Socket * net) {
+    /* xorshift32, scaled to [0, 1). */
+    uint32_t x = net->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    net->rng = x;
+    return x/4294967296.0;
+}
+
+
+static void send_now(Net_Socket * net, const void * data, size_t size) {
+    /* Hand a datagram to the kernel. A full socket buffer loses it, like
+     * the network would. */
+    if (sendto(net->fd, data, size, 0, (struct sockaddr *)&net->peer,
+               sizeof(net->peer)) == (ssize_t)size) {
+        net->stats.sent++;
+    } else {
+        net->stats.dropped++;
+    }
+}
+
+
+int net_send(Net_Socket * net, const void * data, size_t size, double time_now) {
+    /* Send a datagram to the peer, through the artificial conditions.
+     * Returns 0 if it was sent or queued, even if it is then lost, and -1
+     * if there is no peer yet or it is too large. */
+
+    if (!net->has_peer || size > NET_MAX_PACKET) {
+        return -1;
+    }
+
+    const Net_Conditions * conditions = &net->conditions;
+    if (conditions->loss > 0.0 && next_random(net) < conditions->loss) {
+        net->stats.dropped++;
+        return 0;
+    }
+    if (conditions->delay <= 0.0 && conditions->jitter <= 0.0) {
+        send_now(net, data, size);
+        return 0;
+    }
+    if (net->queue_count == NET_QUEUE_SIZE) {
+        net->stats.dropped++;
+        return 0;
+    }
+
+    Net_Delayed * delayed = &net->queue[net->queue_count++];
+    delayed->time_release = time_now + conditions->delay +
+                            conditions->jitter*next_random(net);
+    delayed->size = size;
+    memcpy(delayed->data, data, size);
+    return 0;
+}
+
+
+void net_flush(Net_Socket * net, double time_now) {
+    /* Send the held back datagrams that are due. */
+    size_t i = 0;
+    while (i < net->queue_count) {
+        Net_Delayed * delayed = &net->queue[i];
+        if (delayed->time_release <= time_now) {
+            send_now(net, delayed->data, delayed->size);
+            *delayed = net->queue[--net->queue_count];
+        } else {
+            i++;
+        }
+    }
+}
+
+
+size_t net_receive(Net_Socket * net, void * data, size_t capacity) {
+    /* Read the next datagram from the peer into 'data'. Returns its size,
+     * or 0 if none is waiting. Datagrams from anyone else are skipped. */
+
+    for (;;) {
+        struct sockaddr_in sender;
+        socklen_t sender_size = sizeof(sender);
+        ssize_t size = recvfrom(net->fd, data, capacity, 0,
+                                (struct sockaddr *)&sender, &sender_size);
+        if (size <= 0) {
+            return 0;
+        }
+        if (!net->has_peer) {
+            net->peer = sender;
+            net->has_peer = 1;
+        } else if (sender.sin_addr.s_addr != net->peer.sin_addr.s_addr ||
+                   sender.sin_port != net->peer.sin_port) {
+            continue;
+        }
+        net->stats.received++;
+        return size;
+    }
+}
+
+
+void net_close(Net_Socket * net) {
+    if (net->fd >= 0) {
+        close(net->fd);
+    }
+    free(net->queue);
+    net->fd = -1;
+    net->queue = NULL;
+    net->queue_count = 0;
+}
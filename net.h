@@ -0,0 +1,63 @@
+#ifndef NET_H
+#define NET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+/* Non-blocking UDP socket talking to a single peer. Outgoing datagrams can
+ * be held back and dropped on purpose to try out bad connections on one
+ * machine: with a delay of 40 ms set on both ends, two processes on
+ * loopback see a round trip of 80 ms. */
+
+
+/* Largest datagram sent or received. */
+#define NET_MAX_PACKET 512
+
+/* Datagrams that can be held back at once, further ones are dropped. */
+#define NET_QUEUE_SIZE 256
+
+
+/* Artificial link conditions for outgoing datagrams. */
+typedef struct Net_Conditions {
+    double delay; /* Seconds each datagram is held back. */
+    double jitter; /* Up to this many seconds added at random. */
+    double loss; /* Fraction of datagrams dropped, 0 to 1. */
+} Net_Conditions;
+
+
+typedef struct Net_Delayed {
+    double time_release;
+    size_t size;
+    unsigned char data[NET_MAX_PACKET];
+} Net_Delayed;
+
+
+typedef struct Net_Stats {
+    uint64_t sent;
+    uint64_t received;
+    uint64_t dropped; /* By the artificial loss or a full queue. */
+} Net_Stats;
+
+
+typedef struct Net_Socket {
+    int fd;
+    struct sockaddr_in peer;
+    int has_peer; /* Otherwise the first sender becomes the peer. */
+    Net_Conditions conditions;
+    uint32_t rng;
+    Net_Delayed * queue; /* Unordered, so jitter can reorder datagrams. */
+    size_t queue_count;
+    Net_Stats stats;
+} Net_Socket;
+
+
+int net_open(Net_Socket * net, int port, const Net_Conditions * conditions);
+int net_parse_address(const char * text, char * host, size_t capacity, int * port);
+int net_set_peer(Net_Socket * net, const char * host, int port);
+int net_send(Net_Socket * net, const void * data, size_t size, double time_now);
+void net_flush(Net_Socket * net, double time_now);
+size_t net_receive(Net_Socket * net, void * data, size_t capacity);
+void net_close(Net_Socket * net);
+
+#endif
@@ -0,0 +1,390 @@
+#include <string.h>
+
+#include "netplay.h"
+
+
+#define NETPLAY_MAGIC 0x504f4e47u /* "PONG". */
+
+enum {
+    PACKET_HELLO = 1, /* Joining peer to host, with the settings. */
+    PACKET_WELCOME, /* Host to joining peer, with the settings. */
+    PACKET_INPUT,
+};
+
+/* Packet layout, little endian:
+ *
+ *      0  u32  magic
+ *      4  u8   type
+ *      5  u8   number of inputs
+ *      6  u16  unused
+ *      8  u64  settings for HELLO and WELCOME, first input's tick for INPUT
+ *     16  u64  ack, the sender has the receiver's inputs before this tick
+ *     24  u64  sender's tick
+ *     32  u64  sync tick
+ *     40  u64  sync checksum
+ *     48  u32  sender's clock in ms
+ *     52  u32  receiver's clock in ms echoed, plus the time it was held
+ *     56  i32  sender's advantage in 1/1000 ticks
+ *     60  u8   inputs[]
+ */
+#define PACKET_HEADER_SIZE 60
+#define PACKET_MAX_INPUTS ROLLBACK_WINDOW
+
+
+// ================================================================
+// == Encoding.
+// ================================================================
+
+static void put_u32(unsigned char * p, uint32_t value) {
+    for (int i=0; i<4; i++) {
+        p[i] = value >> 8*i;
+    }
+}
+
+
+static void put_u64(unsigned char * p, uint64_t value) {
+    for (int i=0; i<8; i++) {
+        p[i] = value >> 8*i;
+    }
+}
+
+
+static uint32_t get_u32(const unsigned char * p) {
+    uint32_t value = 0;
+    for (int i=0; i<4; i++) {
+        value |= (uint32_t)p[i] << 8*i;
+    }
+    return value;
+}
+
+
+static uint64_t get_u64(const unsigned char * p) {
+    uint64_t value = 0;
+    for (int i=0; i<8; i++) {
+        value |= (uint64_t)p[i] << 8*i;
+    }
+    return value;
+}
+
+
+static uint64_t hash_bytes(uint64_t hash, const void * data, size_t size) {
+    /* FNV-1a. */
+    const unsigned char * bytes = data;
+    for (size_t i=0; i<size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211u;
+    }
+    return hash;
+}
+
+
+static uint64_t state_checksum(const Sim_State * state) {
+    /* Hash of everything a tick can change. */
+    uint64_t hash = 14695981039346656037u;
+    hash = hash_bytes(hash, state->positions, sizeof(state->positions));
+    hash = hash_bytes(hash, &state->items[ID_BALL].speed, sizeof(Sim_Vec));
+    hash = hash_bytes(hash, state->score, sizeof(state->score));
+    return hash;
+}
+
+
+static uint64_t settings_checksum(const Sim_State * state) {
+    /* Hash of what both players must agree on before the first tick. */
+    uint64_t hash = state_checksum(state);
+    for (int i=0; i<ID_NUM; i++) {
+        const Item_Data * item = &state->items[i];
+        hash = hash_bytes(hash, &item->width, sizeof(item->width));
+        hash = hash_bytes(hash, &item->height, sizeof(item->height));
+        hash = hash_bytes(hash, &item->speed, sizeof(item->speed));
+    }
+    hash = hash_bytes(hash, &state->env.width, sizeof(state->env.width));
+    hash = hash_bytes(hash, &state->env.height, sizeof(state->env.height));
+    hash = hash_bytes(hash, &state->tick_rate, sizeof(state->tick_rate));
+    return hash;
+}
+
+
+// ================================================================
+// == Sending.
+// ================================================================
+
+static uint32_t clock_ms(double time) {
+    /* Milliseconds, wrapping around. */
+    return (uint32_t)(uint64_t)(time*1000.0);
+}
+
+
+static double advantage(const Netplay * netplay) {
+    /* Ticks this side is ahead of the peer, counting the ticks the peer
+     * ran while its last packet was on the way. */
+    double peer_now = netplay->peer_tick + netplay->rtt/2*netplay->tick_rate;
+    return netplay->session.tick - peer_now;
+}
+
+
+static void send_packet(Netplay * netplay, int type, double time_now) {
+    /* Send a packet of 'type' with the current state of this side and,
+     * for INPUT, every local input the peer has not acknowledged yet. */
+
+    const Rollback_Session * session = &netplay->session;
+    unsigned char packet[PACKET_HEADER_SIZE + PACKET_MAX_INPUTS] = {0};
+
+    uint64_t first = netplay->peer_ack;
+    uint64_t count = 0;
+    if (type == PACKET_INPUT) {
+        count = session->local_end - first;
+        if (count > PACKET_MAX_INPUTS) {
+            count = PACKET_MAX_INPUTS;
+        }
+        for (uint64_t i=0; i<count; i++) {
+            packet[PACKET_HEADER_SIZE + i] =
+                session->inputs_local[(first + i) & (ROLLBACK_WINDOW - 1)];
+        }
+    } else {
+        first = netplay->settings;
+    }
+
+    /* Echo the peer's clock, adjusted for how long it was held here. */
+    uint32_t echo = 0;
+    if (netplay->has_peer_time) {
+        echo = netplay->peer_time + clock_ms(time_now - netplay->time_peer_time);
+    }
+
+    /* The newest checksum this side has. */
+    Netplay_Sync sync = {0};
+    if (netplay->sync_next > 0) {
+        uint64_t tick = netplay->sync_next - NETPLAY_SYNC_INTERVAL;
+        sync = netplay->syncs[tick/NETPLAY_SYNC_INTERVAL % NETPLAY_SYNC_HISTORY];
+    }
+
+    put_u32(packet + 0, NETPLAY_MAGIC);
+    packet[4] = type;
+    packet[5] = count;
+    put_u64(packet + 8, first);
+    put_u64(packet + 16, session->remote_end);
+    put_u64(packet + 24, session->tick);
+    put_u64(packet + 32, sync.tick);
+    put_u64(packet + 40, sync.checksum);
+    put_u32(packet + 48, clock_ms(time_now));
+    put_u32(packet + 52, echo);
+    put_u32(packet + 56, (uint32_t)(int32_t)(advantage(netplay)*1000.0));
+
+    net_send(&netplay->net, packet, PACKET_HEADER_SIZE + count, time_now);
+}
+
+
+// ================================================================
+// == Receiving.
+// ================================================================
+
+static void compare_sync(Netplay * netplay, Netplay_Sync local, Netplay_Sync peer) {
+    /* Count a desync if both sides have a checksum of the same tick and
+     * they differ. */
+    if (local.tick != peer.tick || peer.tick <= netplay->sync_checked ||
+        (peer.tick == 0 && peer.checksum == 0)) {
+        return;
+    }
+    netplay->sync_checked = peer.tick;
+    netplay->stats.syncs_checked++;
+    netplay->stats.desyncs += local.checksum != peer.checksum;
+}
+
+
+static void update_syncs(Netplay * netplay) {
+    /* Take the checksums of the states that have become final. */
+    Rollback_Session * session = &netplay->session;
+    for (;;) {
+        uint64_t tick = netplay->sync_next;
+        const Sim_State * state = rollback_final_state(session, tick);
+        if (!state) {
+            /* Fell out of the history while waiting for input. */
+            if (tick + ROLLBACK_WINDOW < session->tick && tick < session->remote_end) {
+                netplay->sync_next += NETPLAY_SYNC_INTERVAL;
+                continue;
+            }
+            return;
+        }
+
+        Netplay_Sync * sync = &netplay->syncs[tick/NETPLAY_SYNC_INTERVAL % NETPLAY_SYNC_HISTORY];
+        sync->tick = tick;
+        sync->checksum = state_checksum(state);
+        compare_sync(netplay, *sync, netplay->sync_peer);
+        netplay->sync_next += NETPLAY_SYNC_INTERVAL;
+    }
+}
+
+
+static void receive_packet(Netplay * netplay, const unsigned char * packet, size_t size,
+                           double time_now) {
+    /* Take in one packet from the peer. */
+
+    if (size < PACKET_HEADER_SIZE || get_u32(packet) != NETPLAY_MAGIC ||
+        size < PACKET_HEADER_SIZE + (size_t)packet[5]) {
+        return;
+    }
+
+    int type = packet[4];
+    uint64_t first = get_u64(packet + 8);
+
+    if (type == PACKET_HELLO && netplay->hosting) {
+        /* Answer every attempt, in case earlier answers were lost, and
+         * even a refused one so the peer can tell why. */
+        netplay->connected |= first == netplay->settings;
+        netplay->refused |= first != netplay->settings;
+        send_packet(netplay, PACKET_WELCOME, time_now);
+        return;
+    }
+    if (type == PACKET_WELCOME && !netplay->hosting) {
+        netplay->connected |= first == netplay->settings;
+        netplay->refused |= first != netplay->settings;
+        return;
+    }
+    if (type != PACKET_INPUT || !netplay->connected) {
+        return;
+    }
+
+    /* Inputs the session already has are skipped by rollback_add_remote. */
+    for (size_t i=0; i<packet[5]; i++) {
+        if (rollback_add_remote(&netplay->session, first + i,
+                                packet[PACKET_HEADER_SIZE + i]) < 0) {
+            break;
+        }
+    }
+
+    uint64_t ack = get_u64(packet + 16);
+    uint64_t tick = get_u64(packet + 24);
+    if (ack > netplay->peer_ack && ack <= netplay->session.local_end) {
+        netplay->peer_ack = ack;
+    }
+    if (tick >= netplay->peer_tick) {
+        netplay->peer_tick = tick;
+        netplay->peer_advantage = (int32_t)get_u32(packet + 56)/1000.0;
+    }
+
+    /* Round trip from our own clock echoed back. */
+    uint32_t echo = get_u32(packet + 52);
+    if (echo != 0) {
+        double rtt = (uint32_t)(clock_ms(time_now) - echo)/1000.0;
+        if (rtt < 10.0) {
+            netplay->rtt = netplay->rtt > 0.0 ? 0.9*netplay->rtt + 0.1*rtt : rtt;
+        }
+    }
+    netplay->peer_time = get_u32(packet + 48);
+    netplay->time_peer_time = time_now;
+    netplay->has_peer_time = 1;
+
+    Netplay_Sync sync = {get_u64(packet + 32), get_u64(packet + 40)};
+    if (sync.tick > netplay->sync_peer.tick) {
+        netplay->sync_peer = sync;
+        compare_sync(netplay, netplay->syncs[sync.tick/NETPLAY_SYNC_INTERVAL %
+                                             NETPLAY_SYNC_HISTORY], sync);
+    }
+}
+
+
+static void receive_all(Netplay * netplay, double time_now) {
+    unsigned char packet[NET_MAX_PACKET];
+    size_t size;
+    while ((size = net_receive(&netplay->net, packet, sizeof(packet))) > 0) {
+        receive_packet(netplay, packet, size, time_now);
+    }
+}
+
+
+// ================================================================
+// == Session.
+// ================================================================
+
+int netplay_open(Netplay * netplay, const Netplay_Config * config, const Sim_State * initial) {
+    /* Host a match on 'config->port', or join the one at 'config->host',
+     * starting at 'initial'. Returns 0 on success. */
+
+    memset(netplay, 0, sizeof(*netplay));
+    netplay->hosting = config->host == NULL;
+    netplay->settings = settings_checksum(initial);
+    netplay->tick_rate = initial->tick_rate;
+    netplay->time_hello = -NETPLAY_HELLO_INTERVAL;
+    for (int i=0; i<NETPLAY_SYNC_HISTORY; i++) {
+        netplay->syncs[i].tick = UINT64_MAX;
+    }
+
+    Sim_Input mask_local = netplay->hosting ? INPUT_RIGHT_UP | INPUT_RIGHT_DOWN :
+                                              INPUT_LEFT_UP | INPUT_LEFT_DOWN;
+    rollback_init(&netplay->session, initial, mask_local, config->input_delay);
+
+    if (net_open(&netplay->net, netplay->hosting ? config->port : 0,
+                 &config->conditions) != 0) {
+        return -1;
+    }
+    if (!netplay->hosting && net_set_peer(&netplay->net, config->host, config->port) != 0) {
+        net_close(&netplay->net);
+        return -1;
+    }
+    return 0;
+}
+
+
+int netplay_connect(Netplay * netplay, double time_now) {
+    /* Make progress on the handshake. Returns 1 once connected, 0 while
+     * still waiting and -1 if the peer plays with other settings. Call
+     * until connected, then start ticking. */
+
+    receive_all(netplay, time_now);
+    if (!netplay->connected && !netplay->hosting &&
+        time_now - netplay->time_hello >= NETPLAY_HELLO_INTERVAL) {
+        netplay->time_hello = time_now;
+        send_packet(netplay, PACKET_HELLO, time_now);
+    }
+    net_flush(&netplay->net, time_now);
+    if (netplay->refused) {
+        return -1;
+    }
+    return netplay->connected;
+}
+
+
+void netplay_poll(Netplay * netplay, double time_now) {
+    /* Take in what the peer sent, apply any corrections and send our
+     * unacknowledged inputs again. Call at least once per frame. */
+
+    receive_all(netplay, time_now);
+    rollback_correct(&netplay->session);
+    update_syncs(netplay);
+    send_packet(netplay, PACKET_INPUT, time_now);
+    net_flush(&netplay->net, time_now);
+}
+
+
+int netplay_tick(Netplay * netplay, Sim_Input input, double time_now) {
+    /* Run the next tick with 'input' from the local player. Returns 1 if it
+     * ran, 0 if it was held back to let the peer catch up. */
+
+    Rollback_Session * session = &netplay->session;
+
+    /* Split the difference with the peer, one tick at a time. */
+    double ahead = (advantage(netplay) - netplay->peer_advantage)/2;
+    if (ahead >= 1.0 && session->tick >= netplay->tick_skipped + NETPLAY_SKIP_SPACING) {
+        netplay->tick_skipped = session->tick;
+        netplay->stats.ticks_skipped++;
+        return 0;
+    }
+
+    if (!rollback_advance(session, input)) {
+        return 0;
+    }
+    update_syncs(netplay);
+    send_packet(netplay, PACKET_INPUT, time_now);
+    net_flush(&netplay->net, time_now);
+    return 1;
+}
+
+
+uint64_t netplay_confirmed(const Netplay * netplay) {
+    /* Ticks before this have the inputs of both players on both sides. */
+    uint64_t remote_end = netplay->session.remote_end;
+    return netplay->peer_ack < remote_end ? netplay->peer_ack : remote_end;
+}
+
+
+void netplay_close(Netplay * netplay) {
+    net_close(&netplay->net);
+}
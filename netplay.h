@@ -0,0 +1,91 @@
+#ifndef NETPLAY_H
+#define NETPLAY_H
+
+#include <stdint.h>
+
+#include "sim.h"
+#include "net.h"
+#include "rollback.h"
+
+/* Two player matches over UDP with rollback. The host plays the right
+ * paddle and waits for a peer, the peer joins and plays the left one. Both
+ * start from the same state, which the handshake checks.
+ *
+ * Every packet carries all local inputs the peer has not acknowledged yet,
+ * so lost packets need no retransmission of their own. Packets also carry
+ * the sender's tick and round trip estimate, from which the side that is
+ * ahead skips a tick now and then to let the other catch up, and a
+ * checksum of a confirmed state every NETPLAY_SYNC_INTERVAL ticks to catch
+ * the two simulations drifting apart. */
+
+
+/* Seconds between connection attempts. */
+#define NETPLAY_HELLO_INTERVAL 0.1
+
+/* Ticks between compared checksums, and how many are kept. */
+#define NETPLAY_SYNC_INTERVAL 32
+#define NETPLAY_SYNC_HISTORY 16
+
+/* Least ticks between two ticks skipped to let the peer catch up. */
+#define NETPLAY_SKIP_SPACING 8
+
+
+typedef struct Netplay_Config {
+    const char * host; /* Peer to join, or NULL to host. */
+    int port; /* Port to host on, or the peer's port. */
+    int input_delay; /* Ticks. */
+    Net_Conditions conditions;
+} Netplay_Config;
+
+
+/* Checksum of the confirmed state before a tick. */
+typedef struct Netplay_Sync {
+    uint64_t tick;
+    uint64_t checksum;
+} Netplay_Sync;
+
+
+typedef struct Netplay_Stats {
+    uint64_t ticks_skipped;
+    uint64_t syncs_checked;
+    uint64_t desyncs;
+} Netplay_Stats;
+
+
+typedef struct Netplay {
+    Net_Socket net;
+    Rollback_Session session;
+    int hosting;
+    int connected;
+    int refused; /* The peer's settings differ. */
+    uint64_t settings; /* Checksum of the initial state. */
+    double time_hello;
+
+    /* What is known about the peer. */
+    uint64_t peer_ack; /* The peer has our inputs before this tick. */
+    uint64_t peer_tick;
+    double peer_advantage; /* Ticks the peer is ahead by its own estimate. */
+    uint32_t peer_time; /* Peer clock in ms, echoed back for the round trip. */
+    double time_peer_time;
+    int has_peer_time;
+    double rtt; /* Seconds, smoothed. */
+    int tick_rate;
+    uint64_t tick_skipped;
+
+    Netplay_Sync syncs[NETPLAY_SYNC_HISTORY]; /* By tick/interval. */
+    uint64_t sync_next;
+    Netplay_Sync sync_peer; /* Latest from the peer not yet compared. */
+    uint64_t sync_checked; /* Ticks up to this were compared. */
+
+    Netplay_Stats stats;
+} Netplay;
+
+
+int netplay_open(Netplay * netplay, const Netplay_Config * config, const Sim_State * initial);
+int netplay_connect(Netplay * netplay, double time_now);
+void netplay_poll(Netplay * netplay, double time_now);
+int netplay_tick(Netplay * netplay, Sim_Input input, double time_now);
+uint64_t netplay_confirmed(const Netplay * netplay);
+void netplay_close(Netplay * netplay);
+
+#endif
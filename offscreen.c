@@ -0,0 +1,208 @@
+#include <string.h>
+
+#include "offscreen.h"
+
+
+static int has_extension(const char * extensions, const char * name) {
+    /* Whether the space separated list 'extensions' holds 'name'. */
+    size_t length = strlen(name);
+    const char * found = extensions;
+    while (found && (found = strstr(found, name)) != NULL) {
+        int starts = found == extensions || found[-1] == ' ';
+        int ends = found[length] == ' ' || found[length] == '\0';
+        if (starts && ends) {
+            return 1;
+        }
+        found += length;
+    }
+    return 0;
+}
+
+
+static EGLDisplay open_display(void) {
+    /* Mesa's surfaceless platform if the client library has it, so that no
+     * display server or render node is needed, else the default display. */
+
+    const char * extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (has_extension(extensions, "EGL_MESA_platform_surfaceless") &&
+        has_extension(extensions, "EGL_EXT_platform_base")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (get_platform_display) {
+            EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+                                                      EGL_DEFAULT_DISPLAY, NULL);
+            if (display != EGL_NO_DISPLAY) {
+                return display;
+            }
+        }
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+
+static int choose_config(EGLDisplay display, EGLConfig * config) {
+    /* An 8 bit RGBA config for desktop GL, one that can back a pbuffer if
+     * there is one. Returns 0 on success, -1 on failure. */
+
+    EGLint surface_types[] = {EGL_PBUFFER_BIT, 0};
+    for (size_t i=0; i<sizeof(surface_types)/sizeof(surface_types[0]); i++) {
+        const EGLint attributes[] = {
+            EGL_SURFACE_TYPE, surface_types[i],
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_RED_SIZE, 8,
+            EGL_GREEN_SIZE, 8,
+            EGL_BLUE_SIZE, 8,
+            EGL_ALPHA_SIZE, 8,
+            EGL_NONE,
+        };
+        EGLint num_configs = 0;
+        if (eglChooseConfig(display, attributes, config, 1, &num_configs) &&
+            num_configs > 0) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+int offscreen_init(Offscreen * offscreen, int width, int height) {
+    /* Create the context and a 'width' by 'height' framebuffer to draw
+     * into, and make both current. Returns 0 on success, -1 on failure. */
+
+    memset(offscreen, 0, sizeof(*offscreen));
+    offscreen->display = EGL_NO_DISPLAY;
+    offscreen->context = EGL_NO_CONTEXT;
+    offscreen->surface = EGL_NO_SURFACE;
+    if (width <= 0 || height <= 0) {
+        return -1;
+    }
+    offscreen->width = width;
+    offscreen->height = height;
+
+    offscreen->display = open_display();
+    EGLint major, minor;
+    if (offscreen->display == EGL_NO_DISPLAY ||
+        !eglInitialize(offscreen->display, &major, &minor)) {
+        offscreen->display = EGL_NO_DISPLAY;
+        return -1;
+    }
+
+    EGLConfig config;
+    if (!eglBindAPI(EGL_OPENGL_API) || choose_config(offscreen->display, &config) != 0) {
+        offscreen_free(offscreen);
+        return -1;
+    }
+
+    /* The same version and profile the window asks GLFW for. */
+    const EGLint attributes_context[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE,
+    };
+    offscreen->context = eglCreateContext(offscreen->display, config,
+                                          EGL_NO_CONTEXT, attributes_context);
+    if (offscreen->context == EGL_NO_CONTEXT) {
+        offscreen_free(offscreen);
+        return -1;
+    }
+
+    const char * extensions = eglQueryString(offscreen->display, EGL_EXTENSIONS);
+    if (!has_extension(extensions, "EGL_KHR_surfaceless_context")) {
+        const EGLint attributes_surface[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+        offscreen->surface = eglCreatePbufferSurface(offscreen->display, config,
+                                                     attributes_surface);
+        if (offscreen->surface == EGL_NO_SURFACE) {
+            offscreen_free(offscreen);
+            return -1;
+        }
+    }
+    if (!eglMakeCurrent(offscreen->display, offscreen->surface, offscreen->surface,
+                        offscreen->context)) {
+        offscreen_free(offscreen);
+        return -1;
+    }
+
+    /* GLEW built for GLX finds no GLX display here, but loads the core
+     * functions all the same. */
+    glewExperimental = GL_TRUE;
+    GLenum status = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    if (status == GLEW_ERROR_NO_GLX_DISPLAY) {
+        status = GLEW_OK;
+    }
+#endif
+    if (status != GLEW_OK) {
+        offscreen_free(offscreen);
+        return -1;
+    }
+    /* glewInit may leave an error behind on core contexts. */
+    glGetError();
+
+    glGenRenderbuffers(1, &offscreen->renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, offscreen->renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &offscreen->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, offscreen->framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_RENDERBUFFER, offscreen->renderbuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        offscreen_free(offscreen);
+        return -1;
+    }
+    glViewport(0, 0, width, height);
+    return glGetError() == GL_NO_ERROR ? 0 : -1;
+}
+
+
+void offscreen_free(Offscreen * offscreen) {
+    if (offscreen->context != EGL_NO_CONTEXT &&
+        eglGetCurrentContext() == offscreen->context) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &offscreen->framebuffer);
+        glDeleteRenderbuffers(1, &offscreen->renderbuffer);
+        eglMakeCurrent(offscreen->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                       EGL_NO_CONTEXT);
+    }
+    if (offscreen->display != EGL_NO_DISPLAY) {
+        if (offscreen->surface != EGL_NO_SURFACE) {
+            eglDestroySurface(offscreen->display, offscreen->surface);
+        }
+        if (offscreen->context != EGL_NO_CONTEXT) {
+            eglDestroyContext(offscreen->display, offscreen->context);
+        }
+        eglTerminate(offscreen->display);
+    }
+    memset(offscreen, 0, sizeof(*offscreen));
+    offscreen->display = EGL_NO_DISPLAY;
+    offscreen->context = EGL_NO_CONTEXT;
+    offscreen->surface = EGL_NO_SURFACE;
+}
+
+
+int offscreen_read(const Offscreen * offscreen, Raster_Target * target) {
+    /* Wait for the frame drawn and copy it into 'target', which must be of
+     * the framebuffer's size, as 0xAARRGGBB pixels top row first like the
+     * software rasterizer's. Returns 0 on success, -1 on failure. */
+
+    if (target->width != offscreen->width || target->height != offscreen->height) {
+        return -1;
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, target->width, target->height,
+                 GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, target->pixels);
+
+    /* GL reads the bottom row first. */
+    for (int y=0; y<target->height/2; y++) {
+        uint32_t * top = target->pixels + (size_t)y*target->width;
+        uint32_t * bottom = target->pixels + (size_t)(target->height - 1 - y)*target->width;
+        for (int x=0; x<target->width; x++) {
+            uint32_t pixel = top[x];
+            top[x] = bottom[x];
+            bottom[x] = pixel;
+        }
+    }
+    return glGetError() == GL_NO_ERROR ? 0 : -1;
+}
@@ -0,0 +1,35 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/glew.h>
+
+#include "raster.h"
+
+/* OpenGL 3.3 core context without a window, for rendering where there is
+ * no display server, such as CI machines and batch hosts.
+ *
+ * The context comes from EGL, on Mesa's surfaceless platform when there is
+ * one so that not even a GPU is needed with llvmpipe, and from the default
+ * display otherwise. It is made current without a surface if the display
+ * allows it, and with a 1x1 pbuffer if not. Either way frames are drawn
+ * into a framebuffer object of the size asked for, which stays bound. */
+
+
+typedef struct Offscreen {
+    EGLDisplay display;
+    EGLContext context;
+    EGLSurface surface; /* EGL_NO_SURFACE if surfaceless. */
+    GLuint framebuffer;
+    GLuint renderbuffer;
+    int width;
+    int height;
+} Offscreen;
+
+
+int offscreen_init(Offscreen * offscreen, int width, int height);
+void offscreen_free(Offscreen * offscreen);
+int offscreen_read(const Offscreen * offscreen, Raster_Target * target);
+
+#endif
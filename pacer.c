@@ -0,0 +1,104 @@
+#define _POSIX_C_SOURCE 200809L
+#include <string.h>
+#include <time.h>
+
+#include "pacer.h"
+#include "trace.h"
+
+
+static void sleep_until(double time) {
+    /* Sleep until shortly before 'time', then spin the rest. */
+    double left = time - trace_now() - PACER_SPIN;
+    if (left > 0.0) {
+        struct timespec ts = {
+            .tv_sec = (time_t)left,
+            .tv_nsec = (long)((left - (time_t)left)*1e9),
+        };
+        nanosleep(&ts, NULL);
+    }
+    while (trace_now() < time) {
+        /* Spin. */
+    }
+}
+
+
+void pacer_init(Pacer * pacer, double rate, int vsync) {
+    /* Pace frames to 'rate' per second, or not at all if 0. 'vsync' tells
+     * whether swaps wait for the display. */
+
+    memset(pacer, 0, sizeof(*pacer));
+    pacer->frame_length = rate > 0.0 ? 1.0/rate : 0.0;
+    pacer->vsync = vsync;
+
+    double now = trace_now();
+    pacer->time_deadline = now + pacer->frame_length;
+    pacer->time_wake = now;
+    pacer->time_render = now;
+    pacer->time_swap = now;
+    pacer->time_window = now;
+}
+
+
+void pacer_wait(Pacer * pacer) {
+    /* Wait until the current frame should start. Call before polling for
+     * input. */
+
+    if (pacer->frame_length > 0.0) {
+        sleep_until(pacer->time_deadline - pacer->render_estimate - PACER_MARGIN);
+    }
+    pacer->time_wake = trace_now();
+}
+
+
+void pacer_rendered(Pacer * pacer) {
+    /* Note that the frame is rendered. Call right before swapping. */
+
+    pacer->time_render = trace_now();
+    double render = pacer->time_render - pacer->time_wake;
+    pacer->render_estimate *= PACER_DECAY;
+    if (render > pacer->render_estimate) {
+        pacer->render_estimate = render;
+    }
+}
+
+
+int pacer_swapped(Pacer * pacer) {
+    /* Note that the swap returned and set the next deadline. Returns 1 when
+     * the rolling window is complete, to be read and reset. */
+
+    double now = trace_now();
+    double frame = now - pacer->time_swap;
+    pacer->time_swap = now;
+    pacer->frame_last = frame;
+    pacer->frames++;
+    histogram_add(&pacer->frame_times, frame);
+    histogram_add(&pacer->window, frame);
+
+    if (pacer->frame_length > 0.0) {
+        if (pacer->vsync) {
+            /* The swap returned at the display's refresh. */
+            if (frame > 1.5*pacer->frame_length) {
+                pacer->deadlines_missed++;
+            }
+            pacer->time_deadline = now + pacer->frame_length;
+        } else {
+            if (now > pacer->time_deadline + PACER_MARGIN) {
+                pacer->deadlines_missed++;
+            }
+            pacer->time_deadline += pacer->frame_length;
+            if (now > pacer->time_deadline) {
+                /* Too late for the next deadline as well, start over. */
+                pacer->time_deadline = now + pacer->frame_length;
+            }
+        }
+    }
+
+    return now - pacer->time_window >= PACER_WINDOW;
+}
+
+
+void pacer_window_reset(Pacer * pacer) {
+    /* Start a new rolling window. */
+    memset(&pacer->window, 0, sizeof(pacer->window));
+    pacer->time_window = pacer->time_swap;
+}
@@ -0,0 +1,61 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <stdint.h>
+
+#include "histogram.h"
+
+/* Frame pacing. Without a target rate frames run back to back and only the
+ * swap interval paces them. With one, each frame sleeps until just before
+ * its deadline, so that input is polled and the world simulated as late as
+ * possible before the frame is shown, and then renders in the time that
+ * rendering recently took plus a margin.
+ *
+ * With vsync the deadlines follow the moments the swaps return, which is
+ * when the display took the last frame. Without it they follow a steady
+ * clock of their own.
+ *
+ * Frame times, from one swap returning to the next, go into a histogram of
+ * the whole run and into one of the last PACER_WINDOW seconds, for the
+ * steadiness of frame delivery rather than its average. */
+
+
+/* Time kept free before the deadline on top of the rendering estimate. */
+#define PACER_MARGIN 0.001
+
+/* The end of a sleep is spun instead, since sleeps overshoot. */
+#define PACER_SPIN 0.0005
+
+/* How quickly the rendering estimate forgets a slow frame, per frame. */
+#define PACER_DECAY 0.98
+
+/* Seconds covered by the rolling frame time histogram. */
+#define PACER_WINDOW 1.0
+
+
+typedef struct Pacer {
+    double frame_length; /* Target seconds per frame, 0 to not sleep. */
+    int vsync; /* Swaps wait for the display. */
+
+    double time_deadline; /* When the next swap should return. */
+    double time_wake; /* When the current frame started. */
+    double time_render; /* When the current frame was rendered. */
+    double time_swap; /* When the last swap returned. */
+    double render_estimate; /* Seconds, recent peak. */
+
+    double frame_last; /* Seconds, swap to swap. */
+    Histogram frame_times;
+    Histogram window; /* The last PACER_WINDOW seconds. */
+    double time_window;
+    uint64_t frames;
+    uint64_t deadlines_missed;
+} Pacer;
+
+
+void pacer_init(Pacer * pacer, double rate, int vsync);
+void pacer_wait(Pacer * pacer);
+void pacer_rendered(Pacer * pacer);
+int pacer_swapped(Pacer * pacer);
+void pacer_window_reset(Pacer * pacer);
+
+#endif
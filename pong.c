@@ -1,104 +1,63 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
+#include <time.h>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include "sim.h"
+#include "balls.h"
+#include "collide.h"
+#include "timestep.h"
+#include "trace.h"
+#include "replay.h"
+#include "netplay.h"
+#include "input.h"
+#include "pacer.h"
+#include "scene.h"
+#include "transforms.h"
+#include "gl_state.h"
+#include "render_queue.h"
+#include "draws.h"
+#include "shader_cache.h"
+#include "shaders.h"
+#include "sprites.h"
+#include "sprite_stream.h"
+#include "raster.h"
+#include "capture.h"
+#include "ai.h"
+#include "audio.h"
+
 #define UNUSED(x) (void) x
 
 #define SIZE(x) sizeof(x)/sizeof(x[0])
 
-#define NUM_ELEMENTS 15
-
-#define m4_unity (m4){\
-    {1.0f, 0.0f, 0.0f, 0.0f}, \
-    {0.0f, 1.0f, 0.0f, 0.0f}, \
-    {0.0f, 0.0f, 1.0f, 0.0f}, \
-    {0.0f, 0.0f, 0.0f, 1.0f}, \
-}
-
-
-typedef GLfloat m4[4][4];
-
-
-/* Enumerate unique objects. */
-enum {
-    ID_PADDLE_RIGHT,
-    ID_PADDLE_LEFT,
-    ID_BALL,
-    ID_DISPLAY_RIGHT,
-    ID_DISPLAY_LEFT,
-    ID_NUM,
-};
-
-typedef struct v3 {
-    GLfloat x;
-    GLfloat y;
-    GLfloat z;
-} v3;
+/* Where F12 and exit write the frame trace when built with TRACE=1. */
+#define TRACE_PATH "pong_trace.json"
 
+/* Where the linked shader program is cached between starts. */
+#define SHADER_CACHE_PATH "pong_shaders.bin"
 
-typedef struct Item_Data {
-    GLint width;
-    GLint height;
-    v3 speed;
-    GLuint id;
-    GLuint offset;
-} Item_Data;
-
-
-typedef struct Data_Environment {
-    GLint width;
-    GLint height;
-    GLfloat delta_width; /* Float value per pixel along width. */
-    GLfloat delta_height;/* Float value per pixel along height. */
-
-} Data_Environment;
+/* Most steps of startup that are timed. */
+#define MAX_STARTUP_STEPS 16
 
 
 typedef struct Event_Data {
     GLFWwindow * window;
-    m4 * transformation_matrices;
-    Item_Data * items;
 } Event_Data;
 
 
-typedef struct Render_Data {
-    GLuint VAO;
-    GLuint program_shader;
-    size_t size_data;
-    GLuint uloc_transform;
-    m4 * transformation_matrices;
-    void (* render_function)(GLuint,
-                             GLuint,
-                             size_t,
-                             GLuint,
-                             m4,
-                             void *,
-                             size_t);
-} Render_Data;
-
-
-/* Create struct for Display_Pixel. */
-typedef struct Display_Element_Data {
-    GLboolean on;
-    GLfloat pos_x;
-    GLfloat pos_y;
-} Display_Element_Data;
-
-
-/* Create Display struct for keeping score. */
-typedef struct Display {
-    GLint pos_x;
-    GLint pos_y;
-    Display_Element_Data elements[NUM_ELEMENTS];
-    GLuint current_value;
-    GLboolean left_aligned;
-    Data_Environment * data_environment;
-} Display;
+/* Keys held, and keys pressed since they were last looked at, so that a
+ * tap shorter than a tick still counts. Indexed by GLFW key. */
+bool map_keys[1024];
+bool map_keys_pressed[1024];
 
+/* Key events on their way from key_callback to the ticks. */
+Input_Queue input_queue;
 
-bool map_keys[1024];
+/* Time from paddle key events to the screen. */
+Input_Latency input_latency;
 
 void key_callback(GLFWwindow * window, int key, int scancode, int action, int mods) {
 
@@ -106,497 +65,239 @@ void key_callback(GLFWwindow * window, int key, int scancode, int action, int mo
     UNUSED(mods);
     UNUSED(window);
 
-    if (action == GLFW_PRESS) {
-        map_keys[key] = true;
-    } else if (action == GLFW_RELEASE && map_keys[key]) {
-        map_keys[key] = false;
+    /* Only take the time here, the tick the event falls into applies it.
+     * Repeats change nothing. */
+    if (key < 0 || key >= (int)(SIZE(map_keys)) || action == GLFW_REPEAT) {
+        return;
     }
+    input_queue_push(&input_queue, (Input_Event){
+        .time = glfwGetTime(),
+        .key = key,
+        .pressed = action == GLFW_PRESS,
+    });
 }
 
 
-void error(const char * message, bool fatal) {
-    fprintf(stderr, "ERROR: %s", message);
-    if (fatal) {
-        fprintf(stderr, "ERROR: Shutting down.\n");
-        exit(EXIT_FAILURE);
-    }
-}
-
-
-void react_to_events(Event_Data event_data, Item_Data * items, Data_Environment env) {
-
-    GLFWwindow * window = event_data.window;
-    m4 * transformation_matrices = event_data.transformation_matrices;
-
-    /* Close window on ESC. */
-    if (map_keys[GLFW_KEY_ESCAPE]) {
-        glfwSetWindowShouldClose(window, GL_TRUE);
-    }
-
-    /* Get item objects for left and right paddle. */
-    Item_Data item_right = items[ID_PADDLE_RIGHT];
-    Item_Data item_left = items[ID_PADDLE_LEFT];
+void keys_apply(double time_until, double time_tick) {
+    /* Apply the queued key events up to 'time_until' to the key maps, and
+     * time the paddle keys as applied by the tick run at 'time_tick'. */
 
-    /* Get delta height from environment. */
-    GLfloat delta_height = env.delta_height;
-
-    /* Get pixel speeds for paddles. */
-    GLint speed_right_pixel = item_right.speed.y;
-    GLint speed_left_pixel = item_left.speed.y;
-
-    /* Convert pixel speed.to float speed for both paddles. */
-    GLfloat speed_right_float = speed_right_pixel * delta_height;
-    GLfloat speed_left_float = speed_left_pixel * delta_height;
-
-    /* Grab pointers to height values for right and left pad. */
-    GLfloat * ptr_pos_right = &transformation_matrices[ID_PADDLE_RIGHT][1][3];
-    GLfloat * ptr_pos_left = &transformation_matrices[ID_PADDLE_LEFT][1][3];
-
-    /* Calculate current positions in pixels. */
-    GLfloat pos_right = *ptr_pos_right/delta_height;
-    GLfloat pos_left = *ptr_pos_left/delta_height;
-
-    /* Create variables for storing the next height value. */
-    GLint next_right_pos, next_left_pos;
-
-    UNUSED(next_left_pos);
-    UNUSED(pos_left);
-    UNUSED(speed_left_float);
-
-    /* Move right paddle up and down with arrow keys. */
-    if (map_keys[GLFW_KEY_UP]) {
-        /* Calculate the next position based on pixel movement. */
-        next_right_pos = pos_right + speed_right_pixel;
-        /* Add the height of the paddle and check bounds. */
-        GLint top_of_right = next_right_pos+item_right.height/2;
-        if (top_of_right < env.height/2) {
-            *ptr_pos_right += speed_right_float;
-        } else {
-            *ptr_pos_right = 1.0f-item_right.height/2*delta_height;
-        }
-    } else if (map_keys[GLFW_KEY_DOWN]) {
-        /* Calculate the next position based on pixel movement. */
-        next_right_pos = pos_right - speed_right_pixel;
-        /* Add the height of the paddle and check bounds. */
-        GLint bottom_of_right = next_right_pos-item_right.height/2;
-        if (bottom_of_right > -env.height/2) {
-            *ptr_pos_right -= speed_right_float;
-        } else {
-            *ptr_pos_right = -1.0f+item_right.height/2*delta_height;
+    Input_Event event;
+    while (input_queue_peek(&input_queue, &event) && event.time <= time_until) {
+        input_queue_pop(&input_queue);
+        map_keys[event.key] = event.pressed;
+        map_keys_pressed[event.key] |= event.pressed;
+        if (event.key == GLFW_KEY_UP || event.key == GLFW_KEY_DOWN) {
+            input_latency_applied(&input_latency, event.time, time_tick);
         }
     }
 }
 
 
-const GLchar * source_vertex_shader = \
-    "#version 330 core\n"
-    "layout (location=0) in vec3 position;\n"
-    "uniform mat4 transform;\n"
-    "\n"
-    "void main() {"
-    "   gl_Position = transform * vec4(position, 1.0f);\n"
-    "}\n";
-
-
-const GLchar * source_fragment_shader = \
-    "#version 330 core\n"
-    "out vec4 color;\n"
-    "void main() {\n"
-    "   color = vec4(1.0f, 1.0f, 1.0f, 1.0f);\n"
-    "}\n";
-
+/* Time taken by each step of startup, for how long the first frame takes. */
+typedef struct Startup_Timing {
+    const char * names[MAX_STARTUP_STEPS];
+    double seconds[MAX_STARTUP_STEPS];
+    size_t count;
+    double time_start;
+    double time_last;
+} Startup_Timing;
 
-GLint shader_compile(GLuint shader_id, char * buffer_info, size_t s_buffer_info) {
-    /* TODO: Make this function on a list in the same way that shaders_delete
-     * does. */
 
-    /* Compile shader. */
-    glCompileShader(shader_id);
-
-    /* Retrieve context data. */
-    GLint success = 0;
-    glGetShaderiv(shader_id, GL_COMPILE_STATUS, &success);
-
-    /* Get error if there was one. */
-    if (!success) {
-        glGetShaderInfoLog(shader_id, s_buffer_info, NULL, buffer_info);
-    }
-    return success;
-}
-
-
-GLint program_link(GLuint program_shader,
-                   GLuint * ids,
-                   size_t num_shaders,
-                   char * buffer_info,
-                   size_t size_buffer) {
-    /* Attach and link the shaders in ids array. Check status and gather any
-     * information on failure and store in buffer_info. Return status. */
-
-    /* Attach all shaders ids. */
-    for(size_t i=0; i<num_shaders; i++) {
-        glAttachShader(program_shader, ids[i]);
+void startup_mark(Startup_Timing * startup, const char * name) {
+    /* Note that the step 'name' ended now. */
+    double now = trace_now();
+    if (startup->count == 0 && startup->time_start == 0.0) {
+        startup->time_start = now;
+        startup->time_last = now;
+        return;
     }
-
-    /* Link all the attached shades. */
-    glLinkProgram(program_shader);
-
-    /* Examine the linking status. */
-    GLint success;
-    glGetProgramiv(program_shader, GL_LINK_STATUS, &success);
-
-    if (!success) {
-        glGetProgramInfoLog(program_shader, size_buffer, NULL, buffer_info);
+    if (startup->count < MAX_STARTUP_STEPS) {
+        startup->names[startup->count] = name;
+        startup->seconds[startup->count] = now - startup->time_last;
+        startup->count++;
     }
-    return success;
+    startup->time_last = now;
 }
 
 
-void shaders_delete(GLuint * ids, size_t num_ids) {
-    /* Delete all shaders in the ids list. */
-    for(size_t i=0; i<num_ids; i++) {
-        glDeleteShader(ids[i]);
+void startup_print(const Startup_Timing * startup, FILE * file) {
+    fprintf(file, "startup: %.1f ms to the first frame\n",
+            (startup->time_last - startup->time_start)*1e3);
+    for (size_t i=0; i<startup->count; i++) {
+        fprintf(file, "  %-20s %8.1f ms\n", startup->names[i], startup->seconds[i]*1e3);
     }
 }
 
 
-void m4_set(m4 dest, m4 source) {
-    for(size_t i=0; i<4; i++) {
-        for(size_t j=0; j<4; j++) {
-            dest[i][j] = source[i][j];
-        }
+void error(const char * message, bool fatal) {
+    fprintf(stderr, "ERROR: %s", message);
+    if (fatal) {
+        fprintf(stderr, "ERROR: Shutting down.\n");
+        exit(EXIT_FAILURE);
     }
 }
 
 
-void render_basic(GLuint vertex_array,
-                  GLuint program_shader,
-                  size_t s_vertices,
-                  GLuint uloc_transform,
-                  m4 matrix_transform,
-                  void * data,
-                  size_t size_data) {
-
-    UNUSED(data);
-    UNUSED(size_data);
-
-    /* Set the current linker program that should be used. */
-    glUseProgram(program_shader);
-
-    /* Set transformation matrix. */
-    size_t count = 1;
-    GLboolean transpose = GL_TRUE;
-    GLfloat * ptr_value = &matrix_transform[0][0];
-
-    printf("x: %f, y: %f\n", matrix_transform[0][3], matrix_transform[1][3]);
-
-    glUniformMatrix4fv(uloc_transform, count, transpose, ptr_value);
+Sim_Input react_to_events_keys(Event_Data event_data) {
+    /* Translate the current key state into simulation input bits. */
 
-    /* Bind the VAO that should be used. */
-    glBindVertexArray(vertex_array);
+    GLFWwindow * window = event_data.window;
 
-    /* Draw the vertices as triangles. */
-    glDrawArrays(GL_TRIANGLES, 0, s_vertices/3);
+    /* Close window on ESC. */
+    if (map_keys[GLFW_KEY_ESCAPE] || map_keys_pressed[GLFW_KEY_ESCAPE]) {
+        glfwSetWindowShouldClose(window, GL_TRUE);
+    }
 
-    /* Unset the shader program */
-    glUseProgram(0);
+    Sim_Input input = 0;
 
-    /* Unbind the vertex array. */
-    glBindVertexArray(0);
+    /* Move right paddle up and down with arrow keys. */
+    if (map_keys[GLFW_KEY_UP] || map_keys_pressed[GLFW_KEY_UP]) {
+        input |= INPUT_RIGHT_UP;
+    } else if (map_keys[GLFW_KEY_DOWN] || map_keys_pressed[GLFW_KEY_DOWN]) {
+        input |= INPUT_RIGHT_DOWN;
+    }
 
+    map_keys_pressed[GLFW_KEY_ESCAPE] = false;
+    map_keys_pressed[GLFW_KEY_UP] = false;
+    map_keys_pressed[GLFW_KEY_DOWN] = false;
+    return input;
 }
 
 
-void render_display(GLuint vertex_array,
-                    GLuint program_shader,
-                    size_t s_vertices,
-                    GLuint uloc_transform,
-                    m4  matrix_transform,
-                    void * data,
-                    size_t size_data) {
-    /* Render function for the display entities. */
-
-    /* Unpack data. */
-    Display * display_data = (Display*)data;
-
-    GLint pos_pixel_x = display_data->pos_x;
-    GLint pos_pixel_y = display_data->pos_y;
-    GLuint current_value = display_data->current_value;
-    GLboolean left_aligned = display_data->left_aligned;
-
-    /* Get elements. */
-    Display_Element_Data * elements = display_data->elements;
-
-    /* Get data_environment. */
-    Data_Environment * data_env = display_data->data_environment;
-    GLfloat delta_width = data_env->delta_width;
-    GLfloat delta_height = data_env->delta_height;
-
-    /* Set up a local transformation matrix. */
-    m4 transformation = {0};
-    m4_set(transformation, m4_unity);
-
-    /* Set the current linker program that should be used. */
-    glUseProgram(program_shader);
-
-    /* Set transformation matrix. */
-    size_t count = 1;
-    GLboolean transpose = GL_TRUE;
-
-    GLfloat * ptr_value = &transformation[0][0];
-
-    /* Bind the VAO that should be used. */
-    glBindVertexArray(vertex_array);
-
-    Display_Element_Data current_element;
-    /* Iterate over all the display entities. */
-    for (size_t i=0; i<NUM_ELEMENTS; i++) {
-        current_element = elements[i];
-
-        if (current_element.on == GL_FALSE) {
-            continue;
+typedef struct Options {
+    int tick_rate; /* Simulation ticks per second. */
+    size_t num_balls; /* Extra balls for the multi-ball mode. */
+    const char * path_record; /* Record the match here, if set. */
+    const char * path_replay; /* Play this match back, if set. */
+    bool networked; /* Host or join a match against a remote player. */
+    Netplay_Config netplay;
+    char join_host[256];
+    int swap_interval; /* Display refreshes per swap, 0 for no vsync. */
+    double pace; /* Frames per second to pace to, 0 to not pace. */
+    bool pace_auto; /* Pace to the display's refresh rate. */
+    bool frame_stats; /* Print frame time percentiles every second. */
+    bool sprites; /* Draw the frame as one batch of squares, not instanced. */
+    bool sprites_orphan; /* Stream the batch by orphaning, not a mapped ring. */
+    bool software; /* Rasterize on the CPU instead of the GPU. */
+    int software_threads; /* Threads rasterizing, the main one included. */
+    const char * path_capture; /* Capture the frames here, if set. */
+    bool ai; /* The computer plays the left paddle. */
+    int ai_reaction; /* Milliseconds before it reacts to a shot. */
+    int ai_error; /* Most pixels its aim is off by. */
+    bool mute; /* Play no sound. */
+} Options;
+
+
+void parse_options(Options * options, int argc, char ** argv) {
+    /* Fill 'options' from the command line, keeping defaults for anything
+     * not given. */
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "--tick-rate") == 0 && i+1 < argc) {
+            options->tick_rate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--balls") == 0 && i+1 < argc) {
+            options->num_balls = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--record") == 0 && i+1 < argc) {
+            options->path_record = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i+1 < argc) {
+            options->path_replay = argv[++i];
+        } else if (strcmp(argv[i], "--host") == 0 && i+1 < argc) {
+            options->netplay.port = atoi(argv[++i]);
+            options->networked = true;
+        } else if (strcmp(argv[i], "--join") == 0 && i+1 < argc &&
+                   net_parse_address(argv[i+1], options->join_host,
+                                     sizeof(options->join_host),
+                                     &options->netplay.port) == 0) {
+            options->netplay.host = options->join_host;
+            options->networked = true;
+            i++;
+        } else if (strcmp(argv[i], "--input-delay") == 0 && i+1 < argc) {
+            options->netplay.input_delay = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--net-delay") == 0 && i+1 < argc) {
+            options->netplay.conditions.delay = atof(argv[++i])/1000.0;
+        } else if (strcmp(argv[i], "--net-jitter") == 0 && i+1 < argc) {
+            options->netplay.conditions.jitter = atof(argv[++i])/1000.0;
+        } else if (strcmp(argv[i], "--net-loss") == 0 && i+1 < argc) {
+            options->netplay.conditions.loss = atof(argv[++i])/100.0;
+        } else if (strcmp(argv[i], "--swap-interval") == 0 && i+1 < argc) {
+            options->swap_interval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pace") == 0 && i+1 < argc) {
+            i++;
+            options->pace_auto = strcmp(argv[i], "auto") == 0;
+            options->pace = options->pace_auto ? 0.0 : atof(argv[i]);
+        } else if (strcmp(argv[i], "--frame-stats") == 0) {
+            options->frame_stats = true;
+        } else if (strcmp(argv[i], "--sprites") == 0) {
+            options->sprites = true;
+        } else if (strcmp(argv[i], "--sprites-orphan") == 0) {
+            options->sprites = true;
+            options->sprites_orphan = true;
+        } else if (strcmp(argv[i], "--software") == 0) {
+            options->software = true;
+        } else if (strcmp(argv[i], "--software-threads") == 0 && i+1 < argc) {
+            options->software = true;
+            options->software_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--capture") == 0 && i+1 < argc) {
+            options->path_capture = argv[++i];
+        } else if (strcmp(argv[i], "--ai") == 0) {
+            options->ai = true;
+        } else if (strcmp(argv[i], "--ai-reaction") == 0 && i+1 < argc) {
+            options->ai = true;
+            options->ai_reaction = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ai-error") == 0 && i+1 < argc) {
+            options->ai = true;
+            options->ai_error = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--mute") == 0) {
+            options->mute = true;
+        } else {
+            fprintf(stderr, "usage: %s [--tick-rate hz] [--balls n] "
+                            "[--record path] [--replay path]\n"
+                            "       [--host port | --join host:port] [--input-delay ticks]\n"
+                            "       [--net-delay ms] [--net-jitter ms] [--net-loss percent]\n"
+                            "       [--swap-interval n] [--pace hz|auto] [--frame-stats]\n"
+                            "       [--sprites | --sprites-orphan | --software]\n"
+                            "       [--software-threads n] [--capture path.y4m|prefix]\n"
+                            "       [--ai] [--ai-reaction ms] [--ai-error pixels] [--mute]\n",
+                    argv[0]);
+            exit(EXIT_FAILURE);
         }
-
-        /* Set transformation x value. */
-        GLfloat float_x = current_element.pos_x * delta_width;
-        transformation[0][3] = float_x;
-
-        /* Set transformation y value. */
-        GLfloat float_y = current_element.pos_y * delta_height;
-        transformation[1][3] = float_y;
-
-        /* Set the transformation data for drawing. */
-        glUniformMatrix4fv(uloc_transform, count, transpose, ptr_value);
-
-        /* Draw the vertices as triangles. */
-        glDrawArrays(GL_TRIANGLES, 0, s_vertices/3);
     }
 
-    /* Unset the shader program */
-    glUseProgram(0);
-
-    /* Unbind the vertex array. */
-    glBindVertexArray(0);
-}
-
-
-void render(Render_Data render_data, GLuint id_transformation, void * data,
-            size_t size_data) {
-    /* Take Render_Data object and id_transfomation and use the defined render
-     * function and supplied data to render the object. */
-    render_data.render_function(render_data.VAO,
-                                render_data.program_shader,
-                                render_data.size_data,
-                                render_data.uloc_transform,
-                                render_data.transformation_matrices[id_transformation],
-                                data,
-                                size_data);
-}
-
-
-void square(GLfloat * buffer, Item_Data item, Data_Environment env){
-    /* Populate vertices with data points corresponding to a square with
-     * width pixel_width and height pixel_height. */
-
-    /* Calculate pixel/screen-axis ratio. */
-    float half_width = item.width * env.delta_width * 0.5f;
-    float half_height = item.height * env.delta_height * 0.5f;
-
-    float temp_buffer[] = {
-        /* First triangle. */
-        -half_width, half_height, 1.0f,
-        -half_width,-half_height, 1.0f,
-         half_width, half_height, 1.0f,
-
-        /* Second triangle. */
-        +half_width,+half_height, 1.0f,
-        -half_width,-half_height, 1.0f,
-        +half_width,-half_height, 1.0f,
-    };
-
-    /* Copy values from temp_buffer to buffer. */
-    size_t temp_elements = SIZE(temp_buffer);
-    size_t index = 0;
-    for (size_t i=0; i<temp_elements; i++) {
-        index = i + item.offset*temp_elements;
-        buffer[index] = temp_buffer[i];
+    if (options->tick_rate <= 0) {
+        error("Tick rate must be positive.\n", true);
     }
-}
-
-
-typedef enum entities {
-    PADDLE,
-    BALL,
-    NUM_ENTITIES,
-} entities;
-
-
-void setup_display(Display * display,
-                   GLint pos_x,
-                   GLint pos_y,
-                   GLuint current_value,
-                   GLboolean left_aligned,
-                   Item_Data * items,
-                   Data_Environment * data_environment) {
-    /* Populate Display 'display' based on data from items. */
-
-    /* Get element data from items. */
-    Item_Data element_item = items[ID_BALL];
-    GLint width = element_item.width;
-    GLint height = element_item.height;
-
-    /* Calculate offset for the first top left element. */
-    GLfloat pos_base_x = pos_x + (float)width/2;
-    GLfloat pos_base_y = pos_y - (float)height/2;
-
-    /*  ^ y+
-     *  |
-     *   ---> x+
-     */
-
-    /* Construct offset table for 'elements' array. */
-    GLint display_width = 3;
-    GLint display_height = 5;
-    GLint index;
-    GLfloat pos_element_x, pos_element_y;
-    for (GLint i=0; i<display_height; i++) {
-        for (GLint j=0; j<display_width; j++) {
-            /* Calculate element index and offset. */
-            index = j + i*display_width;
-            pos_element_x = pos_base_x + width * j;
-            pos_element_y = pos_base_y - height * i;
-            /* Populate element at index. */
-            display->elements[index] = (Display_Element_Data){
-                .on = GL_TRUE, /* Currently always on. */
-                .pos_x = pos_element_x,
-                .pos_y = pos_element_y,
-            };
-        }
+    if (options->swap_interval < 0 || options->pace < 0.0) {
+        error("Swap interval and pace can not be negative.\n", true);
     }
-
-    /* Set up rest of display values. */
-    display->pos_x = pos_x;
-    display->pos_y = pos_y;
-    display->current_value = current_value;
-    display->left_aligned = left_aligned;
-    display->data_environment = data_environment;
-}
-
-
-void display_set(Display * display, GLint value) {
-    /* Set display to value given in 'value'. */
-
-    GLint numbers[][NUM_ELEMENTS] = {
-        /* 0 */
-       {1, 1, 1,
-        1, 0, 1,
-        1, 0, 1,
-        1, 0, 1,
-        1, 1, 1,},
-        /* 1 */
-       {0, 0, 1,
-        0, 0, 1,
-        0, 0, 1,
-        0, 0, 1,
-        0, 0, 1,},
-        /* 2 */
-       {1, 1, 1,
-        0, 0, 1,
-        1, 1, 1,
-        1, 0, 0,
-        1, 1, 1,},
-        /* 3 */
-       {1, 1, 1,
-        0, 0, 1,
-        1, 1, 1,
-        0, 0, 1,
-        1, 1, 1,},
-        /* 4 */
-       {1, 0, 1,
-        1, 0, 1,
-        1, 1, 1,
-        0, 0, 1,
-        0, 0, 1,},
-        /* 5 */
-       {1, 1, 1,
-        1, 0, 0,
-        1, 1, 1,
-        0, 0, 1,
-        1, 1, 1,},
-        /* 6 */
-       {1, 1, 1,
-        1, 0, 0,
-        1, 1, 1,
-        1, 0, 1,
-        1, 1, 1,},
-        /* 7 */
-       {1, 1, 1,
-        0, 0, 1,
-        0, 0, 1,
-        0, 1, 0,
-        1, 0, 0,},
-        /* 8 */
-       {1, 1, 1,
-        1, 0, 1,
-        1, 1, 1,
-        1, 0, 1,
-        1, 1, 1,},
-        /* 9 */
-       {1, 1, 1,
-        1, 0, 1,
-        1, 1, 1,
-        0, 0, 1,
-        1, 1, 1,},
-    };
-
-    GLint * num_list = numbers[value];
-    for (size_t i=0; i<NUM_ELEMENTS; i++) {
-        display->elements[i].on = num_list[i];
+    if (options->software_threads < 0) {
+        error("Software threads can not be negative.\n", true);
+    }
+    if (options->networked && (options->path_record || options->path_replay)) {
+        error("Networked matches can not be recorded or replayed.\n", true);
+    }
+    if (options->ai_reaction < 0 || options->ai_error < 0) {
+        error("Reaction time and aim error can not be negative.\n", true);
+    }
+    if (options->networked && options->ai) {
+        error("The computer can not play networked matches.\n", true);
     }
 }
 
 
-void  move_non_controlled_items(Event_Data events, Item_Data * items, Data_Environment env) {
-
-    m4 * transformation_matrices = events.transformation_matrices;
-
-    GLfloat * pos_ball_x = &transformation_matrices[ID_BALL][0][3];
-    GLfloat * pos_ball_y = &transformation_matrices[ID_BALL][1][3];
-//
-//    GLfloat * transform_ball = transformation_matrices[ID_BALL];
-//
-//    GLfloat * pos_ball_x = &transform_ball[3];
-//
-
-    GLfloat speed_ball_x = items[ID_BALL].speed.x;
-    GLfloat speed_ball_y = items[ID_BALL].speed.y;
-
-    printf("%f\n", speed_ball_x);
-
-    GLfloat width_ball = items[ID_BALL].width;
-    GLfloat height_ball = items[ID_BALL].height;
-
-    GLfloat ball_next_x = *pos_ball_x + speed_ball_x*env.delta_width;
-    GLfloat ball_next_y = *pos_ball_y + speed_ball_y*env.delta_height;
-
-//    GLfloat ball_next_x = *pos_ball_x + 0.001f;
-//    GLfloat ball_next_y = *pos_ball_y + 0.001f;
-
-    printf("ball_next_x: %f\n", ball_next_x);
-
-    if (ball_next_x > 1.0f) {
-        *pos_ball_x = 1.0f - (width_ball*env.delta_width)*0.5f;
-        items[ID_BALL].speed.x *= -1.0f;
-    } else if (ball_next_x < -1.0f) {
-        *pos_ball_x = -1.0f + (width_ball*env.delta_width)*0.5f;
-        items[ID_BALL].speed.x *= -1.0f;
-    } else {
-        *pos_ball_x = ball_next_x;
-    }
-}
+int main(int argc, char ** argv) {
 
+    Options options = {
+        .tick_rate = 120,
+        .swap_interval = 1,
+        .software_threads = 1,
+        .ai_reaction = 150,
+        .ai_error = 30,
+    };
+    parse_options(&options, argc, argv);
 
-int main(void) {
+    /* Time every step up to the first frame. */
+    Startup_Timing startup = {0};
+    startup_mark(&startup, "start");
 
     // ================================================================
     // == Window and context setup.
@@ -607,6 +308,7 @@ int main(void) {
     if(!glfwInit()) {
         error("Could not initialize GLFW.\n", true);
     }
+    startup_mark(&startup, "glfwInit");
 
     /* Window dimensions. */
     GLint WIDTH = 800;
@@ -625,14 +327,17 @@ int main(void) {
     if(!window) {
         error("Could not create a window.\n", true);
     }
+    startup_mark(&startup, "window");
 
     glfwSetKeyCallback(window, key_callback);
 
     glfwMakeContextCurrent(window);
+    glfwSwapInterval(options.swap_interval);
     glewExperimental = GL_TRUE;
     if(glewInit() != GLEW_OK) {
         error("Could not initialize glew.\n", true);
     }
+    startup_mark(&startup, "glewInit");
 
     /* Set clearing color. */
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
@@ -641,308 +346,510 @@ int main(void) {
     // == Data and matrix setup.
     // ================================================================
 
-    /* Create and populate environment data. */
-    Data_Environment data_environment = {
-        .width = WIDTH,
-        .height = HEIGHT,
-        .delta_width = 2.0f/WIDTH,
-        .delta_height = 2.0f/HEIGHT,
-    };
+    /* Create and populate the simulation state. */
+    Sim_State sim = {0};
+    sim_init(&sim, WIDTH, HEIGHT);
+    sim_set_tick_rate(&sim, options.tick_rate);
+
+    /* A replayed match starts from its recorded state and tick rate. */
+    Replay replay = {0};
+    Replay_Cursor replay_cursor;
+    if (options.path_replay) {
+        if (replay_open(&replay, options.path_replay) != 0) {
+            error("Could not open the replay.\n", true);
+        }
+        replay_start(&replay, &replay_cursor, &sim);
+    }
+
+    /* Recorded from the state the match starts in. The writer is static
+     * for the size of its buffer. */
+    static Replay_Writer replay_writer;
+    if (options.path_record &&
+        replay_writer_open(&replay_writer, options.path_record, &sim, 0) != 0) {
+        error("Could not open the recording.\n", true);
+    }
+
+    /* Positions at the previous tick, used for render interpolation. */
+    Sim_Vec positions_previous[ID_NUM];
+    memcpy(positions_previous, sim.positions, sizeof(positions_previous));
 
-    /* Create array with transformation matrices. */
-    m4 transformation_matrices[ID_NUM];
+    /* Grab environment and items from the simulation. */
+    Data_Environment data_environment = sim.env;
+    Item_Data * items = sim.items;
+
+    /* Create array with transformation matrices, one per object and the
+     * unity matrix last. */
+    m4 transformation_matrices[NUM_TRANSFORMS];
 
     /* Initialize all transformation matrices to unity matrix. */
-    for (size_t i=0; i<ID_NUM; i++) {
+    for (size_t i=0; i<NUM_TRANSFORMS; i++) {
         m4_set(transformation_matrices[i], m4_unity);
     }
 
     /* Set starting positions for each object. */
-    transformation_matrices[ID_PADDLE_RIGHT][0][3] = 0.8f;
-    transformation_matrices[ID_PADDLE_LEFT][0][3] = -0.8f;
-
-    /* Paddle dimensions in pixels. */
-    GLuint paddle_width = 20;
-    GLuint paddle_height = 50;
-    v3 paddle_speed = (v3){0.0f, 17.0f, 0.0f};
-    GLuint paddle_offset = 0;
-
-    /* Ball dimensions in pixels. */
-    GLuint ball_width = 15;
-    GLuint ball_height = 15;
-    GLfloat ball_speed_constant = 10.0f;
-    v3 ball_speed = (v3){ball_speed_constant, ball_speed_constant, 0.0f};
-    GLuint ball_offset = 1;
-
-    /* Create Item_Data list items */
-    Item_Data items[ID_NUM] = {0};
-
-    /* Set item data for right paddle. */
-    items[ID_PADDLE_RIGHT] = (Item_Data){
-        .width=paddle_width,
-        .height=paddle_height,
-        .speed=paddle_speed,
-        .offset=paddle_offset,
-    };
-
-    /* Set item data for left paddle. */
-    items[ID_PADDLE_LEFT] = (Item_Data){
-        .width=paddle_width,
-        .height=paddle_height,
-        .speed=paddle_speed,
-        .offset=paddle_offset,
-    };
-
-    /* Set item data for ball. */
-    items[ID_BALL] = (Item_Data){
-        .width=ball_width,
-        .height=ball_height,
-        .speed=ball_speed,
-        .offset=ball_offset,
-    };
+    sync_transformations(transformation_matrices, positions_previous, &sim, 1.0f);
 
     Event_Data event_data = {0};
     event_data.window = window;
-    event_data.transformation_matrices = &transformation_matrices[0];
 
-    /* Set up two two-digit displays for score-keeping. */
+    /* Set up two displays for score-keeping. */
     Display display_right = {0};
     Display display_left = {0};
 
-    /* Display data. */
-    GLint pos_display_x = 60;
-    GLint pos_display_y = 280;
-
-    GLuint etc_display_value = 3;
-    GLboolean etc_display_left_aligned = true;
-
-    /* Set up right display. */
-    setup_display(&display_right,
-                  pos_display_x,
-                  pos_display_y,
-                  etc_display_value,
-                  etc_display_left_aligned,
-                  items,
-                  &data_environment);
-    display_set(&display_right, 0);
-
-    /* Set up left display. */
-    setup_display(&display_left,
-                  -pos_display_x-3*ball_width,
-                  pos_display_y,
-                  etc_display_value,
-                  !etc_display_left_aligned,
-                  items,
-                  &data_environment);
-    display_set(&display_left, 2);
+    scene_displays(&display_right, &display_left, items, &data_environment);
+    startup_mark(&startup, "scene");
 
     // ================================================================
-    // == Buffers.
+    // == Shaders.
     // ================================================================
 
-    /* Calculate and store values related to vertices. */
-    size_t num_squares = 2;
-    size_t num_vertices = 6*num_squares;
-    size_t num_floats = 3*num_vertices;
-    size_t num_floats_in_square = num_floats/num_squares;
-
-    /* Create vertices. */
-    GLfloat vertices[num_floats];
-    square(vertices, items[ID_PADDLE_LEFT], data_environment);
-    square(vertices, items[ID_BALL], data_environment);
-
-    /* Create buffers. */
-    GLuint VBOs[NUM_ENTITIES];
-    GLuint VAOs[NUM_ENTITIES];
-
-    /* Generate empty vertex and buffer object. */
-    glGenVertexArrays(NUM_ENTITIES, VAOs);
-    glGenBuffers(NUM_ENTITIES, VBOs);
-
-    /* Set up main buffer object and populate. */
-
-    /* Bind array buffer. */
-    glBindBuffer(GL_ARRAY_BUFFER, VBOs[PADDLE]);
-
-    /* Populate buffer with data. */
-    glBufferData(GL_ARRAY_BUFFER, num_floats*sizeof(GLfloat), vertices, GL_STATIC_DRAW);
-
-    /* Unbind buffer object. */
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-    /* Set up the different Vertex Array Objects. */
-
-    /* Set up binds for PADDLE VAO object. */
-    glBindBuffer(GL_ARRAY_BUFFER, VBOs[PADDLE]);
-
-    /* Bind PADDLE vertex array object. */
-    glBindVertexArray(VAOs[PADDLE]);
-
-    /* Set vertex attribute pointer for position attribute. */
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(GLfloat), (GLvoid*)0);
-
-    /* Enable vertex attribute location pointer. */
-    glEnableVertexAttribArray(0);
-
-    /* Unbind buffer object. */
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-    /* Unbind vertex array object. */
-    glBindVertexArray(0);
-
-    /* Set up binds for BALL VAO object. */
-
-    /* Bind BALL vertex array object. */
-    glBindVertexArray(VAOs[BALL]);
+    /* Set up shader program. */
+    GLuint program_shader = glCreateProgram();
 
-    /* Re-use the PADDLE VBO since it contains alla data. */
-    glBindBuffer(GL_ARRAY_BUFFER, VBOs[PADDLE]);
+    /* Load the program from the cache when this driver built it from these
+     * sources before, and build it and cache it otherwise. */
+    const GLchar * sources[] = {source_vertex_shader, source_fragment_shader};
+    bool cache = shader_cache_available();
+    uint64_t cache_key = cache ? shader_cache_key(sources, SIZE(sources)) : 0;
+    bool cached = cache &&
+                  shader_cache_load(SHADER_CACHE_PATH, program_shader, cache_key) == 0;
+
+    if (!cached) {
+        /* Ask for a binary that can be cached. */
+        if (cache) {
+            glProgramParameteri(program_shader, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
 
-    /* Set vertex attribute pointer for position at an offset. */
-    size_t offset_bytes = BALL * num_floats_in_square * sizeof(GLfloat);
-    GLvoid * ptr_offset = (GLvoid *)offset_bytes;
+        /* Compile the shaders and link them into the program. */
+        size_t s_buffer_info = 1024;
+        GLchar buffer_info[s_buffer_info];
+        GLint success = program_build(program_shader, buffer_info, s_buffer_info);
+        if (!success) {
+            error("Error building the shader program:\n", false);
+            error(buffer_info, false);
+        }
 
-    /* Set vertex attribute pointer for position at an offset. */
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(GLfloat), ptr_offset);
+        /* Keep the binary for the next start. */
+        if (success && cache &&
+            shader_cache_store(SHADER_CACHE_PATH, program_shader, cache_key) != 0) {
+            error("Could not write the shader cache.\n", false);
+        }
+    }
+    startup_mark(&startup, cached ? "shaders (cached)" : "shaders");
 
-    /* Enable vertex attribute pointer. */
-    glEnableVertexAttribArray(0);
+    /* Read the transformation matrices from the uniform buffer ring. */
+    GLuint uindex_transform = glGetUniformBlockIndex(program_shader, "Transform");
+    glUniformBlockBinding(program_shader, uindex_transform, TRANSFORMS_BINDING);
 
-    /* Unbind vertex and buffer array. */
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    Transform_Ring transforms;
+    if (transform_ring_init(&transforms, NUM_TRANSFORMS) != 0) {
+        error("Could not create the transformation buffer.\n", true);
+    }
 
     // ================================================================
-    // == Shaders.
+    // == Buffers.
     // ================================================================
 
-    /* Create variables for fragment and vertex shader. */
-    GLuint shader_fragment, shader_vertex;
-
-    /* Create storage for shaders. */
-    shader_vertex = glCreateShader(GL_VERTEX_SHADER);
-    shader_fragment = glCreateShader(GL_FRAGMENT_SHADER);
-
-    /* Bind shader sources. */
-    glShaderSource(shader_vertex, 1, &source_vertex_shader, 0);
-    glShaderSource(shader_fragment, 1, &source_fragment_shader, 0);
-
-    /* Compile shaders. */
-    GLint success;
-    size_t s_buffer_info = 1024;
-    GLchar buffer_info[s_buffer_info];
+    /* Set up batch of displays drawn with one instanced call. */
+    Display_Batch display_batch = {
+        .displays = {&display_right, &display_left},
+    };
 
-    /* Compile vertex shader and print errors. */
-    success = shader_compile(shader_vertex, buffer_info , s_buffer_info);
-    if (!success) {
-        error("Error in vertex shader:\n", false);
-        error(buffer_info, false);
+    /* Set up the multi-ball store. */
+    Ball_Batch ball_batch = {0};
+    if (options.num_balls > 0) {
+        if (balls_init(&ball_batch.balls, options.num_balls) != 0 ||
+            collide_grid_init_arena(&ball_batch.grid, &sim,
+                                    ball_batch.balls.capacity) != 0) {
+            error("Could not allocate balls.\n", true);
+        }
+        balls_spawn(&ball_batch.balls, options.num_balls, &sim, 1);
     }
 
-    /* Compile fragment shader and print errors. */
-    success = shader_compile(shader_fragment, buffer_info , s_buffer_info);
-    if (!success) {
-        error("Error in fragment shader:\n", false);
-        error(buffer_info, false);
+    /* Vertex arrays of the paddles, the ball, the extra balls and the
+     * displays, each reading its matrices from the ring. */
+    Draws draws;
+    if (draws_init(&draws, &sim, program_shader, &transforms, &display_batch,
+                   &ball_batch, options.num_balls) != 0) {
+        error("Could not create the vertex buffers.\n", true);
     }
-
-    /* Set up shader program. */
-    GLuint program_shader = glCreateProgram();
-
-    /* Make shader list */
-    GLuint shaders[] = {shader_vertex, shader_fragment};
-
-    /* Attach shaders to shader program and link. */
-    success = program_link(program_shader,
-                           shaders,
-                           SIZE(shaders),
-                           buffer_info,
-                           s_buffer_info);
-
-    if(!success) {
-        error("Error at program linkage:\n", false);
-        error(buffer_info, false);
+    startup_mark(&startup, "buffers");
+
+    /* Stream for drawing the whole frame as one batch of squares, room for
+     * the paddles, the ball, the extra balls and every display cell. */
+    Sprite_Stream sprite_stream = {0};
+    if (options.sprites) {
+        size_t capacity = 3 + options.num_balls + MAX_DISPLAYS*DISPLAY_MAX_CELLS;
+        if (sprite_stream_init(&sprite_stream, capacity, !options.sprites_orphan) != 0 &&
+            sprite_stream_init(&sprite_stream, capacity, 0) != 0) {
+            error("Could not create the sprite stream.\n", true);
+        }
+        transform_ring_attach(&transforms, sprite_stream.vertex_array, TRANSFORM_UNITY, 0);
     }
 
-    /* Delete linked shaders. */
-    shaders_delete(shaders, SIZE(shaders));
+    /* CPU framebuffer of the window's size for the software backend, shown
+     * by blitting a texture that it is copied into. */
+    static Software_Frame software;
+    if (options.software) {
+        software.capacity = 3 + options.num_balls + MAX_DISPLAYS*DISPLAY_MAX_CELLS;
+        software.vertices = malloc(software.capacity*SPRITE_FLOATS*sizeof(float));
+        if (!software.vertices ||
+            raster_init(&software.raster, WIDTH, HEIGHT, options.software_threads) != 0) {
+            error("Could not allocate the software framebuffer.\n", true);
+        }
+        glfwGetFramebufferSize(window, &software.width, &software.height);
+
+        glGenTextures(1, &software.texture);
+        glBindTexture(GL_TEXTURE_2D, software.texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, WIDTH, HEIGHT, 0,
+                     GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, NULL);
+        glGenFramebuffers(1, &software.framebuffer);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, software.framebuffer);
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                               GL_TEXTURE_2D, software.texture, 0);
+        if (glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            error("Could not set up the software framebuffer.\n", true);
+        }
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    }
 
-    /* Get vertex shader transformation location. */
-    GLuint uloc_transform = glGetUniformLocation(program_shader, "transform");
+    /* Draws go through the queue and the state cache from here on. */
+    static Render_Queue render_queue;
+    Gl_State gl_state = {0};
+    gl_state_reset(&gl_state);
+    startup_mark(&startup, "render setup");
 
     // ================================================================
     // == Set up render data.
     // ================================================================
 
-    /* Set up render information. */
-    Render_Data * render_data[NUM_ENTITIES];
-
-    /* Set up render data for paddles. */
-    Render_Data data_render_paddle = (Render_Data){
-        .VAO = VAOs[PADDLE],
-        .program_shader = program_shader,
-        .size_data = num_floats*sizeof(GLfloat),
-        .uloc_transform = uloc_transform,
-        .transformation_matrices = transformation_matrices,
-        .render_function = &render_basic,
+    /* Set up render data for the software backend.*/
+    Render_Data data_render_software = (Render_Data){
+        .render_function = &render_software,
     };
 
-    /* Set up render data for ball.*/
-    Render_Data data_render_ball= (Render_Data){
-        .VAO = VAOs[BALL],
+    /* Set up render data for the sprite batcher.*/
+    Render_Data data_render_sprites = (Render_Data){
+        .VAO = sprite_stream.vertex_array,
         .program_shader = program_shader,
-        .size_data = num_floats*sizeof(GLfloat),
-        .uloc_transform = uloc_transform,
-        .transformation_matrices = transformation_matrices,
-        .render_function = &render_basic,
-    };
-
-    /* Set up render data for displays.*/
-    Render_Data data_render_display = (Render_Data){
-        .VAO = VAOs[BALL],
-        .program_shader = program_shader,
-        .size_data = num_floats*sizeof(GLfloat),
-        .uloc_transform = uloc_transform,
-        .transformation_matrices = transformation_matrices,
-        .render_function = &render_display,
+        .render_function = &render_sprites,
     };
 
     // ================================================================
     // == Main loop.
     // ================================================================
 
+    /* A networked match starts once the peer is there, with the left paddle
+     * played by the remote player when hosting and the right one when
+     * joining. */
+    Netplay netplay = {0};
+    if (options.networked) {
+        if (netplay_open(&netplay, &options.netplay, &sim) != 0) {
+            error("Could not open the connection.\n", true);
+        }
+        int status;
+        while ((status = netplay_connect(&netplay, glfwGetTime())) == 0 &&
+               !glfwWindowShouldClose(window)) {
+            glfwWaitEventsTimeout(NETPLAY_HELLO_INTERVAL/10);
+            keys_apply(glfwGetTime(), glfwGetTime());
+            react_to_events_keys(event_data);
+        }
+        if (status < 0) {
+            error("The peer plays with other settings.\n", true);
+        }
+        startup_mark(&startup, "netplay connect");
+    }
+
+    /* Pace frames to the display when asked to, one frame per swap
+     * interval. */
+    double pace = options.pace;
+    if (options.pace_auto) {
+        const GLFWvidmode * mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+        int interval = options.swap_interval > 1 ? options.swap_interval : 1;
+        pace = mode ? (double)mode->refreshRate/interval : 0.0;
+    }
+    Pacer pacer;
+    pacer_init(&pacer, pace, options.swap_interval > 0);
+
+    /* Read every frame back into a video or a sequence of images, at the
+     * paced rate if there is one. */
+    static Capture capture;
+    if (options.path_capture) {
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        if (capture_open(&capture, options.path_capture, width, height,
+                         pace > 0.0 ? (int)(pace + 0.5) : 60) != 0) {
+            error("Could not start the capture.\n", true);
+        }
+    }
+
+    /* Play the sound effects on their own thread. The game goes on silent
+     * without a sound device. */
+    static Audio audio;
+    if (!options.mute &&
+        audio_open(&audio, AUDIO_SAMPLE_RATE, AUDIO_FRAMES) != 0) {
+        error("Could not open the sound device, playing without sound.\n", false);
+        options.mute = true;
+    }
+
+    /* The computer opponent, its reaction time in ticks of the match. */
+    Ai ai;
+    Ai_Config ai_config = {
+        .paddle = ID_PADDLE_LEFT,
+        .reaction_ticks = (uint32_t)((int64_t)options.ai_reaction*sim.tick_rate/1000),
+        .error = options.ai_error,
+        .seed = 1,
+    };
+    ai_init(&ai, &ai_config);
+
+    /* Set up the fixed-timestep scheduler. */
+    Timestep timestep;
+    timestep_init(&timestep, sim.tick_rate, glfwGetTime());
+
     while(!glfwWindowShouldClose(window)) {
 
+        TRACE_BEGIN("frame");
+
+        /* Sleep until as late as the frame can still make its deadline, so
+         * the input polled next is as fresh as it can be. */
+        TRACE_BEGIN("wait");
+        pacer_wait(&pacer);
+        TRACE_END("wait");
+
         /* Poll for events. */
+        TRACE_BEGIN("poll");
         glfwPollEvents();
+        TRACE_END("poll");
 
-        /* React to polled events. */
-        react_to_events(event_data, items, data_environment);
+        /* Take in the remote inputs, which may correct past ticks. */
+        if (options.networked) {
+            netplay_poll(&netplay, glfwGetTime());
+            sim = netplay.session.state;
+        }
 
-        /* Move the world. */
-        move_non_controlled_items(event_data, items, data_environment);
+        /* Move the world in fixed ticks for the time that has passed. */
+        TRACE_BEGIN("physics");
+        double time_frame = glfwGetTime();
+        int num_ticks = timestep_advance(&timestep, time_frame);
+        for (int i=0; i<num_ticks; i++) {
+            /* Apply the key events from before the end of this tick, and on
+             * the last tick all that have arrived, so no tick waits on a
+             * later frame. */
+            double time_until = i+1 < num_ticks ?
+                                timestep_tick_end(&timestep, num_ticks, i) : time_frame;
+            keys_apply(time_until, glfwGetTime());
+            Sim_Input tick_input = react_to_events_keys(event_data);
+
+            /* The computer moves the left paddle, which no key does. */
+            if (options.ai) {
+                tick_input |= ai_input(&ai, &sim);
+            }
+
+            /* The arrow keys steer the local paddle, which is the left one
+             * when joining a match. */
+            if (options.networked && !netplay.hosting) {
+                tick_input = (tick_input & INPUT_RIGHT_UP ? INPUT_LEFT_UP : 0) |
+                             (tick_input & INPUT_RIGHT_DOWN ? INPUT_LEFT_DOWN : 0);
+            }
+
+            /* A replay supplies the input of every tick and ends the game
+             * when it runs out. */
+            if (options.path_replay && !replay_next(&replay_cursor, &tick_input)) {
+                glfwSetWindowShouldClose(window, GL_TRUE);
+                break;
+            }
+            if (options.path_record) {
+                replay_writer_tick(&replay_writer, &sim, tick_input);
+            }
+
+            memcpy(positions_previous, sim.positions, sizeof(positions_previous));
+            int ticked = 1;
+            if (options.networked) {
+                ticked = netplay_tick(&netplay, tick_input, glfwGetTime());
+                sim = netplay.session.state;
+            } else {
+                sim_step(&sim, tick_input);
+            }
+
+            /* A tick held back keeps the events of the last one. */
+            if (ticked) {
+                audio_post(&audio, sim.events);
+            }
+            if (ball_batch.balls.count > 0) {
+                Collide_Box paddles[2];
+                size_t num_paddles = collide_paddles(&sim, paddles);
+                balls_step(&ball_batch.balls);
+                collide_balls(&ball_batch.grid, &ball_batch.balls,
+                              paddles, num_paddles, NULL);
+            }
+        }
+
+        /* Show the current score, in as many digits as it takes. */
+        display_set(&display_right, sim.score[ID_PADDLE_RIGHT]);
+        display_set(&display_left, sim.score[ID_PADDLE_LEFT]);
+        TRACE_COUNTER("ticks", num_ticks);
+        if (options.networked) {
+            TRACE_COUNTER("ticks resimulated", netplay.session.stats.ticks_resimulated);
+        }
+        TRACE_END("physics");
+
+        /* Place objects between the last two ticks. */
+        sync_transformations(transformation_matrices,
+                             positions_previous,
+                             &sim,
+                             timestep_alpha(&timestep));
+
+        /* Hand this frame's matrices to the GPU in one go. */
+        TRACE_BEGIN("upload transforms");
+        if (transform_ring_upload(&transforms, transformation_matrices) != 0) {
+            error("Could not map the transformation buffer.\n", true);
+        }
+        TRACE_COUNTER("transform waits", transforms.waits);
+        TRACE_END("upload transforms");
 
         /* Clear screen. */
+        TRACE_BEGIN("clear");
         glClear(GL_COLOR_BUFFER_BIT);
+        TRACE_END("clear");
 
-        /* Render the right paddle. */
-        render(data_render_paddle, ID_PADDLE_RIGHT, (void*)0, 0);
+        TRACE_BEGIN("render");
+        gl_state_frame(&gl_state);
 
-        /* Render the left paddle. */
-        render(data_render_paddle, ID_PADDLE_LEFT, (void*)0, 0);
+        /* Every draw reads this frame's matrices. */
+        if (!options.software) {
+            transform_ring_bind(&transforms, &gl_state);
+        }
 
-        /* Render the ball. */
-        render(data_render_ball, ID_BALL, (void*)0, 0);
+        if (options.software) {
+            /* Collect every square and rasterize them on the CPU. */
+            sprite_batch_begin(&software.batch, software.vertices, software.capacity);
+            sprites_build(&software.batch, transformation_matrices, &sim,
+                          &ball_batch, &display_batch, MAX_DISPLAYS);
+            render(&render_queue, data_render_software,
+                   (void*)&software, software.batch.count);
+        } else if (options.sprites) {
+            /* Write every square into the stream and draw them at once. */
+            Sprite_Batch sprite_batch;
+            if (sprite_stream_begin(&sprite_stream, &gl_state, &sprite_batch) != 0) {
+                error("Could not map the sprite stream.\n", true);
+            }
+            sprites_build(&sprite_batch, transformation_matrices, &sim,
+                          &ball_batch, &display_batch, MAX_DISPLAYS);
+            sprite_stream_end(&sprite_stream, &gl_state, &sprite_batch);
+            render(&render_queue, data_render_sprites,
+                   (void*)&sprite_stream, sprite_batch.count);
+        } else {
+            /* Render the paddles, the balls and the displays. */
+            draws_queue(&draws, &render_queue, &display_batch, &ball_batch);
+        }
 
-        /* Render right display. */
-        render(data_render_display, ID_DISPLAY_RIGHT, (void*)&display_right,
-               NUM_ELEMENTS);
+        /* Draw everything, sorted by state. */
+        render_queue_submit(&render_queue, &gl_state);
+        TRACE_COUNTER("gl calls", gl_state.frame.calls);
+        TRACE_COUNTER("gl calls skipped", gl_state.frame.skipped);
+        TRACE_END("render");
+
+        /* Start reading the frame back before it is swapped away. */
+        if (options.path_capture) {
+            TRACE_BEGIN("capture");
+            capture_frame(&capture);
+            TRACE_END("capture");
+        }
 
-        /* Render left display. */
-        render(data_render_display, ID_DISPLAY_LEFT, (void*)&display_left,
-               NUM_ELEMENTS);
+        /* Keep this frame's matrices and squares until the GPU has drawn
+         * it. */
+        transform_ring_fence(&transforms);
+        sprite_stream_fence(&sprite_stream);
 
         /* Swap buffers. */
+        TRACE_BEGIN("swap");
+        pacer_rendered(&pacer);
         glfwSwapBuffers(window);
+        input_latency_swapped(&input_latency, glfwGetTime());
+        TRACE_END("swap");
+
+        /* Report where the time to the first frame went. */
+        if (pacer.frames == 0) {
+            startup_mark(&startup, "first frame");
+            startup_print(&startup, stdout);
+        }
+
+        /* Keep track of how evenly frames arrive. */
+        int window_done = pacer_swapped(&pacer);
+        TRACE_COUNTER("frame us", (int64_t)(pacer.frame_last*1e6));
+        if (window_done) {
+            TRACE_COUNTER("frame p50 us",
+                          (int64_t)(histogram_percentile(&pacer.window, 0.5)*1e6));
+            TRACE_COUNTER("frame p99 us",
+                          (int64_t)(histogram_percentile(&pacer.window, 0.99)*1e6));
+            TRACE_COUNTER("frame p99.9 us",
+                          (int64_t)(histogram_percentile(&pacer.window, 0.999)*1e6));
+            if (options.frame_stats) {
+                histogram_print(&pacer.window, "frame time", stdout);
+            }
+            pacer_window_reset(&pacer);
+        }
+
+        TRACE_END("frame");
+
+        /* Dump the trace on demand. */
+        if (map_keys_pressed[GLFW_KEY_F12]) {
+            map_keys_pressed[GLFW_KEY_F12] = false;
+            TRACE_DUMP(TRACE_PATH);
+        }
+    }
+
+    /* Keep the last frames around for inspection. */
+    TRACE_DUMP(TRACE_PATH);
+
+    /* Report how long the paddle keys took to reach the screen, and how
+     * evenly the frames did. */
+    input_latency_print(&input_latency, stdout);
+    histogram_print(&pacer.frame_times, "frame time", stdout);
+    printf("deadlines missed: %llu\n", (unsigned long long)pacer.deadlines_missed);
+
+    /* Report how many GL calls drawing took, and how many the state cache
+     * saved. */
+    gl_state_frame(&gl_state);
+    if (gl_state.frames > 1) {
+        double frames = gl_state.frames - 1;
+        printf("gl calls per frame: %.1f made, %.1f skipped, %.1f draws\n",
+               gl_state.total.calls/frames, gl_state.total.skipped/frames,
+               gl_state.total.draws/frames);
+    }
+
+    if (options.path_record && replay_writer_close(&replay_writer) != 0) {
+        error("Could not write the recording.\n", false);
+    }
+    replay_close(&replay);
+    if (options.networked) {
+        netplay_close(&netplay);
+    }
+    if (options.sprites) {
+        sprite_stream_free(&sprite_stream);
+    }
+    if (options.software) {
+        raster_free(&software.raster);
+        free(software.vertices);
+        glDeleteFramebuffers(1, &software.framebuffer);
+        glDeleteTextures(1, &software.texture);
+    }
+    if (options.path_capture) {
+        if (capture_close(&capture) != 0) {
+            error("Could not write every captured frame.\n", false);
+        }
+        histogram_print(&capture.overhead, "capture time", stdout);
+        printf("frames captured: %llu, dropped %llu, readbacks waited for %llu\n",
+               (unsigned long long)capture.stats.frames,
+               (unsigned long long)capture.stats.dropped,
+               (unsigned long long)capture.stats.waits);
+    }
+    if (!options.mute) {
+        if (audio_close(&audio) != 0) {
+            error("Could not stop the sound.\n", false);
+        }
+        audio_print(&audio, stdout);
     }
+    draws_free(&draws, &display_batch, &ball_batch);
+    transform_ring_free(&transforms);
 }
@@ -0,0 +1,324 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RASTER_X86 1
+#endif
+
+#include "raster.h"
+
+
+// ================================================================
+// == Span fills.
+// ================================================================
+
+static void span_fill_scalar(uint32_t * pixels, int count, uint32_t color) {
+    for (int i=0; i<count; i++) {
+        pixels[i] = color;
+    }
+}
+
+
+#ifdef RASTER_X86
+
+static void span_fill_sse(uint32_t * pixels, int count, uint32_t color) {
+    /* SSE2 fill, 4 pixels per store. */
+    const __m128i value = _mm_set1_epi32((int)color);
+    int i = 0;
+    for (; i+4<=count; i+=4) {
+        _mm_storeu_si128((__m128i *)(pixels + i), value);
+    }
+    span_fill_scalar(pixels + i, count - i, color);
+}
+
+
+__attribute__((target("avx2")))
+static void span_fill_avx2(uint32_t * pixels, int count, uint32_t color) {
+    /* AVX2 fill, 8 pixels per store, two at a time for wide spans. */
+    const __m256i value = _mm256_set1_epi32((int)color);
+    int i = 0;
+    for (; i+16<=count; i+=16) {
+        _mm256_storeu_si256((__m256i *)(pixels + i), value);
+        _mm256_storeu_si256((__m256i *)(pixels + i + 8), value);
+    }
+    for (; i+8<=count; i+=8) {
+        _mm256_storeu_si256((__m256i *)(pixels + i), value);
+    }
+    if (i+4 <= count) {
+        _mm_storeu_si128((__m128i *)(pixels + i), _mm256_castsi256_si128(value));
+        i += 4;
+    }
+    span_fill_scalar(pixels + i, count - i, color);
+}
+
+#endif
+
+
+/* The widest fill the CPU supports, picked by raster_init. */
+static void (* span_fill)(uint32_t *, int, uint32_t) = span_fill_scalar;
+
+
+// ================================================================
+// == Bands.
+// ================================================================
+
+static int num_tiles(const Raster * raster) {
+    return (raster->target.height + RASTER_TILE_ROWS - 1)/RASTER_TILE_ROWS;
+}
+
+
+static void draw_tile(const Raster * raster, int tile) {
+    /* Clear and fill the rows of band 'tile'. */
+
+    const Raster_Target * target = &raster->target;
+    int y_begin = tile*RASTER_TILE_ROWS;
+    int y_end = y_begin + RASTER_TILE_ROWS;
+    if (y_end > target->height) {
+        y_end = target->height;
+    }
+
+    /* The rows of a band are contiguous, so clearing is one span. */
+    span_fill(target->pixels + (size_t)y_begin*target->width,
+              (y_end - y_begin)*target->width, raster->background);
+
+    for (size_t i=0; i<raster->num_rects; i++) {
+        const Raster_Rect * rect = &raster->rects[i];
+        int y0 = rect->y0 > y_begin ? rect->y0 : y_begin;
+        int y1 = rect->y1 < y_end ? rect->y1 : y_end;
+        if (y0 >= y1) {
+            continue;
+        }
+        uint32_t * row = target->pixels + (size_t)y0*target->width + rect->x0;
+        for (int y=y0; y<y1; y++) {
+            span_fill(row, rect->x1 - rect->x0, raster->color);
+            row += target->width;
+        }
+    }
+}
+
+
+static void draw_tiles(Raster * raster) {
+    /* Draw bands until there are none left. */
+    int count = num_tiles(raster);
+    int tile;
+    while ((tile = atomic_fetch_add_explicit(&raster->next_tile, 1,
+                                             memory_order_relaxed)) < count) {
+        draw_tile(raster, tile);
+    }
+}
+
+
+static void * worker_main(void * argument) {
+    /* Draw bands of every frame started, until told to quit. */
+
+    Raster * raster = argument;
+    uint64_t seen = 0;
+
+    pthread_mutex_lock(&raster->lock);
+    for (;;) {
+        while (!raster->quit && raster->generation == seen) {
+            pthread_cond_wait(&raster->wake, &raster->lock);
+        }
+        if (raster->quit) {
+            break;
+        }
+        seen = raster->generation;
+        pthread_mutex_unlock(&raster->lock);
+
+        draw_tiles(raster);
+
+        pthread_mutex_lock(&raster->lock);
+        if (--raster->busy == 0) {
+            pthread_cond_signal(&raster->done);
+        }
+    }
+    pthread_mutex_unlock(&raster->lock);
+    return NULL;
+}
+
+
+// ================================================================
+// == Frames.
+// ================================================================
+
+int raster_init(Raster * raster, int width, int height, int num_threads) {
+    /* Create a 'width' by 'height' framebuffer drawn by 'num_threads'
+     * threads, the caller of raster_draw included. Returns 0 on success,
+     * -1 on failure. */
+
+    memset(raster, 0, sizeof(*raster));
+    if (width <= 0 || height <= 0) {
+        return -1;
+    }
+
+#ifdef RASTER_X86
+    span_fill = __builtin_cpu_supports("avx2") ? span_fill_avx2 : span_fill_sse;
+#endif
+
+    raster->target.width = width;
+    raster->target.height = height;
+    raster->target.pixels = malloc((size_t)width*height*sizeof(uint32_t));
+    if (!raster->target.pixels) {
+        return -1;
+    }
+
+    if (num_threads > RASTER_MAX_THREADS) {
+        num_threads = RASTER_MAX_THREADS;
+    }
+    pthread_mutex_init(&raster->lock, NULL);
+    pthread_cond_init(&raster->wake, NULL);
+    pthread_cond_init(&raster->done, NULL);
+    for (int i=0; i<num_threads-1; i++) {
+        if (pthread_create(&raster->threads[i], NULL, worker_main, raster) != 0) {
+            break;
+        }
+        raster->num_workers++;
+    }
+    return 0;
+}
+
+
+void raster_free(Raster * raster) {
+    pthread_mutex_lock(&raster->lock);
+    raster->quit = 1;
+    pthread_cond_broadcast(&raster->wake);
+    pthread_mutex_unlock(&raster->lock);
+    for (int i=0; i<raster->num_workers; i++) {
+        pthread_join(raster->threads[i], NULL);
+    }
+    pthread_cond_destroy(&raster->done);
+    pthread_cond_destroy(&raster->wake);
+    pthread_mutex_destroy(&raster->lock);
+    free(raster->rects);
+    free(raster->target.pixels);
+    memset(raster, 0, sizeof(*raster));
+}
+
+
+static float snap(float edge) {
+    /* Snap an edge, in pixels, to RASTER_SUBPIXELS as GPUs snap vertices,
+     * so that edges through pixel centers fall the same way. */
+    return roundf(edge*RASTER_SUBPIXELS)/RASTER_SUBPIXELS;
+}
+
+
+static int first_column(float edge) {
+    /* The first column whose center is at or right of 'edge'. */
+    return (int)ceilf(snap(edge) - 0.5f);
+}
+
+
+static int first_row(float edge) {
+    /* The first row whose center is below 'edge'. A center on the edge
+     * goes to the row above, since GL's window rows count up from the
+     * bottom and the edge is the top one there. */
+    return (int)floorf(snap(edge) + 0.5f);
+}
+
+
+static int rects_from_batch(Raster * raster, const Sprite_Batch * batch) {
+    /* Turn the squares of 'batch' into the pixels they cover, clipped to the
+     * framebuffer. Returns 0 on success, -1 if out of memory. */
+
+    if (batch->count > raster->capacity_rects) {
+        Raster_Rect * rects = realloc(raster->rects, batch->count*sizeof(*rects));
+        if (!rects) {
+            return -1;
+        }
+        raster->rects = rects;
+        raster->capacity_rects = batch->count;
+    }
+
+    /* Pixels whose centers are inside, as the GPU would have it. */
+    float scale_x = 0.5f*raster->target.width;
+    float scale_y = 0.5f*raster->target.height;
+    int width = raster->target.width;
+    int height = raster->target.height;
+
+    raster->num_rects = 0;
+    for (size_t i=0; i<batch->count; i++) {
+        const float * vertex = batch->vertices + i*SPRITE_FLOATS;
+        float left = vertex[0];
+        float top = vertex[1];
+        float right = vertex[10];
+        float bottom = vertex[11];
+
+        Raster_Rect rect = {
+            .x0 = first_column((left + 1.0f)*scale_x),
+            .x1 = first_column((right + 1.0f)*scale_x),
+            .y0 = first_row((1.0f - top)*scale_y),
+            .y1 = first_row((1.0f - bottom)*scale_y),
+        };
+        rect.x0 = rect.x0 < 0 ? 0 : rect.x0;
+        rect.y0 = rect.y0 < 0 ? 0 : rect.y0;
+        rect.x1 = rect.x1 > width ? width : rect.x1;
+        rect.y1 = rect.y1 > height ? height : rect.y1;
+        if (rect.x0 < rect.x1 && rect.y0 < rect.y1) {
+            raster->rects[raster->num_rects++] = rect;
+        }
+    }
+    return 0;
+}
+
+
+void raster_draw(Raster * raster, const Sprite_Batch * batch,
+                 uint32_t background, uint32_t color) {
+    /* Draw the squares of 'batch' in 'color' on 'background'. */
+
+    raster->background = background;
+    raster->color = color;
+    if (rects_from_batch(raster, batch) != 0) {
+        raster->num_rects = 0;
+    }
+    atomic_store_explicit(&raster->next_tile, 0, memory_order_relaxed);
+
+    if (raster->num_workers == 0) {
+        draw_tiles(raster);
+        return;
+    }
+
+    /* Start the workers, draw along and wait for the last band. */
+    pthread_mutex_lock(&raster->lock);
+    raster->busy = raster->num_workers;
+    raster->generation++;
+    pthread_cond_broadcast(&raster->wake);
+    pthread_mutex_unlock(&raster->lock);
+
+    draw_tiles(raster);
+
+    pthread_mutex_lock(&raster->lock);
+    while (raster->busy > 0) {
+        pthread_cond_wait(&raster->done, &raster->lock);
+    }
+    pthread_mutex_unlock(&raster->lock);
+}
+
+
+int raster_write_ppm(const Raster_Target * target, FILE * file) {
+    /* Write the framebuffer as a binary PPM. Returns 0 on success, -1 on
+     * failure. */
+
+    if (fprintf(file, "P6\n%d %d\n255\n", target->width, target->height) < 0) {
+        return -1;
+    }
+    unsigned char * row = malloc((size_t)target->width*3);
+    if (!row) {
+        return -1;
+    }
+    int result = 0;
+    for (int y=0; y<target->height && result == 0; y++) {
+        const uint32_t * pixels = target->pixels + (size_t)y*target->width;
+        for (int x=0; x<target->width; x++) {
+            row[3*x+0] = pixels[x] >> 16 & 0xff;
+            row[3*x+1] = pixels[x] >> 8 & 0xff;
+            row[3*x+2] = pixels[x] & 0xff;
+        }
+        if (fwrite(row, 3, target->width, file) != (size_t)target->width) {
+            result = -1;
+        }
+    }
+    free(row);
+    return result;
+}
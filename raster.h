@@ -0,0 +1,78 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "sprites.h"
+
+/* Software rasterizer for frames made of axis-aligned squares, such as a
+ * Sprite_Batch, for machines without a GPU and for dumping frames to disk.
+ *
+ * A square covers the pixels whose centers it contains, filled a row at a
+ * time with the widest stores the CPU has. The framebuffer is cut into
+ * bands of RASTER_TILE_ROWS rows, each cleared and filled by itself so
+ * that it stays in cache, and with threads the bands are taken from a
+ * shared counter by the calling thread and the workers alike.
+ *
+ * Pixels are 0xAARRGGBB, top row first. */
+
+
+/* Rows per band. */
+#define RASTER_TILE_ROWS 32
+
+/* Steps per pixel that square edges are snapped to, the 8 bits of
+ * sub-pixel precision of common GPUs. */
+#define RASTER_SUBPIXELS 256.0f
+
+/* Most threads drawing, the caller included. */
+#define RASTER_MAX_THREADS 64
+
+
+typedef struct Raster_Target {
+    uint32_t * pixels;
+    int width;
+    int height;
+} Raster_Target;
+
+
+/* Pixels covered by a square, 'x1' and 'y1' excluded. */
+typedef struct Raster_Rect {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+} Raster_Rect;
+
+
+typedef struct Raster {
+    Raster_Target target;
+    uint32_t background;
+    uint32_t color;
+    Raster_Rect * rects; /* Of the frame being drawn. */
+    size_t num_rects;
+    size_t capacity_rects;
+
+    /* Workers, all but the calling thread. */
+    int num_workers;
+    pthread_t threads[RASTER_MAX_THREADS];
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    uint64_t generation; /* Frames started. */
+    int busy; /* Workers still drawing the current frame. */
+    int quit;
+    atomic_int next_tile;
+} Raster;
+
+
+int raster_init(Raster * raster, int width, int height, int num_threads);
+void raster_free(Raster * raster);
+void raster_draw(Raster * raster, const Sprite_Batch * batch,
+                 uint32_t background, uint32_t color);
+int raster_write_ppm(const Raster_Target * target, FILE * file);
+
+#endif
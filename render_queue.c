@@ -0,0 +1,47 @@
+#include "render_queue.h"
+
+
+int render(Render_Queue * queue, Render_Data render_data, void * data, size_t size_data) {
+    /* Queue the object of 'render_data' to be drawn with supplied data by
+     * its render function. Its vertex array picks the matrices. Returns 0
+     * on success, -1 if the queue is full. */
+
+    if (queue->count == RENDER_QUEUE_SIZE) {
+        return -1;
+    }
+    queue->commands[queue->count++] = (Render_Command){
+        .key = (uint64_t)render_data.program_shader << 32 | render_data.VAO,
+        .render_data = render_data,
+        .data = data,
+        .size_data = size_data,
+    };
+    return 0;
+}
+
+
+void render_queue_submit(Render_Queue * queue, Gl_State * state) {
+    /* Sort the queued draws by state and draw them, emptying the queue. */
+
+    /* Insertion sort, stable and quick for the handful of draws there are. */
+    for (size_t i=1; i<queue->count; i++) {
+        Render_Command command = queue->commands[i];
+        size_t j = i;
+        while (j > 0 && queue->commands[j-1].key > command.key) {
+            queue->commands[j] = queue->commands[j-1];
+            j--;
+        }
+        queue->commands[j] = command;
+    }
+
+    for (size_t i=0; i<queue->count; i++) {
+        Render_Command * command = &queue->commands[i];
+        Render_Data * render_data = &command->render_data;
+        render_data->render_function(state,
+                                     render_data->VAO,
+                                     render_data->program_shader,
+                                     render_data->size_data,
+                                     command->data,
+                                     command->size_data);
+    }
+    queue->count = 0;
+}
@@ -0,0 +1,50 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <GL/glew.h>
+
+#include "gl_state.h"
+
+/* Draws of a frame, collected by render() and submitted together, sorted so
+ * that draws sharing a program and a vertex array follow each other and
+ * the state cache can leave out their binds. Draws with equal state keep
+ * the order they were queued in. */
+
+
+/* Draws queued per frame at most. */
+#define RENDER_QUEUE_SIZE 64
+
+
+typedef struct Render_Data {
+    GLuint VAO;
+    GLuint program_shader;
+    size_t size_data;
+    void (* render_function)(Gl_State *,
+                             GLuint,
+                             GLuint,
+                             size_t,
+                             void *,
+                             size_t);
+} Render_Data;
+
+
+typedef struct Render_Command {
+    uint64_t key; /* Program above vertex array. */
+    Render_Data render_data;
+    void * data;
+    size_t size_data;
+} Render_Command;
+
+
+typedef struct Render_Queue {
+    Render_Command commands[RENDER_QUEUE_SIZE];
+    size_t count;
+} Render_Queue;
+
+
+int render(Render_Queue * queue, Render_Data render_data, void * data, size_t size_data);
+void render_queue_submit(Render_Queue * queue, Gl_State * state);
+
+#endif
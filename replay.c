@@ -0,0 +1,314 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "replay.h"
+
+
+/* Run lengths up to this fit in the run byte itself. */
+#define RUN_SHORT_MAX 15
+#define RUN_LONG_MIN 16
+
+
+// ================================================================
+// == Recording.
+// ================================================================
+
+static void writer_flush(Replay_Writer * writer) {
+    /* Hand the buffered bytes to the file. */
+    if (writer->buffer_used > 0 &&
+        fwrite(writer->buffer, 1, writer->buffer_used, writer->file) != writer->buffer_used) {
+        writer->failed = 1;
+    }
+    writer->buffer_used = 0;
+}
+
+
+static void writer_put(Replay_Writer * writer, unsigned char byte) {
+    writer->buffer[writer->buffer_used++] = byte;
+    writer->header.runs_size++;
+    if (writer->buffer_used == REPLAY_BUFFER_SIZE) {
+        writer_flush(writer);
+    }
+}
+
+
+static void writer_end_run(Replay_Writer * writer) {
+    /* Encode the current run, if there is one. */
+
+    uint64_t length = writer->run_length;
+    if (length == 0) {
+        return;
+    }
+
+    if (length <= RUN_SHORT_MAX) {
+        writer_put(writer, writer->run_input | length << 4);
+    } else {
+        writer_put(writer, writer->run_input);
+        length -= RUN_LONG_MIN;
+        while (length >= 0x80) {
+            writer_put(writer, (length & 0x7f) | 0x80);
+            length >>= 7;
+        }
+        writer_put(writer, length);
+    }
+    writer->run_length = 0;
+}
+
+
+int replay_writer_open(Replay_Writer * writer,
+                       const char * path,
+                       const Sim_State * initial,
+                       uint64_t keyframe_interval) {
+    /* Start recording a match that begins at 'initial' into 'path'. A
+     * 'keyframe_interval' of 0 picks the default. Returns 0 on success. */
+
+    memset(writer, 0, sizeof(*writer));
+    writer->file = fopen(path, "wb");
+    if (!writer->file) {
+        return -1;
+    }
+
+    Replay_Header * header = &writer->header;
+    memcpy(header->magic, REPLAY_MAGIC, sizeof(REPLAY_MAGIC));
+    header->version = REPLAY_VERSION;
+    header->state_size = sizeof(Sim_State);
+    header->runs_offset = sizeof(Replay_Header);
+    header->keyframe_interval = keyframe_interval > 0 ? keyframe_interval :
+                                                        REPLAY_KEYFRAME_INTERVAL;
+    header->initial = *initial;
+
+    /* Reserve room for the header, which is complete only at the end. */
+    if (fwrite(header, sizeof(*header), 1, writer->file) != 1) {
+        fclose(writer->file);
+        return -1;
+    }
+    return 0;
+}
+
+
+int replay_writer_tick(Replay_Writer * writer, const Sim_State * state, Sim_Input input) {
+    /* Record that 'input' was applied to 'state' for the next tick.
+     * Returns 0 on success. */
+
+    Replay_Header * header = &writer->header;
+
+    /* Keyframe, starting a fresh run. */
+    if (header->num_ticks % header->keyframe_interval == 0) {
+        writer_end_run(writer);
+
+        if (header->num_keyframes == writer->keyframes_capacity) {
+            size_t capacity = writer->keyframes_capacity ? 2*writer->keyframes_capacity : 16;
+            Replay_Keyframe * keyframes = realloc(writer->keyframes,
+                                                  capacity*sizeof(*keyframes));
+            if (!keyframes) {
+                writer->failed = 1;
+                return -1;
+            }
+            writer->keyframes = keyframes;
+            writer->keyframes_capacity = capacity;
+        }
+        Replay_Keyframe * keyframe = &writer->keyframes[header->num_keyframes++];
+        keyframe->offset = header->runs_size;
+        keyframe->state = *state;
+    }
+
+    if (writer->run_length > 0 && input == writer->run_input) {
+        writer->run_length++;
+    } else {
+        writer_end_run(writer);
+        writer->run_input = input;
+        writer->run_length = 1;
+    }
+    header->num_ticks++;
+
+    return writer->failed ? -1 : 0;
+}
+
+
+int replay_writer_close(Replay_Writer * writer) {
+    /* Write out the rest of the match and close the file. Returns 0 if
+     * everything was written. */
+
+    Replay_Header * header = &writer->header;
+    writer_end_run(writer);
+    writer_flush(writer);
+
+    /* Pad so the keyframes can be used in place once mapped. */
+    size_t end = header->runs_offset + header->runs_size;
+    size_t padding = (alignof(Replay_Keyframe) - end % alignof(Replay_Keyframe)) %
+                     alignof(Replay_Keyframe);
+    for (size_t i=0; i<padding; i++) {
+        writer->buffer[writer->buffer_used++] = 0;
+    }
+    writer_flush(writer);
+
+    header->keyframes_offset = end + padding;
+    if (fwrite(writer->keyframes, sizeof(Replay_Keyframe), header->num_keyframes,
+               writer->file) != header->num_keyframes) {
+        writer->failed = 1;
+    }
+
+    if (fseek(writer->file, 0, SEEK_SET) != 0 ||
+        fwrite(header, sizeof(*header), 1, writer->file) != 1) {
+        writer->failed = 1;
+    }
+    if (fclose(writer->file) != 0) {
+        writer->failed = 1;
+    }
+
+    free(writer->keyframes);
+    writer->keyframes = NULL;
+    return writer->failed ? -1 : 0;
+}
+
+
+// ================================================================
+// == Playback.
+// ================================================================
+
+int replay_open(Replay * replay, const char * path) {
+    /* Map the replay at 'path' and check that it is one this build can
+     * play. Returns 0 on success. */
+
+    memset(replay, 0, sizeof(*replay));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(Replay_Header)) {
+        close(fd);
+        return -1;
+    }
+    void * data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+    replay->data = data;
+    replay->size = info.st_size;
+
+    /* Inputs are read once from front to back. */
+    madvise(data, info.st_size, MADV_SEQUENTIAL);
+
+    const Replay_Header * header = data;
+    uint64_t interval = header->keyframe_interval;
+    uint64_t keyframes_size = header->num_keyframes*sizeof(Replay_Keyframe);
+    int valid = memcmp(header->magic, REPLAY_MAGIC, sizeof(REPLAY_MAGIC)) == 0 &&
+                header->version == REPLAY_VERSION &&
+                header->state_size == sizeof(Sim_State) &&
+                interval > 0 &&
+                header->num_keyframes == (header->num_ticks + interval-1)/interval &&
+                header->runs_offset <= replay->size &&
+                header->runs_size <= replay->size - header->runs_offset &&
+                header->keyframes_offset % alignof(Replay_Keyframe) == 0 &&
+                header->keyframes_offset <= replay->size &&
+                header->num_keyframes <= replay->size/sizeof(Replay_Keyframe) &&
+                keyframes_size <= replay->size - header->keyframes_offset;
+    if (!valid) {
+        replay_close(replay);
+        return -1;
+    }
+
+    replay->header = header;
+    replay->runs = replay->data + header->runs_offset;
+    replay->keyframes = (const Replay_Keyframe *)(replay->data + header->keyframes_offset);
+    return 0;
+}
+
+
+void replay_close(Replay * replay) {
+    if (replay->data) {
+        munmap((void *)replay->data, replay->size);
+    }
+    memset(replay, 0, sizeof(*replay));
+}
+
+
+void replay_start(const Replay * replay, Replay_Cursor * cursor, Sim_State * state) {
+    /* Point 'cursor' at the first tick and set 'state' to the initial
+     * state. */
+    cursor->next = replay->runs;
+    cursor->end = replay->runs + replay->header->runs_size;
+    cursor->run_left = 0;
+    cursor->input = 0;
+    cursor->tick = 0;
+    *state = replay->header->initial;
+}
+
+
+int replay_next(Replay_Cursor * cursor, Sim_Input * input) {
+    /* Read the input of the next tick. Returns 0 at the end of the replay
+     * or on a damaged run. */
+
+    if (cursor->run_left == 0) {
+        if (cursor->next >= cursor->end) {
+            return 0;
+        }
+
+        unsigned char byte = *cursor->next++;
+        uint64_t length = byte >> 4;
+        cursor->input = byte & 0x0f;
+
+        if (length == 0) {
+            int shift = 0;
+            do {
+                if (cursor->next >= cursor->end || shift > 56) {
+                    return 0;
+                }
+                byte = *cursor->next++;
+                length |= (uint64_t)(byte & 0x7f) << shift;
+                shift += 7;
+            } while (byte & 0x80);
+            length += RUN_LONG_MIN;
+        }
+        cursor->run_left = length;
+    }
+
+    cursor->run_left--;
+    cursor->tick++;
+    *input = cursor->input;
+    return 1;
+}
+
+
+int replay_seek(const Replay * replay, Replay_Cursor * cursor, uint64_t tick, Sim_State * state) {
+    /* Set 'state' to the state before tick 'tick' and 'cursor' to that
+     * tick's input, from the closest keyframe. Returns 0 on success. */
+
+    const Replay_Header * header = replay->header;
+    if (tick > header->num_ticks) {
+        return -1;
+    }
+
+    uint64_t index = tick/header->keyframe_interval;
+    if (index >= header->num_keyframes) {
+        /* Exactly at the end: nothing follows the last keyframe. */
+        if (header->num_keyframes == 0) {
+            replay_start(replay, cursor, state);
+            return 0;
+        }
+        index = header->num_keyframes - 1;
+    }
+
+    const Replay_Keyframe * keyframe = &replay->keyframes[index];
+    replay_start(replay, cursor, state);
+    cursor->next = replay->runs + keyframe->offset;
+    cursor->tick = index*header->keyframe_interval;
+    *state = keyframe->state;
+
+    Sim_Input input;
+    while (cursor->tick < tick) {
+        if (!replay_next(cursor, &input)) {
+            return -1;
+        }
+        sim_step(state, input);
+    }
+    return 0;
+}
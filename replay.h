@@ -0,0 +1,102 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sim.h"
+
+/* Recorded matches. Since sim_step is deterministic, a match is stored as
+ * its initial state (items, environment, tick rate) plus the input of every
+ * tick, and played back by stepping the simulation again.
+ *
+ * File layout, in native byte order:
+ *
+ *     Replay_Header      initial state and where everything else is
+ *     runs               run-length coded inputs
+ *     Replay_Keyframe[]  full state every keyframe_interval ticks
+ *
+ * A run is one byte holding the input in the low four bits and the run
+ * length in the high four bits. A length of 0 means the run is 16 ticks or
+ * longer and the length minus 16 follows as a LEB128 varint. Held keys
+ * thus cost a few bytes per second, and changing keys one byte per tick.
+ *
+ * Keyframes start a new run, so seeking loads the closest earlier keyframe
+ * and steps at most keyframe_interval-1 ticks from there. */
+
+
+#define REPLAY_MAGIC "PONGRPL"
+#define REPLAY_VERSION 2
+
+/* Default ticks between keyframes. */
+#define REPLAY_KEYFRAME_INTERVAL 1024
+
+/* Size of the writer's output buffer. */
+#define REPLAY_BUFFER_SIZE (1 << 16)
+
+
+typedef struct Replay_Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t state_size; /* sizeof(Sim_State), replays follow its layout. */
+    uint64_t num_ticks;
+    uint64_t runs_offset;
+    uint64_t runs_size;
+    uint64_t keyframes_offset;
+    uint64_t num_keyframes;
+    uint64_t keyframe_interval;
+    Sim_State initial;
+} Replay_Header;
+
+typedef struct Replay_Keyframe {
+    uint64_t offset; /* Into the runs. */
+    Sim_State state; /* Before the input of tick index*keyframe_interval. */
+} Replay_Keyframe;
+
+
+typedef struct Replay_Writer {
+    FILE * file;
+    Replay_Header header;
+    unsigned char buffer[REPLAY_BUFFER_SIZE];
+    size_t buffer_used;
+    Sim_Input run_input;
+    uint64_t run_length;
+    Replay_Keyframe * keyframes;
+    size_t keyframes_capacity;
+    int failed;
+} Replay_Writer;
+
+/* A file opened for playback, mapped into memory. */
+typedef struct Replay {
+    const unsigned char * data;
+    size_t size;
+    const Replay_Header * header;
+    const unsigned char * runs;
+    const Replay_Keyframe * keyframes;
+} Replay;
+
+/* Position in the inputs of a replay. */
+typedef struct Replay_Cursor {
+    const unsigned char * next;
+    const unsigned char * end;
+    uint64_t run_left;
+    Sim_Input input;
+    uint64_t tick; /* Ticks read since the start of the replay. */
+} Replay_Cursor;
+
+
+int replay_writer_open(Replay_Writer * writer,
+                       const char * path,
+                       const Sim_State * initial,
+                       uint64_t keyframe_interval);
+int replay_writer_tick(Replay_Writer * writer, const Sim_State * state, Sim_Input input);
+int replay_writer_close(Replay_Writer * writer);
+
+int replay_open(Replay * replay, const char * path);
+void replay_close(Replay * replay);
+void replay_start(const Replay * replay, Replay_Cursor * cursor, Sim_State * state);
+int replay_next(Replay_Cursor * cursor, Sim_Input * input);
+int replay_seek(const Replay * replay, Replay_Cursor * cursor, uint64_t tick, Sim_State * state);
+
+#endif
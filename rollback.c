@@ -0,0 +1,148 @@
+#include <stddef.h>
+
+#include "rollback.h"
+
+
+/* Ring index of a tick. */
+#define SLOT(tick) ((tick) & (ROLLBACK_WINDOW - 1))
+
+/* No tick predicted wrong. */
+#define MISMATCH_NONE UINT64_MAX
+
+
+void rollback_init(Rollback_Session * session,
+                   const Sim_State * initial,
+                   Sim_Input mask_local,
+                   int input_delay) {
+    /* Start a session at 'initial', where the local player sets the input
+     * bits in 'mask_local' and the remote player all others. Local input
+     * takes effect 'input_delay' ticks after it is added. */
+
+    if (input_delay < 0) {
+        input_delay = 0;
+    } else if (input_delay > ROLLBACK_MAX_DELAY) {
+        input_delay = ROLLBACK_MAX_DELAY;
+    }
+
+    *session = (Rollback_Session){
+        .state = *initial,
+        .mask_local = mask_local,
+        .mask_remote = ~mask_local & (INPUT_RIGHT_UP | INPUT_RIGHT_DOWN |
+                                      INPUT_LEFT_UP | INPUT_LEFT_DOWN),
+        .input_delay = input_delay,
+        .local_end = input_delay, /* Stays tick + input_delay. */
+        .mismatch = MISMATCH_NONE,
+    };
+    /* The inputs start zeroed, so the ticks before the first delayed input
+     * see no local keys. */
+}
+
+
+int rollback_add_remote(Rollback_Session * session, uint64_t tick, Sim_Input input) {
+    /* Confirm the remote input of 'tick'. Inputs must be added in order, so
+     * anything but the next one is ignored. Returns 1 if the input was
+     * taken, 0 if ignored and -1 if it is too far ahead to be kept. */
+
+    if (tick != session->remote_end) {
+        return 0;
+    }
+    if (tick + ROLLBACK_MAX_PREDICTION >= session->tick + ROLLBACK_WINDOW) {
+        return -1;
+    }
+
+    /* Ticks already run used a prediction that may have been wrong. */
+    input &= session->mask_remote;
+    Sim_Input * slot = &session->inputs_remote[SLOT(tick)];
+    if (tick < session->tick && *slot != input && tick < session->mismatch) {
+        session->mismatch = tick;
+    }
+    *slot = input;
+    session->remote_end++;
+    return 1;
+}
+
+
+static void step(Rollback_Session * session) {
+    /* Run the current tick with the local input and the confirmed or
+     * predicted remote input, keeping the state before it. */
+
+    uint64_t tick = session->tick;
+    session->snapshots[SLOT(tick)] = session->state;
+
+    /* Predict that the remote player keeps doing what they did last, and
+     * remember the guess to check it once the real input arrives. */
+    if (tick >= session->remote_end) {
+        Sim_Input predicted = 0;
+        if (session->remote_end > 0) {
+            predicted = session->inputs_remote[SLOT(session->remote_end - 1)];
+        }
+        session->inputs_remote[SLOT(tick)] = predicted;
+    }
+
+    sim_step(&session->state, session->inputs_local[SLOT(tick)] |
+                              session->inputs_remote[SLOT(tick)]);
+    session->tick++;
+}
+
+
+void rollback_correct(Rollback_Session * session) {
+    /* If a tick was predicted wrong, go back to before it and run the
+     * ticks since again. */
+
+    if (session->mismatch >= session->tick) {
+        session->mismatch = MISMATCH_NONE;
+        return;
+    }
+
+    uint64_t tick_end = session->tick;
+    uint64_t depth = tick_end - session->mismatch;
+
+    session->tick = session->mismatch;
+    session->state = session->snapshots[SLOT(session->tick)];
+    session->mismatch = MISMATCH_NONE;
+    while (session->tick < tick_end) {
+        step(session);
+    }
+
+    Rollback_Stats * stats = &session->stats;
+    stats->rollbacks++;
+    stats->ticks_resimulated += depth;
+    if (depth > stats->max_depth) {
+        stats->max_depth = depth;
+    }
+}
+
+
+int rollback_advance(Rollback_Session * session, Sim_Input input) {
+    /* Correct any misprediction and run the next tick, adding 'input' as
+     * the local input for the tick after the delay. Returns 1 if the tick
+     * ran, 0 if the remote player is too far behind to keep predicting, in
+     * which case 'input' is dropped. */
+
+    rollback_correct(session);
+
+    if (session->tick >= session->remote_end + ROLLBACK_MAX_PREDICTION) {
+        session->stats.stalls++;
+        return 0;
+    }
+
+    session->inputs_local[SLOT(session->local_end)] = input & session->mask_local;
+    session->local_end++;
+    step(session);
+    return 1;
+}
+
+
+const Sim_State * rollback_final_state(const Rollback_Session * session, uint64_t tick) {
+    /* Return the state before 'tick' if every input before it is confirmed
+     * and it is still kept, NULL otherwise. */
+
+    if (tick > session->tick || tick > session->remote_end ||
+        tick > session->mismatch || tick + ROLLBACK_WINDOW < session->tick) {
+        return NULL;
+    }
+    if (tick == session->tick) {
+        return &session->state;
+    }
+    return &session->snapshots[SLOT(tick)];
+}
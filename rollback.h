@@ -0,0 +1,68 @@
+#ifndef ROLLBACK_H
+#define ROLLBACK_H
+
+#include <stdint.h>
+
+#include "sim.h"
+
+/* Rollback for two players, one local and one remote, in the style of
+ * GGPO. Ticks run as soon as the local input is known, with the remote
+ * input predicted by repeating the last one received, and the state before
+ * every tick is kept. When the real remote input of a tick arrives and
+ * differs from the prediction, the state is put back to before that tick
+ * and the ticks since are simulated again with what is now known.
+ *
+ * Local input can be delayed by a few ticks, which hides that much latency
+ * without any rollback at the cost of that much input lag. This is only the
+ * bookkeeping; netplay.h moves the inputs between the players. */
+
+
+/* Ticks of history kept, a power of two. */
+#define ROLLBACK_WINDOW 64
+
+/* Ticks the simulation may run ahead of the confirmed remote input. */
+#define ROLLBACK_MAX_PREDICTION 16
+
+/* Largest input delay in ticks. */
+#define ROLLBACK_MAX_DELAY 8
+
+
+typedef struct Rollback_Stats {
+    uint64_t rollbacks;
+    uint64_t ticks_resimulated;
+    uint64_t max_depth; /* Most ticks undone at once. */
+    uint64_t stalls; /* Ticks held back for running too far ahead. */
+} Rollback_Stats;
+
+
+typedef struct Rollback_Session {
+    Sim_State state; /* Before tick 'tick'. */
+    uint64_t tick;
+
+    /* Indexed by tick % ROLLBACK_WINDOW. */
+    Sim_State snapshots[ROLLBACK_WINDOW]; /* State before each tick. */
+    Sim_Input inputs_local[ROLLBACK_WINDOW];
+    Sim_Input inputs_remote[ROLLBACK_WINDOW]; /* Confirmed, or as predicted. */
+
+    Sim_Input mask_local; /* INPUT_* bits of the local paddle. */
+    Sim_Input mask_remote;
+    int input_delay;
+
+    uint64_t local_end; /* Local input is known for the ticks before this. */
+    uint64_t remote_end; /* Remote input is confirmed for the ticks before this. */
+    uint64_t mismatch; /* Earliest tick that was predicted wrong, if < tick. */
+
+    Rollback_Stats stats;
+} Rollback_Session;
+
+
+void rollback_init(Rollback_Session * session,
+                   const Sim_State * initial,
+                   Sim_Input mask_local,
+                   int input_delay);
+int rollback_add_remote(Rollback_Session * session, uint64_t tick, Sim_Input input);
+void rollback_correct(Rollback_Session * session);
+int rollback_advance(Rollback_Session * session, Sim_Input input);
+const Sim_State * rollback_final_state(const Rollback_Session * session, uint64_t tick);
+
+#endif
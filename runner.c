@@ -0,0 +1,349 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "runner.h"
+#include "batch.h"
+
+
+/* Result of popping or stealing a task. */
+#define DEQUE_EMPTY (-1)
+#define DEQUE_ABORT (-2)
+
+
+/* Chase-Lev deque of task indices with a fixed capacity. Only the owner
+ * pushes and pops at the bottom, any worker steals from the top. Top and
+ * bottom sit on their own cache lines since thieves hammer one and the
+ * owner the other. */
+typedef struct Runner_Deque {
+    _Alignas(64) _Atomic int64_t top;
+    _Alignas(64) _Atomic int64_t bottom;
+    _Atomic int64_t * tasks;
+    int64_t mask;
+} Runner_Deque;
+
+
+/* Everything one worker touches while running. Aligned so that no two
+ * workers share a cache line. */
+typedef struct Runner_Worker {
+    _Alignas(64) Runner_Deque deque;
+    pthread_t thread;
+    int id;
+    int started;
+    uint32_t rng; /* Victim selection. */
+    Runner_Result result;
+
+    /* Shared, read only. */
+    struct Runner_Worker * workers;
+    int num_workers;
+    const Sim_State * initial;
+    uint64_t num_games;
+    uint64_t num_ticks;
+} Runner_Worker;
+
+
+static int deque_init(Runner_Deque * deque, int64_t capacity) {
+    /* Allocate room for at least 'capacity' tasks. Returns 0 on success. */
+    int64_t size = 1;
+    while (size < capacity) {
+        size *= 2;
+    }
+    deque->tasks = malloc(size*sizeof(*deque->tasks));
+    if (!deque->tasks) {
+        return -1;
+    }
+    deque->mask = size - 1;
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+    return 0;
+}
+
+
+static int deque_push(Runner_Deque * deque, int64_t task) {
+    /* Owner only. Returns 0 on success, -1 if the deque is full. */
+    int64_t b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    int64_t t = atomic_load_explicit(&deque->top, memory_order_acquire);
+    if (b - t > deque->mask) {
+        return -1;
+    }
+    atomic_store_explicit(&deque->tasks[b & deque->mask], task, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+    return 0;
+}
+
+
+static int64_t deque_pop(Runner_Deque * deque) {
+    /* Owner only. Take the newest task, or DEQUE_EMPTY. */
+    int64_t b = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (t > b) {
+        /* Already empty. */
+        atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+        return DEQUE_EMPTY;
+    }
+
+    int64_t task = atomic_load_explicit(&deque->tasks[b & deque->mask], memory_order_relaxed);
+    if (t == b) {
+        /* Last task: race the thieves for it. */
+        if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+                                                     memory_order_seq_cst,
+                                                     memory_order_relaxed)) {
+            task = DEQUE_EMPTY;
+        }
+        atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+
+static int64_t deque_steal(Runner_Deque * deque) {
+    /* Any thread. Take the oldest task, DEQUE_EMPTY, or DEQUE_ABORT if
+     * another thread got there first. */
+    int64_t t = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+    if (t >= b) {
+        return DEQUE_EMPTY;
+    }
+
+    int64_t task = atomic_load_explicit(&deque->tasks[t & deque->mask], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed)) {
+        return DEQUE_ABORT;
+    }
+    return task;
+}
+
+
+static uint32_t next_random(uint32_t * rng) {
+    /* xorshift32. */
+    uint32_t x = *rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *rng = x;
+    return x;
+}
+
+
+static uint64_t game_checksum(const Sim_State * state) {
+    /* FNV-1a over the positions and the scores of one game. */
+    const unsigned char * bytes = (const unsigned char *)state->positions;
+    uint64_t hash = 14695981039346656037u;
+    for (size_t i=0; i<sizeof(state->positions); i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211u;
+    }
+    hash = (hash ^ state->score[ID_PADDLE_RIGHT]) * 1099511628211u;
+    hash = (hash ^ state->score[ID_PADDLE_LEFT]) * 1099511628211u;
+    return hash;
+}
+
+
+static void run_task(Runner_Worker * worker, int64_t task,
+                     Batch_State * batch, Sim_Input * inputs, uint32_t * rngs) {
+    /* Play the games of one task from start to end. Each game's inputs
+     * are seeded from its global index, so the results do not depend on
+     * which worker runs it. */
+
+    uint64_t first = (uint64_t)task*RUNNER_CHUNK;
+    size_t count = RUNNER_CHUNK;
+    if (first + count > worker->num_games) {
+        count = worker->num_games - first;
+    }
+
+    batch_reset(batch, count, worker->initial);
+    for (size_t g=0; g<count; g++) {
+        rngs[g] = (uint32_t)((first + g) * 2654435761u) | 1;
+    }
+
+    for (uint64_t i=0; i<worker->num_ticks; i++) {
+        for (size_t g=0; g<count; g++) {
+            inputs[g] = next_random(&rngs[g]) & (INPUT_RIGHT_UP | INPUT_RIGHT_DOWN |
+                                                 INPUT_LEFT_UP | INPUT_LEFT_DOWN);
+        }
+        batch_step(batch, inputs);
+    }
+
+    Runner_Result * result = &worker->result;
+    Sim_State state;
+    for (size_t g=0; g<count; g++) {
+        batch_get(batch, g, &state);
+        result->score_right += state.score[ID_PADDLE_RIGHT];
+        result->score_left += state.score[ID_PADDLE_LEFT];
+        result->checksum += game_checksum(&state);
+    }
+    result->games += count;
+    result->game_ticks += count*worker->num_ticks;
+}
+
+
+static int64_t find_task(Runner_Worker * worker) {
+    /* Pop from the own deque, or steal from the others starting at a
+     * random victim. Tasks are only pushed before the workers start, so
+     * once every deque has been seen empty there is nothing left to do. */
+
+    int64_t task = deque_pop(&worker->deque);
+    if (task >= 0) {
+        return task;
+    }
+
+    int num = worker->num_workers;
+    for (;;) {
+        int aborted = 0;
+        int start = next_random(&worker->rng) % num;
+        for (int i=0; i<num; i++) {
+            Runner_Worker * victim = &worker->workers[(start + i) % num];
+            if (victim == worker) {
+                continue;
+            }
+            task = deque_steal(&victim->deque);
+            if (task >= 0) {
+                worker->result.tasks_stolen++;
+                return task;
+            }
+            aborted |= task == DEQUE_ABORT;
+        }
+        if (!aborted) {
+            return DEQUE_EMPTY;
+        }
+    }
+}
+
+
+static void pin_to_cpu(int cpu) {
+    /* Keep a worker on one core, so its memory stays local. Best effort. */
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % CPU_SETSIZE, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+
+static void * worker_main(void * arg) {
+    /* Run tasks until none are left anywhere. */
+
+    /* Workers run on their own core, except worker 0 which is the calling
+     * thread and is left where the caller put it. */
+    Runner_Worker * worker = arg;
+    if (worker->id > 0) {
+        pin_to_cpu(worker->id % runner_num_cpus());
+    }
+
+    /* Allocated after pinning so the pages are first touched on the
+     * worker's own node. A worker that cannot allocate leaves its tasks
+     * to the thieves. */
+    Batch_State batch;
+    Sim_Input * inputs = malloc(RUNNER_CHUNK*sizeof(*inputs));
+    uint32_t * rngs = malloc(RUNNER_CHUNK*sizeof(*rngs));
+    if (inputs && rngs && batch_init(&batch, RUNNER_CHUNK, worker->initial) == 0) {
+        int64_t task;
+        while ((task = find_task(worker)) >= 0) {
+            run_task(worker, task, &batch, inputs, rngs);
+        }
+        batch_free(&batch);
+    }
+    free(rngs);
+    free(inputs);
+    return NULL;
+}
+
+
+int runner_num_cpus(void) {
+    /* Number of cores available to run workers on. */
+    long num = sysconf(_SC_NPROCESSORS_ONLN);
+    return num > 0 ? num : 1;
+}
+
+
+int runner_run(const Sim_State * initial,
+               uint64_t num_games,
+               uint64_t num_ticks,
+               int num_threads,
+               Runner_Result * result) {
+    /* Play 'num_games' games of 'num_ticks' ticks each, starting from
+     * 'initial', on 'num_threads' workers (the calling thread is one of
+     * them) and sum up the results. Returns 0 on success. */
+
+    memset(result, 0, sizeof(*result));
+    if (num_threads < 1) {
+        return -1;
+    }
+
+    Runner_Worker * workers = aligned_alloc(64, num_threads*sizeof(*workers));
+    if (!workers) {
+        return -1;
+    }
+    memset(workers, 0, num_threads*sizeof(*workers));
+
+    /* Deal out contiguous ranges of tasks before any worker starts, so no
+     * worker can finish while another still has tasks to push. */
+    int64_t num_tasks = (num_games + RUNNER_CHUNK-1) / RUNNER_CHUNK;
+    int status = 0;
+    for (int w=0; w<num_threads; w++) {
+        Runner_Worker * worker = &workers[w];
+        int64_t first = num_tasks*w/num_threads;
+        int64_t last = num_tasks*(w+1)/num_threads;
+
+        worker->id = w;
+        worker->rng = 0x9e3779b9u + w;
+        worker->workers = workers;
+        worker->num_workers = num_threads;
+        worker->initial = initial;
+        worker->num_games = num_games;
+        worker->num_ticks = num_ticks;
+
+        if (deque_init(&worker->deque, last - first) != 0) {
+            status = -1;
+            break;
+        }
+        /* Pushed in reverse, so the owner pops its tasks in order and
+         * thieves take from the far end of the range. */
+        for (int64_t task=last-1; task>=first; task--) {
+            deque_push(&worker->deque, task);
+        }
+    }
+
+    if (status == 0) {
+        /* A worker whose thread cannot be started is simply robbed by the
+         * others, and the calling thread always works as worker 0. */
+        for (int w=1; w<num_threads; w++) {
+            workers[w].started = pthread_create(&workers[w].thread, NULL,
+                                                worker_main, &workers[w]) == 0;
+        }
+        worker_main(&workers[0]);
+        for (int w=1; w<num_threads; w++) {
+            if (workers[w].started) {
+                pthread_join(workers[w].thread, NULL);
+            }
+        }
+
+        for (int w=0; w<num_threads; w++) {
+            Runner_Result * part = &workers[w].result;
+            result->games += part->games;
+            result->game_ticks += part->game_ticks;
+            result->score_right += part->score_right;
+            result->score_left += part->score_left;
+            result->checksum += part->checksum;
+            result->tasks_stolen += part->tasks_stolen;
+        }
+        if (result->games != num_games) {
+            status = -1;
+        }
+    }
+
+    for (int w=0; w<num_threads; w++) {
+        free(workers[w].deque.tasks);
+    }
+    free(workers);
+    return status;
+}
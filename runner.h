@@ -0,0 +1,36 @@
+#ifndef RUNNER_H
+#define RUNNER_H
+
+#include <stdint.h>
+
+#include "sim.h"
+
+/* Multi-core runner for large numbers of independent headless games. The
+ * games are cut into tasks of RUNNER_CHUNK games, each stepped together
+ * with batch_step. Every worker owns a work-stealing deque of tasks, its
+ * own batch and its own totals, so the only shared writes are the steals
+ * themselves and the totals are summed once the workers are done. */
+
+
+/* Games per task, a multiple of BATCH_LANES. */
+#define RUNNER_CHUNK 256
+
+
+typedef struct Runner_Result {
+    uint64_t games;
+    uint64_t game_ticks;
+    uint64_t score_right;
+    uint64_t score_left;
+    uint64_t checksum; /* Sum over games, so independent of scheduling. */
+    uint64_t tasks_stolen;
+} Runner_Result;
+
+
+int runner_num_cpus(void);
+int runner_run(const Sim_State * initial,
+               uint64_t num_games,
+               uint64_t num_ticks,
+               int num_threads,
+               Runner_Result * result);
+
+#endif
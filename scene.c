@@ -0,0 +1,205 @@
+#include "scene.h"
+
+
+#define SIZE(x) sizeof(x)/sizeof(x[0])
+
+
+void m4_set(m4 dest, m4 source) {
+    for(size_t i=0; i<4; i++) {
+        for(size_t j=0; j<4; j++) {
+            dest[i][j] = source[i][j];
+        }
+    }
+}
+
+
+void square(float * buffer, Item_Data item, Data_Environment env){
+    /* Populate vertices with data points corresponding to a square with
+     * width pixel_width and height pixel_height. */
+
+    /* Calculate pixel/screen-axis ratio. */
+    float half_width = item.width * env.delta_width * 0.5f;
+    float half_height = item.height * env.delta_height * 0.5f;
+
+    float temp_buffer[] = {
+        /* First triangle. */
+        -half_width, half_height, 1.0f,
+        -half_width,-half_height, 1.0f,
+         half_width, half_height, 1.0f,
+
+        /* Second triangle. */
+        +half_width,+half_height, 1.0f,
+        -half_width,-half_height, 1.0f,
+        +half_width,-half_height, 1.0f,
+    };
+
+    /* Copy values from temp_buffer to buffer. */
+    size_t temp_elements = SIZE(temp_buffer);
+    size_t index = 0;
+    for (size_t i=0; i<temp_elements; i++) {
+        index = i + item.offset*temp_elements;
+        buffer[index] = temp_buffer[i];
+    }
+}
+
+
+/* Glyph of a digit from its rows, top first, each row an octal digit with
+ * the leftmost cell as its highest bit. */
+#define GLYPH(r0, r1, r2, r3, r4) \
+    ((uint16_t)((r0) | (r1) << 3 | (r2) << 6 | (r3) << 9 | (r4) << 12))
+
+static const uint16_t glyphs[10] = {
+    GLYPH(07, 05, 05, 05, 07), /* 0 */
+    GLYPH(01, 01, 01, 01, 01), /* 1 */
+    GLYPH(07, 01, 07, 04, 07), /* 2 */
+    GLYPH(07, 01, 07, 01, 07), /* 3 */
+    GLYPH(05, 05, 07, 01, 01), /* 4 */
+    GLYPH(07, 04, 07, 01, 07), /* 5 */
+    GLYPH(07, 04, 07, 05, 07), /* 6 */
+    GLYPH(07, 01, 01, 02, 04), /* 7 */
+    GLYPH(07, 05, 07, 05, 07), /* 8 */
+    GLYPH(07, 05, 07, 01, 07), /* 9 */
+};
+
+
+void setup_display(Display * display,
+                   int pos_x,
+                   int pos_y,
+                   unsigned int current_value,
+                   bool left_aligned,
+                   Item_Data * items,
+                   Data_Environment * data_environment) {
+    /* Populate Display 'display' based on data from items. */
+
+    /* Cells are the size of the ball. */
+    display->cell_width = items[ID_BALL].width;
+    display->cell_height = items[ID_BALL].height;
+
+    /* Set up rest of display values. */
+    display->pos_x = pos_x;
+    display->pos_y = pos_y;
+    display->left_aligned = left_aligned;
+    display->data_environment = data_environment;
+    display_set(display, current_value);
+}
+
+
+void display_set(Display * display, unsigned int value) {
+    /* Set display to value given in 'value'. */
+
+    display->current_value = value;
+
+    /* Collect the digits least significant first, then turn them around. */
+    uint16_t reversed[DISPLAY_MAX_DIGITS];
+    size_t num_digits = 0;
+    do {
+        reversed[num_digits++] = glyphs[value % 10];
+        value /= 10;
+    } while (value > 0 && num_digits < DISPLAY_MAX_DIGITS);
+
+    for (size_t i=0; i<num_digits; i++) {
+        display->glyphs[i] = reversed[num_digits - 1 - i];
+    }
+    display->num_digits = num_digits;
+}
+
+
+size_t display_cells(const Display * display, float (* offsets)[2]) {
+    /* Store the offset of every lit cell, in normalized device coordinates,
+     * in 'offsets', which holds DISPLAY_MAX_CELLS. Returns how many there
+     * are. */
+
+    /*  ^ y+
+     *  |
+     *   ---> x+
+     */
+
+    const Data_Environment * env = display->data_environment;
+    float width = display->cell_width;
+    float height = display->cell_height;
+
+    /* Center of the top left cell of the first digit drawn. Numbers that
+     * are not left aligned keep their last digit in place. */
+    float base_x = display->pos_x + width/2;
+    float base_y = display->pos_y - height/2;
+    if (!display->left_aligned) {
+        base_x -= (float)(display->num_digits - 1)*DISPLAY_ADVANCE*width;
+    }
+
+    size_t count = 0;
+    for (size_t d=0; d<display->num_digits; d++) {
+        uint16_t glyph = display->glyphs[d];
+        float digit_x = base_x + (float)d*DISPLAY_ADVANCE*width;
+
+        for (int i=0; i<DISPLAY_GLYPH_HEIGHT; i++) {
+            for (int j=0; j<DISPLAY_GLYPH_WIDTH; j++) {
+                int bit = i*DISPLAY_GLYPH_WIDTH + (DISPLAY_GLYPH_WIDTH - 1 - j);
+                if (!(glyph >> bit & 1)) {
+                    continue;
+                }
+                offsets[count][0] = (digit_x + width*j)*env->delta_width;
+                offsets[count][1] = (base_y - height*i)*env->delta_height;
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+
+void scene_displays(Display * display_right,
+                    Display * display_left,
+                    Item_Data * items,
+                    Data_Environment * data_environment) {
+    /* Set up the score displays above each half of the arena, growing away
+     * from the center line. */
+
+    int pos_display_x = 60;
+    int pos_display_y = 280;
+    int cell_width = items[ID_BALL].width;
+
+    setup_display(display_right, pos_display_x, pos_display_y, 0, true,
+                  items, data_environment);
+    setup_display(display_left, -pos_display_x-DISPLAY_GLYPH_WIDTH*cell_width,
+                  pos_display_y, 0, false, items, data_environment);
+}
+
+
+void scene_sprites(Sprite_Batch * batch,
+                   const Sim_State * sim,
+                   const v3 * positions,
+                   const Ball_Store * balls,
+                   Display * const * displays,
+                   size_t num_displays,
+                   float (* cells)[2]) {
+    /* Append every square of the frame to 'batch': the paddles and the ball
+     * at 'positions', in normalized device coordinates per ID, the extra
+     * 'balls' if any and the lit cells of the displays. 'cells' is room for
+     * DISPLAY_MAX_CELLS offsets. */
+
+    const Data_Environment * env = &sim->env;
+
+    size_t ids[] = {ID_PADDLE_RIGHT, ID_PADDLE_LEFT, ID_BALL};
+    for (size_t i=0; i<SIZE(ids); i++) {
+        Item_Data item = sim->items[ids[i]];
+        sprite_batch_squares(batch, &positions[ids[i]].x, &positions[ids[i]].y, 0, 1,
+                             item.width*env->delta_width*0.5f,
+                             item.height*env->delta_height*0.5f);
+    }
+
+    /* The extra balls and the display cells are ball sized. */
+    Item_Data ball = sim->items[ID_BALL];
+    float half_width = ball.width*env->delta_width*0.5f;
+    float half_height = ball.height*env->delta_height*0.5f;
+
+    if (balls) {
+        sprite_batch_squares(batch, balls->x, balls->y, 1, balls->count,
+                             half_width, half_height);
+    }
+
+    for (size_t i=0; i<num_displays; i++) {
+        size_t num_cells = display_cells(displays[i], cells);
+        sprite_batch_squares(batch, &cells[0][0], &cells[0][1], 2, num_cells,
+                             half_width, half_height);
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sim.h"
+#include "balls.h"
+#include "sprites.h"
+
+/* CPU side of what is drawn: transformation matrices, the vertices of the
+ * squares everything is made of and the score displays. Kept free of GL so
+ * that the benchmarks can build it without a context.
+ *
+ * A display shows a number of any width in digits of DISPLAY_GLYPH_WIDTH by
+ * DISPLAY_GLYPH_HEIGHT cells, each cell a ball sized square. A digit's
+ * glyph is a bitmask with one bit per cell, row by row from the top. */
+
+
+#define DISPLAY_GLYPH_WIDTH 3
+#define DISPLAY_GLYPH_HEIGHT 5
+#define DISPLAY_GLYPH_CELLS (DISPLAY_GLYPH_WIDTH*DISPLAY_GLYPH_HEIGHT)
+
+/* Cells from one digit to the next, the glyph plus a blank column. */
+#define DISPLAY_ADVANCE (DISPLAY_GLYPH_WIDTH + 1)
+
+/* Digits of the largest 32 bit value. */
+#define DISPLAY_MAX_DIGITS 10
+
+/* Most cells one display can light. */
+#define DISPLAY_MAX_CELLS (DISPLAY_MAX_DIGITS*DISPLAY_GLYPH_CELLS)
+
+#define m4_unity (m4){\
+    {1.0f, 0.0f, 0.0f, 0.0f}, \
+    {0.0f, 1.0f, 0.0f, 0.0f}, \
+    {0.0f, 0.0f, 1.0f, 0.0f}, \
+    {0.0f, 0.0f, 0.0f, 1.0f}, \
+}
+
+
+typedef float m4[4][4];
+
+
+/* Create Display struct for keeping score. */
+typedef struct Display {
+    int pos_x; /* Pixels, top left of the first digit drawn. */
+    int pos_y;
+    int cell_width;
+    int cell_height;
+    unsigned int current_value;
+    size_t num_digits;
+    uint16_t glyphs[DISPLAY_MAX_DIGITS]; /* Most significant digit first. */
+    bool left_aligned; /* Extra digits grow to the right, else the left. */
+    Data_Environment * data_environment;
+} Display;
+
+
+void m4_set(m4 dest, m4 source);
+void square(float * buffer, Item_Data item, Data_Environment env);
+void setup_display(Display * display,
+                   int pos_x,
+                   int pos_y,
+                   unsigned int current_value,
+                   bool left_aligned,
+                   Item_Data * items,
+                   Data_Environment * data_environment);
+void display_set(Display * display, unsigned int value);
+size_t display_cells(const Display * display, float (* offsets)[2]);
+void scene_displays(Display * display_right,
+                    Display * display_left,
+                    Item_Data * items,
+                    Data_Environment * data_environment);
+void scene_sprites(Sprite_Batch * batch,
+                   const Sim_State * sim,
+                   const v3 * positions,
+                   const Ball_Store * balls,
+                   Display * const * displays,
+                   size_t num_displays,
+                   float (* cells)[2]);
+
+#endif
@@ -0,0 +1,144 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "shader_cache.h"
+
+
+/* FNV-1a, 64 bit. */
+#define FNV_OFFSET 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+/* Refuse binaries larger than this as corrupt. */
+#define SHADER_CACHE_MAX_SIZE (1 << 24)
+
+
+static uint64_t hash_string(uint64_t hash, const char * string) {
+    /* Continue 'hash' over 'string' and its terminating zero, so that
+     * strings run together hash differently from their concatenation. */
+    const unsigned char * c = (const unsigned char *)(string ? string : "");
+    do {
+        hash ^= *c;
+        hash *= FNV_PRIME;
+    } while (*c++);
+    return hash;
+}
+
+
+int shader_cache_available(void) {
+    /* Whether program binaries can be retrieved and loaded. Needs a current
+     * context. */
+    if (!GLEW_ARB_get_program_binary) {
+        return 0;
+    }
+    GLint num_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+    return num_formats > 0;
+}
+
+
+uint64_t shader_cache_key(const char * const * sources, size_t num_sources) {
+    /* Key of the program built from 'sources' by the current driver. */
+    uint64_t hash = FNV_OFFSET;
+    for (size_t i=0; i<num_sources; i++) {
+        hash = hash_string(hash, sources[i]);
+    }
+    hash = hash_string(hash, (const char *)glGetString(GL_VENDOR));
+    hash = hash_string(hash, (const char *)glGetString(GL_RENDERER));
+    hash = hash_string(hash, (const char *)glGetString(GL_VERSION));
+    return hash;
+}
+
+
+static void * read_binary(FILE * file, uint64_t key, Shader_Cache_Header * header) {
+    /* Read the header and binary from 'file' if stored under 'key'. Returns
+     * the binary, to be freed, or NULL. */
+
+    if (fread(header, sizeof(*header), 1, file) != 1 ||
+        memcmp(header->magic, SHADER_CACHE_MAGIC, sizeof(SHADER_CACHE_MAGIC)) != 0 ||
+        header->version != SHADER_CACHE_VERSION || header->key != key ||
+        header->size == 0 || header->size > SHADER_CACHE_MAX_SIZE) {
+        return NULL;
+    }
+
+    void * binary = malloc(header->size);
+    if (binary && fread(binary, 1, header->size, file) != header->size) {
+        free(binary);
+        return NULL;
+    }
+    return binary;
+}
+
+
+int shader_cache_load(const char * path, GLuint program, uint64_t key) {
+    /* Load the binary cached at 'path' into 'program' if it was stored under
+     * 'key' and the driver takes it. Returns 0 if 'program' is linked, -1
+     * otherwise. */
+
+    FILE * file = fopen(path, "rb");
+    if (!file) {
+        return -1;
+    }
+    Shader_Cache_Header header;
+    void * binary = read_binary(file, key, &header);
+    fclose(file);
+    if (!binary) {
+        return -1;
+    }
+
+    glProgramBinary(program, header.format, binary, (GLsizei)header.size);
+    free(binary);
+
+    GLint success = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    return success ? 0 : -1;
+}
+
+
+int shader_cache_store(const char * path, GLuint program, uint64_t key) {
+    /* Store the binary of the linked 'program' at 'path' under 'key'. The
+     * program should be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+     * Returns 0 on success, -1 on failure. */
+
+    GLint size = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0) {
+        return -1;
+    }
+    void * binary = malloc(size);
+    if (!binary) {
+        return -1;
+    }
+
+    Shader_Cache_Header header = {
+        .magic = SHADER_CACHE_MAGIC,
+        .version = SHADER_CACHE_VERSION,
+        .key = key,
+    };
+    GLsizei length = 0;
+    GLenum format = 0;
+    glGetProgramBinary(program, size, &length, &format, binary);
+    header.format = format;
+    header.size = length;
+
+    /* Write next to the old file and swap it in, so that an interrupted
+     * write never leaves half a binary behind. */
+    char path_temp[4096];
+    int result = -1;
+    if (length > 0 && snprintf(path_temp, sizeof(path_temp), "%s.tmp", path) <
+                      (int)sizeof(path_temp)) {
+        FILE * file = fopen(path_temp, "wb");
+        if (file) {
+            int written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                          fwrite(binary, 1, length, file) == (size_t)length;
+            if (fclose(file) == 0 && written && rename(path_temp, path) == 0) {
+                result = 0;
+            } else {
+                remove(path_temp);
+            }
+        }
+    }
+
+    free(binary);
+    return result;
+}
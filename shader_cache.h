@@ -0,0 +1,41 @@
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <GL/glew.h>
+
+/* On-disk cache of a linked program's binary, so that later starts load it
+ * with glProgramBinary instead of compiling and linking the shaders again.
+ *
+ * File layout, in native byte order:
+ *
+ *     Shader_Cache_Header  key, binary format and size
+ *     binary               as returned by glGetProgramBinary
+ *
+ * The key hashes the shader sources together with the GL vendor, renderer
+ * and version strings, so that a change to any of them, such as a driver
+ * update, misses the cache. Drivers may still refuse a binary they wrote
+ * themselves, in which case loading fails and the caller builds the
+ * program from source. */
+
+
+#define SHADER_CACHE_MAGIC "PONGPRG"
+#define SHADER_CACHE_VERSION 1
+
+
+typedef struct Shader_Cache_Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t format; /* Binary format enum. */
+    uint64_t key;
+    uint64_t size; /* Bytes of binary following. */
+} Shader_Cache_Header;
+
+
+int shader_cache_available(void);
+uint64_t shader_cache_key(const char * const * sources, size_t num_sources);
+int shader_cache_load(const char * path, GLuint program, uint64_t key);
+int shader_cache_store(const char * path, GLuint program, uint64_t key);
+
+#endif
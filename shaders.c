@@ -0,0 +1,105 @@
+#include "shaders.h"
+#include "transforms.h"
+
+#define SIZE(x) sizeof(x)/sizeof(x[0])
+
+/* A macro's value as a string literal. */
+#define STRING(x) STRING_LITERAL(x)
+#define STRING_LITERAL(x) #x
+
+
+const GLchar * source_vertex_shader = \
+    "#version 330 core\n"
+    "layout (location=0) in vec3 position;\n"
+    "layout (location=1) in vec2 offset;\n"
+    "layout (location=" STRING(TRANSFORMS_ATTRIBUTE) ") in int slot;\n"
+    "layout (std140, row_major) uniform Transform {\n"
+    "   mat4 transforms[" STRING(TRANSFORMS_MAX) "];\n"
+    "};\n"
+    "\n"
+    "void main() {"
+    "   gl_Position = transforms[slot] * vec4(position + vec3(offset, 0.0f), 1.0f);\n"
+    "}\n";
+
+
+const GLchar * source_fragment_shader = \
+    "#version 330 core\n"
+    "out vec4 color;\n"
+    "void main() {\n"
+    "   color = vec4(1.0f, 1.0f, 1.0f, 1.0f);\n"
+    "}\n";
+
+
+GLint shader_compile(GLuint shader_id, char * buffer_info, size_t s_buffer_info) {
+    /* TODO: Make this function on a list in the same way that shaders_delete
+     * does. */
+
+    /* Compile shader. */
+    glCompileShader(shader_id);
+
+    /* Retrieve context data. */
+    GLint success = 0;
+    glGetShaderiv(shader_id, GL_COMPILE_STATUS, &success);
+
+    /* Get error if there was one. */
+    if (!success) {
+        glGetShaderInfoLog(shader_id, s_buffer_info, NULL, buffer_info);
+    }
+    return success;
+}
+
+
+GLint program_link(GLuint program_shader,
+                   GLuint * ids,
+                   size_t num_shaders,
+                   char * buffer_info,
+                   size_t size_buffer) {
+    /* Attach and link the shaders in ids array. Check status and gather any
+     * information on failure and store in buffer_info. Return status. */
+
+    /* Attach all shaders ids. */
+    for(size_t i=0; i<num_shaders; i++) {
+        glAttachShader(program_shader, ids[i]);
+    }
+
+    /* Link all the attached shades. */
+    glLinkProgram(program_shader);
+
+    /* Examine the linking status. */
+    GLint success;
+    glGetProgramiv(program_shader, GL_LINK_STATUS, &success);
+
+    if (!success) {
+        glGetProgramInfoLog(program_shader, size_buffer, NULL, buffer_info);
+    }
+    return success;
+}
+
+
+void shaders_delete(GLuint * ids, size_t num_ids) {
+    /* Delete all shaders in the ids list. */
+    for(size_t i=0; i<num_ids; i++) {
+        glDeleteShader(ids[i]);
+    }
+}
+
+GLint program_build(GLuint program_shader, char * buffer_info, size_t size_buffer) {
+    /* Compile the vertex and fragment shaders above and link them into
+     * 'program_shader'. On failure, 'buffer_info' holds the information of
+     * the step that failed. Return status. */
+
+    GLuint shader_vertex = glCreateShader(GL_VERTEX_SHADER);
+    GLuint shader_fragment = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(shader_vertex, 1, &source_vertex_shader, 0);
+    glShaderSource(shader_fragment, 1, &source_fragment_shader, 0);
+
+    GLuint shaders[] = {shader_vertex, shader_fragment};
+    GLint success = shader_compile(shader_vertex, buffer_info, size_buffer) &&
+                    shader_compile(shader_fragment, buffer_info, size_buffer) &&
+                    program_link(program_shader, shaders, SIZE(shaders),
+                                 buffer_info, size_buffer);
+
+    /* The program keeps what it needs once linked. */
+    shaders_delete(shaders, SIZE(shaders));
+    return success;
+}
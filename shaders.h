@@ -0,0 +1,25 @@
+#ifndef SHADERS_H
+#define SHADERS_H
+
+#include <stddef.h>
+#include <GL/glew.h>
+
+/* The game's shaders, shared by the window and offscreen renderers. Every
+ * square is drawn white at its position plus an optional per-instance
+ * offset, moved by its entity's matrix in the Transform block. */
+
+
+extern const GLchar * source_vertex_shader;
+extern const GLchar * source_fragment_shader;
+
+
+GLint shader_compile(GLuint shader_id, char * buffer_info, size_t s_buffer_info);
+GLint program_link(GLuint program_shader,
+                   GLuint * ids,
+                   size_t num_shaders,
+                   char * buffer_info,
+                   size_t size_buffer);
+void shaders_delete(GLuint * ids, size_t num_ids);
+GLint program_build(GLuint program_shader, char * buffer_info, size_t size_buffer);
+
+#endif
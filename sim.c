@@ -0,0 +1,379 @@
+#include <string.h>
+#include <stdbool.h>
+
+#include "sim.h"
+
+
+/* What the ball hit first while being swept through a tick. */
+enum {
+    SIM_HIT_NONE,
+    SIM_HIT_WALL_RIGHT,
+    SIM_HIT_WALL_LEFT,
+    SIM_HIT_WALL_Y,
+    SIM_HIT_PADDLE_X,
+    SIM_HIT_PADDLE_Y,
+};
+
+
+/* Sweep times outside [0, SIM_TIME_ONE] only ever mean that nothing is hit
+ * within the tick, so they are clamped to just outside that range. */
+#define SIM_TIME_BEFORE (-1)
+#define SIM_TIME_AFTER (SIM_TIME_ONE + 1)
+
+
+void sim_init(Sim_State * state, int width, int height) {
+    /* Populate 'state' with the starting world for a width x height arena. */
+
+    memset(state, 0, sizeof(*state));
+
+    /* Create and populate environment data. */
+    state->env = (Data_Environment){
+        .width = width,
+        .height = height,
+        .delta_width = 2.0f/width,
+        .delta_height = 2.0f/height,
+    };
+
+    /* Speeds below are given in pixels per tick at the base rate. */
+    state->tick_rate = SIM_BASE_TICK_RATE;
+
+    /* Set starting positions for each object, the paddles at 80% of the
+     * way to the side walls. */
+    state->positions[ID_PADDLE_RIGHT].x = (Sim_Fixed)(width*2/5)*SIM_FIXED_ONE;
+    state->positions[ID_PADDLE_LEFT].x = -(Sim_Fixed)(width*2/5)*SIM_FIXED_ONE;
+
+    /* Paddle dimensions in pixels. */
+    int paddle_width = 20;
+    int paddle_height = 50;
+    Sim_Vec paddle_speed = (Sim_Vec){0, 17*SIM_FIXED_ONE};
+    unsigned int paddle_offset = 0;
+
+    /* Ball dimensions in pixels. */
+    int ball_width = 15;
+    int ball_height = 15;
+    Sim_Fixed ball_speed_constant = 10*SIM_FIXED_ONE;
+    Sim_Vec ball_speed = (Sim_Vec){ball_speed_constant, ball_speed_constant};
+    unsigned int ball_offset = 1;
+
+    /* Set item data for right paddle. */
+    state->items[ID_PADDLE_RIGHT] = (Item_Data){
+        .width=paddle_width,
+        .height=paddle_height,
+        .speed=paddle_speed,
+        .offset=paddle_offset,
+    };
+
+    /* Set item data for left paddle. */
+    state->items[ID_PADDLE_LEFT] = (Item_Data){
+        .width=paddle_width,
+        .height=paddle_height,
+        .speed=paddle_speed,
+        .offset=paddle_offset,
+    };
+
+    /* Set item data for ball. */
+    state->items[ID_BALL] = (Item_Data){
+        .width=ball_width,
+        .height=ball_height,
+        .speed=ball_speed,
+        .offset=ball_offset,
+    };
+}
+
+
+v3 sim_to_ndc(const Data_Environment * env, Sim_Vec position) {
+    /* Convert a simulation position to normalized device coordinates. */
+    return (v3){
+        (float)position.x/SIM_FIXED_ONE*env->delta_width,
+        (float)position.y/SIM_FIXED_ONE*env->delta_height,
+        0.0f,
+    };
+}
+
+
+static void move_paddle(Sim_Fixed * ptr_pos,
+                        Item_Data item,
+                        Data_Environment env,
+                        int direction) {
+    /* Move the paddle at 'ptr_pos' one step up (direction > 0) or down
+     * (direction < 0), clamping it inside the arena. */
+
+    /* Furthest the paddle's center may get from the middle. */
+    Sim_Fixed limit = (Sim_Fixed)(env.height/2 - item.height/2)*SIM_FIXED_ONE;
+
+    if (direction > 0) {
+        Sim_Fixed next_pos = *ptr_pos + item.speed.y;
+        *ptr_pos = next_pos < limit ? next_pos : limit;
+    } else if (direction < 0) {
+        Sim_Fixed next_pos = *ptr_pos - item.speed.y;
+        *ptr_pos = next_pos > -limit ? next_pos : -limit;
+    }
+}
+
+
+void sim_set_tick_rate(Sim_State * state, int tick_rate) {
+    /* Rescale all per-tick speeds so that the world moves at the same
+     * pixels per second when stepped 'tick_rate' times per second. Speeds
+     * are rounded to the nearest sub-pixel. */
+
+    for (size_t i=0; i<ID_NUM; i++) {
+        Sim_Fixed * speeds[] = {&state->items[i].speed.x, &state->items[i].speed.y};
+        for (size_t j=0; j<2; j++) {
+            int64_t scaled = (int64_t)*speeds[j]*state->tick_rate;
+            int64_t half = scaled < 0 ? -tick_rate/2 : tick_rate/2;
+            *speeds[j] = (scaled + half)/tick_rate;
+        }
+    }
+    state->tick_rate = tick_rate;
+}
+
+
+void react_to_events(Sim_State * state, Sim_Input input) {
+    /* Move the paddles according to the input bits in 'input'. */
+
+    Item_Data * items = state->items;
+    Sim_Vec * positions = state->positions;
+
+    /* Move right paddle up and down. */
+    if (input & INPUT_RIGHT_UP) {
+        move_paddle(&positions[ID_PADDLE_RIGHT].y,
+                    items[ID_PADDLE_RIGHT], state->env, 1);
+    } else if (input & INPUT_RIGHT_DOWN) {
+        move_paddle(&positions[ID_PADDLE_RIGHT].y,
+                    items[ID_PADDLE_RIGHT], state->env, -1);
+    }
+
+    /* Move left paddle up and down. */
+    if (input & INPUT_LEFT_UP) {
+        move_paddle(&positions[ID_PADDLE_LEFT].y,
+                    items[ID_PADDLE_LEFT], state->env, 1);
+    } else if (input & INPUT_LEFT_DOWN) {
+        move_paddle(&positions[ID_PADDLE_LEFT].y,
+                    items[ID_PADDLE_LEFT], state->env, -1);
+    }
+}
+
+
+static int32_t time_to_cover(int64_t distance, Sim_Fixed move) {
+    /* Fraction of 'move' (not zero) that covers 'distance', rounded toward
+     * zero and clamped to [SIM_TIME_BEFORE, SIM_TIME_AFTER]. */
+    int64_t time = distance*SIM_TIME_ONE/move;
+    if (time < SIM_TIME_BEFORE) {
+        return SIM_TIME_BEFORE;
+    }
+    return time > SIM_TIME_AFTER ? SIM_TIME_AFTER : time;
+}
+
+
+static Sim_Fixed scale_by_time(Sim_Fixed value, int32_t time) {
+    /* 'value' times the fraction 'time' of a tick, rounded toward zero. */
+    return (int64_t)value*time/SIM_TIME_ONE;
+}
+
+
+static bool sweep_axis(Sim_Fixed pos, Sim_Fixed move, Sim_Fixed target, Sim_Fixed reach,
+                       int32_t * enter, int32_t * exit) {
+    /* Times at which a point at 'pos' moving by 'move' enters and leaves
+     * the slab [target-reach, target+reach]. Returns false if it is outside
+     * and does not move. */
+    if (move == 0) {
+        int64_t distance = (int64_t)pos - target;
+        if (distance <= -reach || distance >= reach) {
+            return false;
+        }
+        *enter = SIM_TIME_BEFORE;
+        *exit = SIM_TIME_AFTER;
+        return true;
+    }
+    int32_t near = time_to_cover((int64_t)target - reach - pos, move);
+    int32_t far = time_to_cover((int64_t)target + reach - pos, move);
+    *enter = near < far ? near : far;
+    *exit = near < far ? far : near;
+    return true;
+}
+
+
+static bool sweep_paddle(Sim_Vec ball, Sim_Vec move, Sim_Vec paddle, Sim_Vec reach,
+                         int32_t * time_hit, int * axis_hit) {
+    /* Swept test of the ball's center against the paddle grown by the
+     * ball's half size ('reach'). On a hit within the move, store the time
+     * of impact and the axis of the face that was hit (0 for x, 1 for y).
+     * Overlaps at the start are not reported; they are pushed out first. */
+
+    int32_t enter_x, exit_x, enter_y, exit_y;
+    if (!sweep_axis(ball.x, move.x, paddle.x, reach.x, &enter_x, &exit_x) ||
+        !sweep_axis(ball.y, move.y, paddle.y, reach.y, &enter_y, &exit_y)) {
+        return false;
+    }
+
+    int32_t enter = enter_x > enter_y ? enter_x : enter_y;
+    int32_t exit = exit_x < exit_y ? exit_x : exit_y;
+    if (enter >= exit || enter < 0 || enter > SIM_TIME_ONE) {
+        return false;
+    }
+
+    *time_hit = enter;
+    *axis_hit = enter_x > enter_y ? 0 : 1;
+    return true;
+}
+
+
+void move_non_controlled_items(Sim_State * state) {
+    /* Advance everything that is not driven by input. The ball is swept
+     * through the tick: it travels to the earliest wall or paddle it would
+     * touch, is placed on it, bounces, and continues with the time left,
+     * so it can never pass through a paddle regardless of speed or tick
+     * length. */
+
+    Item_Data * items = state->items;
+    Data_Environment env = state->env;
+
+    Sim_Vec * ball = &state->positions[ID_BALL];
+    Sim_Vec * speed = &items[ID_BALL].speed;
+
+    /* Half sizes are whole pixels times SIM_FIXED_ONE/2, so exact. */
+    Sim_Fixed half_width_ball = items[ID_BALL].width*(SIM_FIXED_ONE/2);
+    Sim_Fixed half_height_ball = items[ID_BALL].height*(SIM_FIXED_ONE/2);
+
+    /* Walls the ball's center can reach. */
+    Sim_Fixed limit_x = env.width*(SIM_FIXED_ONE/2) - half_width_ball;
+    Sim_Fixed limit_y = env.height*(SIM_FIXED_ONE/2) - half_height_ball;
+
+    /* Paddles, and how close the ball's center can get to theirs. */
+    int ids[] = {ID_PADDLE_RIGHT, ID_PADDLE_LEFT};
+    Sim_Vec paddles[2];
+    Sim_Vec reach[2];
+    for (size_t i=0; i<2; i++) {
+        paddles[i] = state->positions[ids[i]];
+        reach[i] = (Sim_Vec){
+            items[ids[i]].width*(SIM_FIXED_ONE/2) + half_width_ball,
+            items[ids[i]].height*(SIM_FIXED_ONE/2) + half_height_ball,
+        };
+    }
+
+    /* Paddles that moved into the ball push it out in front of them. */
+    for (size_t i=0; i<2; i++) {
+        Sim_Fixed dx = ball->x - paddles[i].x;
+        Sim_Fixed dy = ball->y - paddles[i].y;
+        if (dx > -reach[i].x && dx < reach[i].x &&
+            dy > -reach[i].y && dy < reach[i].y) {
+            Sim_Fixed direction = paddles[i].x > 0 ? -1 : 1;
+            ball->x = paddles[i].x + direction*reach[i].x;
+            if (speed->x*direction < 0) {
+                speed->x = -speed->x;
+            }
+            state->events |= SIM_EVENT_BOUNCE_PADDLE;
+        }
+    }
+
+    int32_t time_left = SIM_TIME_ONE;
+    for (int bounce=0; bounce<SIM_MAX_BOUNCES && time_left > 0; bounce++) {
+
+        /* Distance travelled in the rest of the tick. */
+        Sim_Vec move = {
+            scale_by_time(speed->x, time_left),
+            scale_by_time(speed->y, time_left),
+        };
+
+        /* Find the earliest impact, as a fraction of the remaining move. */
+        int32_t time_hit = SIM_TIME_ONE;
+        int hit = SIM_HIT_NONE;
+        size_t paddle_hit = 0;
+
+        if (move.x > 0 && ball->x + move.x > limit_x) {
+            time_hit = time_to_cover((int64_t)limit_x - ball->x, move.x);
+            hit = SIM_HIT_WALL_RIGHT;
+        } else if (move.x < 0 && ball->x + move.x < -limit_x) {
+            time_hit = time_to_cover((int64_t)-limit_x - ball->x, move.x);
+            hit = SIM_HIT_WALL_LEFT;
+        }
+
+        int32_t time_wall_y;
+        if (move.y > 0 && ball->y + move.y > limit_y) {
+            time_wall_y = time_to_cover((int64_t)limit_y - ball->y, move.y);
+            if (time_wall_y < time_hit) {
+                time_hit = time_wall_y;
+                hit = SIM_HIT_WALL_Y;
+            }
+        } else if (move.y < 0 && ball->y + move.y < -limit_y) {
+            time_wall_y = time_to_cover((int64_t)-limit_y - ball->y, move.y);
+            if (time_wall_y < time_hit) {
+                time_hit = time_wall_y;
+                hit = SIM_HIT_WALL_Y;
+            }
+        }
+
+        for (size_t i=0; i<2; i++) {
+            int32_t time_paddle;
+            int axis;
+            if (sweep_paddle(*ball, move, paddles[i], reach[i], &time_paddle, &axis) &&
+                time_paddle < time_hit) {
+                time_hit = time_paddle;
+                hit = axis == 0 ? SIM_HIT_PADDLE_X : SIM_HIT_PADDLE_Y;
+                paddle_hit = i;
+            }
+        }
+
+        /* Never travel backwards. */
+        time_hit = time_hit < 0 ? 0 : time_hit;
+
+        /* Travel to the impact, or to the end of the tick. */
+        ball->x += scale_by_time(move.x, time_hit);
+        ball->y += scale_by_time(move.y, time_hit);
+        time_left -= scale_by_time(time_left, time_hit);
+
+        /* Place the ball on what it hit, undoing rounding, and bounce.
+         * Reaching the wall behind a paddle scores for the other side. */
+        Sim_Vec paddle = paddles[paddle_hit];
+        switch (hit) {
+            case SIM_HIT_NONE:
+                time_left = 0;
+                break;
+            case SIM_HIT_WALL_RIGHT:
+                ball->x = limit_x;
+                speed->x = -speed->x;
+                state->score[ID_PADDLE_LEFT]++;
+                state->events |= SIM_EVENT_SCORE_LEFT;
+                break;
+            case SIM_HIT_WALL_LEFT:
+                ball->x = -limit_x;
+                speed->x = -speed->x;
+                state->score[ID_PADDLE_RIGHT]++;
+                state->events |= SIM_EVENT_SCORE_RIGHT;
+                break;
+            case SIM_HIT_WALL_Y:
+                ball->y = speed->y > 0 ? limit_y : -limit_y;
+                speed->y = -speed->y;
+                state->events |= SIM_EVENT_BOUNCE_WALL;
+                break;
+            case SIM_HIT_PADDLE_X:
+                ball->x = move.x > 0 ? paddle.x - reach[paddle_hit].x :
+                                       paddle.x + reach[paddle_hit].x;
+                speed->x = -speed->x;
+                state->events |= SIM_EVENT_BOUNCE_PADDLE;
+                break;
+            case SIM_HIT_PADDLE_Y:
+                ball->y = move.y > 0 ? paddle.y - reach[paddle_hit].y :
+                                       paddle.y + reach[paddle_hit].y;
+                speed->y = -speed->y;
+                state->events |= SIM_EVENT_BOUNCE_PADDLE;
+                break;
+        }
+    }
+}
+
+
+void sim_step(Sim_State * state, Sim_Input input) {
+    /* Advance the world in 'state' one step using 'input'. */
+
+    /* Only report what happened during this step. */
+    state->events = 0;
+
+    /* React to input. */
+    react_to_events(state, input);
+
+    /* Move the world. */
+    move_non_controlled_items(state);
+
+    state->tick++;
+}
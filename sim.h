@@ -0,0 +1,114 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+
+/* Headless simulation core. Holds everything needed to advance the world
+ * one step without a window, a GL context or any output.
+ *
+ * Positions and speeds are fixed point, SIM_FIXED_ONE units per pixel with
+ * the origin at the center of the arena, and stepping uses integer math
+ * only. Every build on every machine thus computes the same bits, which
+ * replays and distributed runs rely on. Floats appear only when converting
+ * to normalized device coordinates for rendering. */
+
+
+/* Tick rate that the speeds set up by sim_init are expressed in. */
+#define SIM_BASE_TICK_RATE 60
+
+
+/* Most bounces the ball resolves within one tick. */
+#define SIM_MAX_BOUNCES 8
+
+
+/* Sub-pixel units per pixel. Arenas up to 32767 pixels across fit. */
+#define SIM_FIXED_SHIFT 16
+#define SIM_FIXED_ONE (1 << SIM_FIXED_SHIFT)
+
+/* One whole tick, for times of impact within a tick. */
+#define SIM_TIME_ONE (1 << 16)
+
+
+/* Enumerate unique objects. */
+enum {
+    ID_PADDLE_RIGHT,
+    ID_PADDLE_LEFT,
+    ID_BALL,
+    ID_DISPLAY_RIGHT,
+    ID_DISPLAY_LEFT,
+    ID_NUM,
+};
+
+
+/* Input bits for one simulation step. */
+enum {
+    INPUT_RIGHT_UP = 1 << 0,
+    INPUT_RIGHT_DOWN = 1 << 1,
+    INPUT_LEFT_UP = 1 << 2,
+    INPUT_LEFT_DOWN = 1 << 3,
+};
+
+typedef uint8_t Sim_Input;
+
+
+/* Things that happened during the last step. */
+enum {
+    SIM_EVENT_BOUNCE_WALL = 1 << 0,
+    SIM_EVENT_BOUNCE_PADDLE = 1 << 1,
+    SIM_EVENT_SCORE_RIGHT = 1 << 2,
+    SIM_EVENT_SCORE_LEFT = 1 << 3,
+};
+
+
+typedef struct v3 {
+    float x;
+    float y;
+    float z;
+} v3;
+
+
+typedef int32_t Sim_Fixed;
+
+typedef struct Sim_Vec {
+    Sim_Fixed x;
+    Sim_Fixed y;
+} Sim_Vec;
+
+
+typedef struct Item_Data {
+    int width;
+    int height;
+    Sim_Vec speed; /* Sub-pixels per tick. */
+    unsigned int id;
+    unsigned int offset;
+} Item_Data;
+
+
+typedef struct Data_Environment {
+    int width;
+    int height;
+    float delta_width; /* Float value per pixel along width, for rendering. */
+    float delta_height;/* Float value per pixel along height, for rendering. */
+
+} Data_Environment;
+
+
+typedef struct Sim_State {
+    Item_Data items[ID_NUM];
+    Data_Environment env;
+    Sim_Vec positions[ID_NUM]; /* Sub-pixels from the arena center. */
+    int tick_rate; /* Steps per simulated second. */
+    uint64_t tick;
+    uint32_t score[2]; /* Points, indexed by ID_PADDLE_RIGHT/LEFT. */
+    uint32_t events; /* SIM_EVENT_* bits of the last step. */
+} Sim_State;
+
+
+void sim_init(Sim_State * state, int width, int height);
+v3 sim_to_ndc(const Data_Environment * env, Sim_Vec position);
+void sim_set_tick_rate(Sim_State * state, int tick_rate);
+void react_to_events(Sim_State * state, Sim_Input input);
+void move_non_controlled_items(Sim_State * state);
+void sim_step(Sim_State * state, Sim_Input input);
+
+#endif
@@ -0,0 +1,121 @@
+#include <string.h>
+
+#include "sim.h"
+#include "sound.h"
+
+
+// ================================================================
+// == Event queue.
+// ================================================================
+
+int sound_queue_push(Sound_Queue * queue, Sound_Event event) {
+    /* Producer only. Returns 0 on success, -1 if the queue is full and the
+     * event was dropped. */
+
+    size_t slot;
+    if (spsc_reserve(&queue->ring, SOUND_QUEUE_SIZE, &slot) != 0) {
+        return -1;
+    }
+    queue->events[slot] = event;
+    spsc_publish(&queue->ring);
+    return 0;
+}
+
+
+int sound_queue_pop(Sound_Queue * queue, Sound_Event * event) {
+    /* Consumer only. Take the oldest event into 'event'. Returns 0 if the
+     * queue is empty. */
+
+    size_t slot;
+    if (!spsc_front(&queue->ring, SOUND_QUEUE_SIZE, &slot)) {
+        return 0;
+    }
+    *event = queue->events[slot];
+    spsc_release(&queue->ring);
+    return 1;
+}
+
+
+// ================================================================
+// == Synthesizer.
+// ================================================================
+
+/* Pitch and length of the blip of each event. */
+static const struct {
+    uint32_t event;
+    float frequency; /* Hz. */
+    float duration; /* Seconds. */
+    float amplitude;
+} blips[] = {
+    {SIM_EVENT_BOUNCE_PADDLE, 459.0f, 0.035f, 0.25f},
+    {SIM_EVENT_BOUNCE_WALL, 226.0f, 0.020f, 0.25f},
+    {SIM_EVENT_SCORE_RIGHT, 490.0f, 0.250f, 0.25f},
+    {SIM_EVENT_SCORE_LEFT, 490.0f, 0.250f, 0.25f},
+};
+
+
+void sound_synth_init(Sound_Synth * synth, int sample_rate) {
+    memset(synth, 0, sizeof(*synth));
+    synth->sample_rate = sample_rate;
+    synth->attack = sample_rate/1000;
+}
+
+
+static Sound_Voice * free_voice(Sound_Synth * synth) {
+    /* A silent voice, or the one closest to its end. */
+    Sound_Voice * voice = &synth->voices[0];
+    for (size_t i=0; i<SOUND_VOICES; i++) {
+        if (synth->voices[i].left < voice->left) {
+            voice = &synth->voices[i];
+        }
+    }
+    return voice;
+}
+
+
+void sound_synth_trigger(Sound_Synth * synth, uint32_t events) {
+    /* Start the blip of every event in 'events'. */
+    for (size_t i=0; i<sizeof(blips)/sizeof(blips[0]); i++) {
+        if (!(events & blips[i].event)) {
+            continue;
+        }
+        Sound_Voice * voice = free_voice(synth);
+        uint32_t length = (uint32_t)(blips[i].duration*synth->sample_rate);
+        *voice = (Sound_Voice){
+            .phase = 0.0f,
+            .step = blips[i].frequency/synth->sample_rate,
+            .amplitude = blips[i].amplitude,
+            .length = length > 0 ? length : 1,
+            .left = length > 0 ? length : 1,
+        };
+    }
+}
+
+
+void sound_synth_render(Sound_Synth * synth, float * output, size_t num_frames,
+                        int num_channels) {
+    /* Mix the voices into 'num_frames' interleaved frames of 'output'. */
+
+    memset(output, 0, num_frames*num_channels*sizeof(float));
+
+    for (size_t v=0; v<SOUND_VOICES; v++) {
+        Sound_Voice * voice = &synth->voices[v];
+        size_t count = voice->left < num_frames ? voice->left : num_frames;
+        float decay = voice->amplitude/voice->length;
+        for (size_t i=0; i<count; i++) {
+            /* Faded in over the attack and out linearly over the rest. */
+            uint32_t played = voice->length - voice->left;
+            float gain = decay*voice->left;
+            if (played < synth->attack) {
+                gain *= (float)played/synth->attack;
+            }
+            float sample = voice->phase < 0.5f ? gain : -gain;
+            for (int c=0; c<num_channels; c++) {
+                output[i*num_channels + c] += sample;
+            }
+            voice->phase += voice->step;
+            voice->phase -= voice->phase >= 1.0f ? 1.0f : 0.0f;
+            voice->left--;
+        }
+    }
+}
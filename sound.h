@@ -0,0 +1,63 @@
+#ifndef SOUND_H
+#define SOUND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "spsc.h"
+
+/* Sound effects of the game, synthesized rather than played from samples,
+ * and the queue that carries the events that trigger them from the
+ * simulation to the audio thread.
+ *
+ * The queue is single producer, single consumer, and both ends finish in
+ * a fixed number of steps without locks, so the audio thread never waits
+ * on the simulation. The synthesizer keeps a fixed set of voices, so
+ * nothing is allocated while playing either. Each bounce or point starts a
+ * short square wave blip at the pitch of the original arcade game. */
+
+
+/* Events the queue holds, a power of two. */
+#define SOUND_QUEUE_SIZE 64
+
+/* Blips sounding at once, the oldest one is cut off for a new one. */
+#define SOUND_VOICES 8
+
+
+typedef struct Sound_Event {
+    double time; /* Seconds when posted, on the CLOCK_MONOTONIC clock. */
+    uint32_t events; /* SIM_EVENT_* bits. */
+} Sound_Event;
+
+
+typedef struct Sound_Queue {
+    Spsc_Ring ring;
+    Sound_Event events[SOUND_QUEUE_SIZE];
+} Sound_Queue;
+
+
+typedef struct Sound_Voice {
+    float phase; /* Of the square wave, in periods. */
+    float step; /* Periods per frame. */
+    float amplitude;
+    uint32_t length; /* Frames. */
+    uint32_t left; /* Frames still to play, 0 if silent. */
+} Sound_Voice;
+
+
+typedef struct Sound_Synth {
+    Sound_Voice voices[SOUND_VOICES];
+    int sample_rate;
+    uint32_t attack; /* Frames of fade in, against clicks. */
+} Sound_Synth;
+
+
+int sound_queue_push(Sound_Queue * queue, Sound_Event event);
+int sound_queue_pop(Sound_Queue * queue, Sound_Event * event);
+
+void sound_synth_init(Sound_Synth * synth, int sample_rate);
+void sound_synth_trigger(Sound_Synth * synth, uint32_t events);
+void sound_synth_render(Sound_Synth * synth, float * output, size_t num_frames,
+                        int num_channels);
+
+#endif
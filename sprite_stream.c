@@ -0,0 +1,110 @@
+#include <string.h>
+
+#include "sprite_stream.h"
+
+
+int sprite_stream_init(Sprite_Stream * stream, size_t capacity, int persistent) {
+    /* Create the stream for up to 'capacity' squares per frame, persistently
+     * mapped if 'persistent' and the context can. Needs a current context.
+     * Returns 0 on success, -1 on failure. */
+
+    memset(stream, 0, sizeof(*stream));
+    stream->capacity = capacity;
+    stream->size_segment = capacity*SPRITE_FLOATS*sizeof(float);
+
+    glGenVertexArrays(1, &stream->vertex_array);
+    glGenBuffers(1, &stream->buffer);
+    glBindVertexArray(stream->vertex_array);
+    glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+
+    if (persistent && GLEW_ARB_buffer_storage) {
+        size_t size = SPRITE_STREAM_FRAMES*stream->size_segment;
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+        stream->mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+        stream->persistent = stream->mapped != NULL;
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, stream->size_segment, NULL, GL_STREAM_DRAW);
+    }
+
+    /* 2D positions only, the offset attribute keeps its default of 0. */
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2*sizeof(GLfloat), (GLvoid*)0);
+    glEnableVertexAttribArray(0);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (persistent && GLEW_ARB_buffer_storage && !stream->persistent) {
+        sprite_stream_free(stream);
+        return -1;
+    }
+    return glGetError() == GL_NO_ERROR ? 0 : -1;
+}
+
+
+void sprite_stream_free(Sprite_Stream * stream) {
+    for (size_t i=0; i<SPRITE_STREAM_FRAMES; i++) {
+        if (stream->fences[i]) {
+            glDeleteSync(stream->fences[i]);
+        }
+    }
+    if (stream->persistent) {
+        glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &stream->buffer);
+    glDeleteVertexArrays(1, &stream->vertex_array);
+    memset(stream, 0, sizeof(*stream));
+}
+
+
+int sprite_stream_begin(Sprite_Stream * stream, Gl_State * state, Sprite_Batch * batch) {
+    /* Start 'batch' in memory that becomes this frame's vertices. Returns 0
+     * on success, -1 if the buffer could not be mapped. */
+
+    if (stream->persistent) {
+        /* Wait until the GPU is done with the draw that last read the next
+         * segment. */
+        stream->segment = (stream->segment + 1) % SPRITE_STREAM_FRAMES;
+        stream->waits += gl_fence_wait(&stream->fences[stream->segment]);
+        float * segment = stream->mapped + stream->segment*stream->capacity*SPRITE_FLOATS;
+        sprite_batch_begin(batch, segment, stream->capacity);
+        return 0;
+    }
+
+    /* Orphan the old contents and map the fresh storage. */
+    gl_bind_array_buffer(state, stream->buffer);
+    glBufferData(GL_ARRAY_BUFFER, stream->size_segment, NULL, GL_STREAM_DRAW);
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT |
+                       GL_MAP_UNSYNCHRONIZED_BIT;
+    float * mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, stream->size_segment, flags);
+    state->frame.calls += 2;
+    if (!mapped) {
+        return -1;
+    }
+    sprite_batch_begin(batch, mapped, stream->capacity);
+    return 0;
+}
+
+
+void sprite_stream_end(Sprite_Stream * stream, Gl_State * state, const Sprite_Batch * batch) {
+    /* Hand the vertices of 'batch' to the GPU. */
+
+    if (!stream->persistent) {
+        gl_bind_array_buffer(state, stream->buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        state->frame.calls++;
+    }
+    stream->first = stream->persistent ?
+                    (GLint)(stream->segment*stream->capacity*SPRITE_VERTICES) : 0;
+    stream->count = batch->count;
+}
+
+
+void sprite_stream_fence(Sprite_Stream * stream) {
+    /* Mark the end of this frame's draw. Call after it. */
+    if (stream->persistent) {
+        stream->fences[stream->segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
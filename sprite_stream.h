@@ -0,0 +1,47 @@
+#ifndef SPRITE_STREAM_H
+#define SPRITE_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <GL/glew.h>
+
+#include "gl_state.h"
+#include "sprites.h"
+
+/* Vertex buffer that a Sprite_Batch is written into every frame, and the
+ * vertex array that draws it.
+ *
+ * With ARB_buffer_storage the buffer is a persistently mapped ring of
+ * SPRITE_STREAM_FRAMES segments guarded by fences, as the transformation
+ * ring is, and the batch is written straight into the segment of the
+ * frame. Without it, or when asked not to, the buffer is orphaned and
+ * mapped anew each frame, leaving the driver to find fresh memory while the
+ * GPU still reads the old. */
+
+
+/* Frames the GPU may lag behind. */
+#define SPRITE_STREAM_FRAMES 3
+
+
+typedef struct Sprite_Stream {
+    GLuint buffer;
+    GLuint vertex_array;
+    size_t capacity; /* Squares per frame. */
+    size_t size_segment; /* Bytes per frame. */
+    int persistent;
+    float * mapped; /* Whole buffer if persistent. */
+    GLsync fences[SPRITE_STREAM_FRAMES];
+    size_t segment; /* Written this frame. */
+    GLint first; /* First vertex of this frame. */
+    size_t count; /* Squares of this frame. */
+    uint64_t waits; /* Frames that had to wait for the GPU. */
+} Sprite_Stream;
+
+
+int sprite_stream_init(Sprite_Stream * stream, size_t capacity, int persistent);
+void sprite_stream_free(Sprite_Stream * stream);
+int sprite_stream_begin(Sprite_Stream * stream, Gl_State * state, Sprite_Batch * batch);
+void sprite_stream_end(Sprite_Stream * stream, Gl_State * state, const Sprite_Batch * batch);
+void sprite_stream_fence(Sprite_Stream * stream);
+
+#endif
@@ -0,0 +1,55 @@
+#include "sprites.h"
+
+
+void sprite_batch_begin(Sprite_Batch * batch, float * vertices, size_t capacity) {
+    /* Start a batch of up to 'capacity' squares written to 'vertices'. */
+    batch->vertices = vertices;
+    batch->count = 0;
+    batch->capacity = capacity;
+}
+
+
+size_t sprite_batch_squares(Sprite_Batch * batch,
+                            const float * xs,
+                            const float * ys,
+                            size_t stride,
+                            size_t count,
+                            float half_width,
+                            float half_height) {
+    /* Append 'count' squares of the same size centered on xs[i*stride],
+     * ys[i*stride]. Returns how many fit. */
+
+    if (count > batch->capacity - batch->count) {
+        count = batch->capacity - batch->count;
+    }
+
+    /* Same winding as the squares made by 'square'. */
+    float * vertex = batch->vertices + batch->count*SPRITE_FLOATS;
+    for (size_t i=0; i<count; i++) {
+        float left = xs[i*stride] - half_width;
+        float right = xs[i*stride] + half_width;
+        float top = ys[i*stride] + half_height;
+        float bottom = ys[i*stride] - half_height;
+
+        /* First triangle. */
+        vertex[0] = left;
+        vertex[1] = top;
+        vertex[2] = left;
+        vertex[3] = bottom;
+        vertex[4] = right;
+        vertex[5] = top;
+
+        /* Second triangle. */
+        vertex[6] = right;
+        vertex[7] = top;
+        vertex[8] = left;
+        vertex[9] = bottom;
+        vertex[10] = right;
+        vertex[11] = bottom;
+
+        vertex += SPRITE_FLOATS;
+    }
+
+    batch->count += count;
+    return count;
+}
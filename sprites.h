@@ -0,0 +1,37 @@
+#ifndef SPRITES_H
+#define SPRITES_H
+
+#include <stddef.h>
+
+/* Sprite batching: every square of a frame appended as two triangles of 2D
+ * vertices in normalized device coordinates, so that the whole frame is
+ * one vertex buffer and one draw. The alternative to instancing, where the
+ * GPU expands one square per offset instead of the CPU writing all of its
+ * vertices. Kept free of GL; the memory written into is usually a mapped
+ * buffer. */
+
+
+/* Vertices per square, two triangles. */
+#define SPRITE_VERTICES 6
+
+/* Floats per square. */
+#define SPRITE_FLOATS (2*SPRITE_VERTICES)
+
+
+typedef struct Sprite_Batch {
+    float * vertices; /* SPRITE_FLOATS per square. */
+    size_t count; /* Squares. */
+    size_t capacity;
+} Sprite_Batch;
+
+
+void sprite_batch_begin(Sprite_Batch * batch, float * vertices, size_t capacity);
+size_t sprite_batch_squares(Sprite_Batch * batch,
+                            const float * xs,
+                            const float * ys,
+                            size_t stride,
+                            size_t count,
+                            float half_width,
+                            float half_height);
+
+#endif
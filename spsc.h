@@ -0,0 +1,67 @@
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+/* Indices of a lock-free single producer, single consumer ring, kept apart
+ * from its elements so every queue of the game shares the one set of
+ * memory orderings. The owner keeps an array of a power of two elements
+ * next to the ring and passes its length along.
+ *
+ * The producer asks for the slot of the next element, writes the element
+ * and publishes it; the consumer asks for the slot of the oldest, reads it
+ * and releases it. Every call takes a fixed number of steps, so neither
+ * side ever waits on the other. The release store of one side and the
+ * acquire load of the other order the element's contents with the index
+ * that hands it over. */
+
+
+typedef struct Spsc_Ring {
+    _Alignas(64) _Atomic size_t head; /* Written by the producer. */
+    _Alignas(64) _Atomic size_t tail; /* Written by the consumer. */
+    size_t dropped; /* Elements offered while full, producer only. */
+} Spsc_Ring;
+
+
+static inline int spsc_reserve(Spsc_Ring * ring, size_t size, size_t * slot) {
+    /* Producer only. Store the slot of the next element in 'slot'. Returns
+     * 0 on success, -1 if the ring is full and the element is dropped. */
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail == size) {
+        ring->dropped++;
+        return -1;
+    }
+    *slot = head & (size - 1);
+    return 0;
+}
+
+
+static inline void spsc_publish(Spsc_Ring * ring) {
+    /* Producer only. Hand over the element written to the reserved slot. */
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+
+static inline int spsc_front(Spsc_Ring * ring, size_t size, size_t * slot) {
+    /* Consumer only. Store the slot of the oldest element in 'slot'.
+     * Returns 0 if the ring is empty. */
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (tail == head) {
+        return 0;
+    }
+    *slot = tail & (size - 1);
+    return 1;
+}
+
+
+static inline void spsc_release(Spsc_Ring * ring) {
+    /* Consumer only. Give the oldest element's slot back to the producer. */
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+#endif
@@ -0,0 +1,54 @@
+#include "timestep.h"
+
+
+void timestep_init(Timestep * timestep, int tick_rate, double time_now) {
+    /* Set up 'timestep' to produce 'tick_rate' ticks per second, starting
+     * at 'time_now'. */
+    timestep->tick_length = 1.0/tick_rate;
+    timestep->accumulator = 0.0;
+    timestep->time_previous = time_now;
+
+    /* Never fall further behind than a quarter of a second per frame. */
+    timestep->max_ticks_per_frame = tick_rate/4 > 1 ? tick_rate/4 : 1;
+}
+
+
+int timestep_advance(Timestep * timestep, double time_now) {
+    /* Add the real time passed since the last call and return the number of
+     * fixed ticks that should be simulated now. */
+
+    double time_frame = time_now - timestep->time_previous;
+    timestep->time_previous = time_now;
+
+    /* Clamp negative jumps from the clock. */
+    if (time_frame < 0.0) {
+        time_frame = 0.0;
+    }
+
+    timestep->accumulator += time_frame;
+
+    int num_ticks = timestep->accumulator/timestep->tick_length;
+
+    /* Drop time we can not catch up on instead of stalling. */
+    if (num_ticks > timestep->max_ticks_per_frame) {
+        num_ticks = timestep->max_ticks_per_frame;
+        timestep->accumulator = num_ticks*timestep->tick_length;
+    }
+
+    timestep->accumulator -= num_ticks*timestep->tick_length;
+    return num_ticks;
+}
+
+
+double timestep_tick_end(const Timestep * timestep, int num_ticks, int tick) {
+    /* Return the real time that tick 'tick' of the 'num_ticks' returned by
+     * the last timestep_advance catches the simulation up to. */
+    return timestep->time_previous - timestep->accumulator -
+           (num_ticks-1 - tick)*timestep->tick_length;
+}
+
+
+float timestep_alpha(const Timestep * timestep) {
+    /* Return how far real time is between the last two ticks, in [0, 1). */
+    return timestep->accumulator/timestep->tick_length;
+}
@@ -0,0 +1,22 @@
+#ifndef TIMESTEP_H
+#define TIMESTEP_H
+
+/* Accumulator based fixed-timestep scheduler. Real time is fed in once per
+ * rendered frame and converted into a whole number of simulation ticks plus
+ * an interpolation factor for rendering between the last two ticks. */
+
+
+typedef struct Timestep {
+    double tick_length; /* Seconds per simulation tick. */
+    double accumulator; /* Real time not yet consumed by ticks. */
+    double time_previous;
+    int max_ticks_per_frame; /* Cap to avoid spiralling on slow frames. */
+} Timestep;
+
+
+void timestep_init(Timestep * timestep, int tick_rate, double time_now);
+int timestep_advance(Timestep * timestep, double time_now);
+double timestep_tick_end(const Timestep * timestep, int num_ticks, int tick);
+float timestep_alpha(const Timestep * timestep);
+
+#endif
@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "trace.h"
+
+
+typedef struct Trace_Buffer {
+    Trace_Event events[TRACE_CAPACITY];
+    _Atomic uint64_t head; /* Total number of events ever written. */
+    uint32_t thread_index;
+    struct Trace_Buffer * next;
+} Trace_Buffer;
+
+
+/* Per-thread buffer, allocated once on the first event of each thread. */
+static _Thread_local Trace_Buffer * trace_buffer_local;
+
+/* All buffers ever allocated, only touched when a thread registers. */
+static Trace_Buffer * trace_buffers;
+static uint32_t trace_num_threads;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+static Trace_Buffer * trace_buffer_register(void) {
+    /* Allocate and register the ring buffer for the calling thread. */
+    Trace_Buffer * buffer = calloc(1, sizeof(*buffer));
+    if (!buffer) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&trace_lock);
+    buffer->thread_index = trace_num_threads++;
+    buffer->next = trace_buffers;
+    trace_buffers = buffer;
+    pthread_mutex_unlock(&trace_lock);
+
+    trace_buffer_local = buffer;
+    return buffer;
+}
+
+
+double trace_now(void) {
+    /* Monotonic time in seconds, the clock of the trace and of every
+     * timing the game takes, on any thread and also before glfwInit. */
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+
+void trace_event(Trace_Phase phase, const char * name, int64_t value) {
+    /* Append one event to the calling thread's ring buffer. */
+
+    Trace_Buffer * buffer = trace_buffer_local;
+    if (!buffer) {
+        buffer = trace_buffer_register();
+        if (!buffer) {
+            return;
+        }
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    uint64_t head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    Trace_Event * event = &buffer->events[head & (TRACE_CAPACITY-1)];
+    event->timestamp = (uint64_t)ts.tv_sec*1000000000u + ts.tv_nsec;
+    event->name = name;
+    event->value = value;
+    event->phase = phase;
+
+    /* Publish the event for trace_dump. */
+    atomic_store_explicit(&buffer->head, head+1, memory_order_release);
+}
+
+
+int trace_dump(const char * path) {
+    /* Write the events of all threads to 'path' as Chrome trace JSON.
+     * Returns 0 on success. Events from other threads that are written while
+     * dumping may show up torn; dump from a quiet point when that matters. */
+
+    FILE * file = fopen(path, "w");
+    if (!file) {
+        return -1;
+    }
+
+    const char * phases[] = {"B", "E", "C"};
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    bool first = true;
+
+    pthread_mutex_lock(&trace_lock);
+    for (Trace_Buffer * buffer = trace_buffers; buffer; buffer = buffer->next) {
+        uint64_t head = atomic_load_explicit(&buffer->head, memory_order_acquire);
+        uint64_t start = head > TRACE_CAPACITY ? head - TRACE_CAPACITY : 0;
+
+        for (uint64_t i=start; i<head; i++) {
+            Trace_Event event = buffer->events[i & (TRACE_CAPACITY-1)];
+
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,"
+                    "\"pid\":1,\"tid\":%u",
+                    first ? "" : ",\n",
+                    event.name,
+                    phases[event.phase],
+                    event.timestamp*1e-3,
+                    buffer->thread_index);
+            if (event.phase == TRACE_PHASE_COUNTER) {
+                fprintf(file, ",\"args\":{\"value\":%lld}", (long long)event.value);
+            }
+            fprintf(file, "}");
+            first = false;
+        }
+    }
+    pthread_mutex_unlock(&trace_lock);
+
+    fprintf(file, "\n]}\n");
+    return fclose(file);
+}
@@ -0,0 +1,49 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/* Low-overhead frame tracing. Events are written as fixed-size binary
+ * records into a preallocated ring buffer owned by the calling thread and
+ * only formatted when dumped as Chrome trace JSON (chrome://tracing or
+ * https://ui.perfetto.dev). Without PONG_TRACE every macro compiles to
+ * nothing. Names must be string literals; only the pointer is stored. */
+
+
+/* Number of events kept per thread; older events are overwritten. */
+#define TRACE_CAPACITY (1 << 16)
+
+
+typedef enum Trace_Phase {
+    TRACE_PHASE_BEGIN,
+    TRACE_PHASE_END,
+    TRACE_PHASE_COUNTER,
+} Trace_Phase;
+
+
+typedef struct Trace_Event {
+    uint64_t timestamp; /* Nanoseconds, monotonic clock. */
+    const char * name;
+    int64_t value; /* Counter value, unused for scopes. */
+    uint32_t phase;
+} Trace_Event;
+
+
+double trace_now(void);
+void trace_event(Trace_Phase phase, const char * name, int64_t value);
+int trace_dump(const char * path);
+
+
+#ifdef PONG_TRACE
+#define TRACE_BEGIN(name) trace_event(TRACE_PHASE_BEGIN, (name), 0)
+#define TRACE_END(name) trace_event(TRACE_PHASE_END, (name), 0)
+#define TRACE_COUNTER(name, value) trace_event(TRACE_PHASE_COUNTER, (name), (value))
+#define TRACE_DUMP(path) ((void)trace_dump(path))
+#else
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END(name) ((void)0)
+#define TRACE_COUNTER(name, value) ((void)0)
+#define TRACE_DUMP(path) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,147 @@
+#include <string.h>
+
+#include "transforms.h"
+
+
+/* Instance divisor of a slot shared by every instance, one no draw reaches. */
+#define TRANSFORMS_DIVISOR_FIXED ((GLuint)-1)
+
+
+int transform_ring_init(Transform_Ring * ring, size_t num_slots) {
+    /* Create the ring for 'num_slots' matrices per frame, at most
+     * TRANSFORMS_MAX. Needs a current context. Returns 0 on success, -1 on
+     * failure. */
+
+    memset(ring, 0, sizeof(*ring));
+    if (num_slots == 0 || num_slots > TRANSFORMS_MAX) {
+        return -1;
+    }
+
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    if (alignment < 1) {
+        alignment = 256;
+    }
+    /* Every segment backs the whole block, whose size the shader fixes. */
+    ring->num_slots = num_slots;
+    ring->size_segment = (TRANSFORMS_MAX*sizeof(m4) + alignment - 1)/alignment*alignment;
+    size_t size = TRANSFORMS_FRAMES*ring->size_segment;
+
+    GLint slots[TRANSFORMS_MAX];
+    for (size_t i=0; i<TRANSFORMS_MAX; i++) {
+        slots[i] = (GLint)i;
+    }
+    glGenBuffers(1, &ring->slots);
+    glBindBuffer(GL_ARRAY_BUFFER, ring->slots);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(slots), slots, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &ring->buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, ring->buffer);
+
+    if (GLEW_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_UNIFORM_BUFFER, size, NULL, flags);
+        ring->mapped = glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags);
+        ring->persistent = ring->mapped != NULL;
+    }
+    if (!ring->persistent) {
+        /* Storage made with glBufferStorage can not be respecified, so
+         * start over with a fresh buffer. */
+        if (GLEW_ARB_buffer_storage) {
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            glDeleteBuffers(1, &ring->buffer);
+            glGenBuffers(1, &ring->buffer);
+            glBindBuffer(GL_UNIFORM_BUFFER, ring->buffer);
+        }
+        glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_STREAM_DRAW);
+        ring->mapped = NULL;
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    return glGetError() == GL_NO_ERROR ? 0 : -1;
+}
+
+
+void transform_ring_free(Transform_Ring * ring) {
+    for (size_t i=0; i<TRANSFORMS_FRAMES; i++) {
+        if (ring->fences[i]) {
+            glDeleteSync(ring->fences[i]);
+        }
+    }
+    if (ring->persistent) {
+        glBindBuffer(GL_UNIFORM_BUFFER, ring->buffer);
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &ring->buffer);
+    glDeleteBuffers(1, &ring->slots);
+    memset(ring, 0, sizeof(*ring));
+}
+
+
+int transform_ring_upload(Transform_Ring * ring, m4 * matrices) {
+    /* Move on to the next segment and write 'matrices', one per slot, into
+     * it. Call once per frame before the draws. Returns 0 on success, -1 if
+     * the segment could not be mapped. */
+
+    /* Wait until the GPU is done with the draws that last read the next
+     * segment. */
+    ring->segment = (ring->segment + 1) % TRANSFORMS_FRAMES;
+    ring->waits += gl_fence_wait(&ring->fences[ring->segment]);
+
+    size_t offset = ring->segment*ring->size_segment;
+    uint8_t * segment;
+    if (ring->persistent) {
+        segment = ring->mapped + offset;
+    } else {
+        /* The fence already kept the GPU out of this range. */
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT |
+                           GL_MAP_INVALIDATE_RANGE_BIT;
+        glBindBuffer(GL_UNIFORM_BUFFER, ring->buffer);
+        segment = glMapBufferRange(GL_UNIFORM_BUFFER, offset, ring->size_segment, flags);
+        if (!segment) {
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            return -1;
+        }
+    }
+
+    memcpy(segment, matrices, ring->num_slots*sizeof(m4));
+
+    if (!ring->persistent) {
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+    return 0;
+}
+
+
+void transform_ring_attach(const Transform_Ring * ring, GLuint vertex_array, size_t slot,
+                           int per_instance) {
+    /* Have draws of 'vertex_array' use the matrix in 'slot', or if
+     * 'per_instance' instance i the one in slot + i. Binds behind the
+     * back of any Gl_State. */
+    glBindVertexArray(vertex_array);
+    glBindBuffer(GL_ARRAY_BUFFER, ring->slots);
+    glVertexAttribIPointer(TRANSFORMS_ATTRIBUTE, 1, GL_INT, sizeof(GLint),
+                           (GLvoid*)(slot*sizeof(GLint)));
+    glEnableVertexAttribArray(TRANSFORMS_ATTRIBUTE);
+    glVertexAttribDivisor(TRANSFORMS_ATTRIBUTE, per_instance ? 1 : TRANSFORMS_DIVISOR_FIXED);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+void transform_ring_bind(const Transform_Ring * ring, Gl_State * state) {
+    /* Have the following draws read this frame's matrices. Call once per
+     * frame, after transform_ring_upload. */
+    GLintptr offset = ring->segment*ring->size_segment;
+    gl_bind_uniform_range(state, TRANSFORMS_BINDING, ring->buffer, offset,
+                          TRANSFORMS_MAX*sizeof(m4));
+}
+
+
+void transform_ring_fence(Transform_Ring * ring) {
+    /* Mark the end of this frame's draws. Call after the last one. */
+    ring->fences[ring->segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,64 @@
+#ifndef TRANSFORMS_H
+#define TRANSFORMS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <GL/glew.h>
+
+#include "scene.h"
+#include "gl_state.h"
+
+/* Per-entity transformation matrices in one uniform buffer, written once
+ * per frame instead of with a glUniformMatrix4fv call per draw.
+ *
+ * The buffer is a ring of TRANSFORMS_FRAMES segments, one per frame in
+ * flight, so the frame being written never holds matrices the GPU may still
+ * read. A fence after each frame's draws guards its segment for when the
+ * ring comes around. With ARB_buffer_storage the buffer is mapped once,
+ * persistently and coherently; without it each segment is mapped
+ * unsynchronized for the frame, which the fences make safe.
+ *
+ * A frame's matrices are one array in the shader's Transform block, bound
+ * once per frame, so draws change no uniform state at all. Each vertex
+ * array carries the slot of its entity's matrix as an integer attribute
+ * read from a small buffer of slot numbers: the same slot for every
+ * vertex and instance, or the next slot for every instance, so that one
+ * instanced draw covers entities with the same shape. */
+
+
+/* Frames the GPU may lag behind. */
+#define TRANSFORMS_FRAMES 3
+
+/* Matrices the Transform block holds, at least the slots of a ring. */
+#define TRANSFORMS_MAX 8
+
+/* Uniform buffer binding point of the Transform block, the one that
+ * transform_ring_bind binds the matrices to. */
+#define TRANSFORMS_BINDING 0
+
+/* Vertex attribute location of the slot, the shader's 'slot' input. */
+#define TRANSFORMS_ATTRIBUTE 2
+
+
+typedef struct Transform_Ring {
+    GLuint buffer;
+    GLuint slots; /* Vertex buffer of the slot numbers, 0 to num_slots-1. */
+    size_t num_slots; /* Matrices per frame. */
+    size_t size_segment; /* Bytes per frame, padded to the offset alignment. */
+    int persistent; /* Mapped once for good. */
+    uint8_t * mapped; /* Whole buffer if persistent, else current segment. */
+    GLsync fences[TRANSFORMS_FRAMES];
+    size_t segment; /* Written this frame. */
+    uint64_t waits; /* Frames that had to wait for the GPU. */
+} Transform_Ring;
+
+
+int transform_ring_init(Transform_Ring * ring, size_t num_slots);
+void transform_ring_free(Transform_Ring * ring);
+int transform_ring_upload(Transform_Ring * ring, m4 * matrices);
+void transform_ring_attach(const Transform_Ring * ring, GLuint vertex_array, size_t slot,
+                           int per_instance);
+void transform_ring_bind(const Transform_Ring * ring, Gl_State * state);
+void transform_ring_fence(Transform_Ring * ring);
+
+#endif